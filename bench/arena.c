@@ -0,0 +1,89 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ptab.h>
+
+#include "bench.h"
+
+#define MAP_SIZE ((size_t)1 << 30)
+
+struct arena_mode {
+	const char *ingest_name;
+	const char *render_name;
+	int map;
+	unsigned int flags;
+};
+
+static const struct arena_mode modes[] = {
+	{ "ingest-malloc", "render-malloc", 0, 0 },
+	{ "ingest-mmap", "render-mmap", 1, 0 },
+	{ "ingest-mmap-huge", "render-mmap-huge", 1, PTAB_MAP_HUGEPAGE },
+	{ NULL, NULL, 0, 0 }
+};
+
+/*
+ * compare the default malloc-backed arena against a mapped arena,
+ * both for filling a large table and for rendering it
+ */
+static void arena_run(const struct arena_mode *mode, size_t rows, FILE *out)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mode->map && ptab_mem_map(p, MAP_SIZE, mode->flags) != PTAB_OK) {
+		printf("%-24s unsupported\n", mode->ingest_name);
+		ptab_free(p);
+		return;
+	}
+
+	ptab_column(p, "Host", PTAB_STRING);
+	ptab_column(p, "Requests", PTAB_INTEGER);
+	ptab_column(p, "Status", PTAB_STRING);
+	ptab_column(p, "Path", PTAB_STRING);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (r & 1) ? "web01.example.com" : "db02");
+		ptab_row_data_i(p, "%d", (int)r);
+		ptab_row_data_s(p, (r % 7) ? "OK" : "ERROR");
+		ptab_row_data_s(p, "/api/v1/resources/items");
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(mode->ingest_name, rows, rows * 4, secs);
+
+	start = bench_seconds();
+	ptab_dumpf(p, out, PTAB_ASCII);
+	secs = bench_seconds() - start;
+	bench_report(mode->render_name, rows, rows * 4, secs);
+
+	ptab_free(p);
+}
+
+void arena_bench(void)
+{
+	const struct arena_mode *mode;
+	FILE *out;
+
+	out = fopen("/dev/null", "w");
+	if (!out) {
+		fprintf(stderr, "could not open /dev/null\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (mode = modes; mode->ingest_name; mode++)
+		arena_run(mode, 2000000, out);
+
+	fclose(out);
+}
@@ -0,0 +1,16 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+/* main.c */
+extern double bench_seconds(void);
+extern void bench_report(const char *name, size_t rows, size_t cells, double secs);
+
+/* benchmarks */
+extern void ingest_bench(void);
+extern void arena_bench(void);
+extern void concurrent_bench(void);
+extern void layout_bench(void);
+
+#endif
@@ -0,0 +1,84 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <ptab.h>
+
+#include "bench.h"
+
+#define MAX_THREADS 8
+#define TOTAL_ROWS 2000000
+
+struct worker {
+	ptab_t *p;
+	size_t rows;
+	int id;
+};
+
+static void *worker_func(void *arg)
+{
+	struct worker *w = arg;
+	size_t r;
+
+	for (r = 0; r < w->rows; r++) {
+		ptab_begin_row(w->p);
+		ptab_row_data_s(w->p, (r & 1) ? "worker" : "concurrent");
+		ptab_row_data_i(w->p, "%d", w->id);
+		ptab_row_data_i(w->p, "%d", (int)r);
+		ptab_end_row(w->p);
+	}
+
+	return NULL;
+}
+
+/*
+ * the same number of rows split across more and more threads; with
+ * a shard per thread, the time should drop as threads are added
+ */
+static void concurrent_run(int num_threads)
+{
+	struct worker workers[MAX_THREADS];
+	pthread_t threads[MAX_THREADS];
+	char name[32];
+	double start, secs;
+	ptab_t *p;
+	int i;
+
+	p = ptab_init(NULL);
+	if (!p || ptab_concurrent(p) != PTAB_OK) {
+		fprintf(stderr, "could not create a concurrent table\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Worker", PTAB_INTEGER);
+	ptab_column(p, "Row", PTAB_INTEGER);
+
+	start = bench_seconds();
+
+	for (i = 0; i < num_threads; i++) {
+		workers[i].p = p;
+		workers[i].rows = TOTAL_ROWS / (size_t)num_threads;
+		workers[i].id = i;
+		pthread_create(&threads[i], NULL, worker_func, &workers[i]);
+	}
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	secs = bench_seconds() - start;
+
+	snprintf(name, sizeof(name), "concurrent-%d", num_threads);
+	bench_report(name, TOTAL_ROWS, TOTAL_ROWS * 3, secs);
+
+	ptab_free(p);
+}
+
+void concurrent_bench(void)
+{
+	int n;
+
+	for (n = 1; n <= MAX_THREADS; n *= 2)
+		concurrent_run(n);
+}
@@ -0,0 +1,534 @@
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ptab.h>
+
+#include "bench.h"
+
+static const char *words[] = {
+	"Alabama", "AL", "Tuscaloosa", "Bryant Denny", "101821",
+	"Arkansas", "AR", "Fayetteville", "Razorback Stadium", "72000",
+	"Auburn", "Jordan Hare", "LSU", "Baton Rouge", "Tiger Stadium"
+};
+
+#define NUM_WORDS (sizeof(words) / sizeof(words[0]))
+#define NUM_COLUMNS 4
+
+/*
+ * fill a table of string columns; this is dominated by the
+ * arena allocator, so the cost per cell should not grow with
+ * the size of the table
+ */
+static void ingest_strings(size_t rows)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_STRING);
+	ptab_column(p, "B", PTAB_STRING);
+	ptab_column(p, "C", PTAB_STRING);
+	ptab_column(p, "D", PTAB_STRING);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++)
+			ptab_row_data_s(p, words[(r + (size_t)c) % NUM_WORDS]);
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report("ingest-strings", rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * the string table again, but borrowing the words from one buffer,
+ * the way a table built over a memory-mapped file would
+ */
+static void ref_strings(size_t rows)
+{
+	char text[256];
+	size_t offsets[NUM_WORDS], lens[NUM_WORDS];
+	size_t used = 0;
+	ptab_t *p;
+	double start, secs;
+	size_t r, w;
+	int c;
+
+	for (w = 0; w < NUM_WORDS; w++) {
+		offsets[w] = used;
+		lens[w] = strlen(words[w]);
+		memcpy(text + used, words[w], lens[w]);
+		used += lens[w];
+	}
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_STRING);
+	ptab_column(p, "B", PTAB_STRING);
+	ptab_column(p, "C", PTAB_STRING);
+	ptab_column(p, "D", PTAB_STRING);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++) {
+			w = (r + (size_t)c) % NUM_WORDS;
+			ptab_row_data_s_ref(p, text + offsets[w], lens[w]);
+		}
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report("ref-strings", rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/* how ingest_mixed formats its numeric columns */
+enum mixed_mode {
+	MIXED_PRINTF,
+	MIXED_FORMAT,
+	MIXED_LAZY
+};
+
+static const char *const mixed_names[] = {
+	"ingest-mixed", "ingest-mixed-format", "ingest-mixed-lazy"
+};
+
+/*
+ * same as above, but with the printf-formatted numeric columns; with
+ * column formats they are parsed once up front, and a lazy table keeps
+ * the numbers and leaves the formatting for later
+ */
+static void ingest_mixed(size_t rows, enum mixed_mode mode)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Count", PTAB_INTEGER);
+	ptab_column(p, "Ratio", PTAB_FLOAT);
+	ptab_column(p, "State", PTAB_STRING);
+
+	if (mode == MIXED_FORMAT) {
+		ptab_column_format(p, 1, "%d");
+		ptab_column_format(p, 2, "%.3f");
+	} else if (mode == MIXED_LAZY) {
+		ptab_column_lazy(p, 1, "%d");
+		ptab_column_lazy(p, 2, "%.3f");
+	}
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, words[r % NUM_WORDS]);
+		ptab_row_data_i(p, "%d", (int)r);
+		ptab_row_data_f(p, "%.3f", (float)r / 7.0f);
+		ptab_row_data_s(p, words[(r + 1) % NUM_WORDS]);
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(mixed_names[mode], rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * a table of int columns; "%1d" prints the same as "%d", but it has
+ * to go through printf, where a bare "%d" doesn't
+ */
+static void ingest_ints(size_t rows, const char *format)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_INTEGER);
+	ptab_column(p, "B", PTAB_INTEGER);
+	ptab_column(p, "C", PTAB_INTEGER);
+	ptab_column(p, "D", PTAB_INTEGER);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++)
+			ptab_row_data_i(p, format, (int)(r * 7919u) >> (c * 8));
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(strcmp(format, "%d") == 0 ? "ingest-ints" : "ingest-ints-printf",
+		     rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * a table of 64-bit counters, the same way: "%1" PRIu64 has to go
+ * through printf, and a bare "%" PRIu64 doesn't
+ */
+static void ingest_u64(size_t rows, const char *format)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_UINT64);
+	ptab_column(p, "B", PTAB_UINT64);
+	ptab_column(p, "C", PTAB_UINT64);
+	ptab_column(p, "D", PTAB_UINT64);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++)
+			ptab_row_data_u64(p, format, (uint64_t)r * 0x9e3779b97f4a7c15u >> (c * 16));
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(strcmp(format, "%" PRIu64) == 0 ? "ingest-u64" : "ingest-u64-printf",
+		     rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * a table of decimal columns, to the cent, which are written the same
+ * way as integers
+ */
+static void ingest_decimals(size_t rows)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column_decimal(p, "A", 2);
+	ptab_column_decimal(p, "B", 2);
+	ptab_column_decimal(p, "C", 2);
+	ptab_column_decimal(p, "D", 2);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++)
+			ptab_row_data_dec(p, (int64_t)(r * 7919u) >> (c * 8));
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report("ingest-decimals", rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * a table of timestamp columns to the millisecond, with rows a few
+ * milliseconds apart as a log's would be, against the same text made
+ * with gmtime and strftime for each cell
+ */
+static void ingest_timestamps(size_t rows, bool by_strftime)
+{
+	ptab_t *p;
+	double start, secs;
+	char buf[64];
+	int64_t ns;
+	size_t r, len;
+	time_t t;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (c = 0; c < NUM_COLUMNS; c++) {
+		ptab_column(p, "Time", by_strftime ? PTAB_STRING : PTAB_TIMESTAMP);
+		if (!by_strftime)
+			ptab_column_format(p, (unsigned int)c, "%F %T.%3N");
+	}
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++) {
+			ns = INT64_C(1700000000000000000) + (int64_t)r * 3456789 + c * 1000000;
+
+			if (by_strftime) {
+				t = (time_t)(ns / 1000000000);
+				len = strftime(buf, sizeof(buf), "%F %T", gmtime(&t));
+				snprintf(buf + len, sizeof(buf) - len, ".%03d",
+					 (int)(ns / 1000000 % 1000));
+				ptab_row_data_s(p, buf);
+			} else {
+				ptab_row_data_ts(p, ns);
+			}
+		}
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(by_strftime ? "ingest-timestamps-strftime" : "ingest-timestamps",
+		     rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * a table of double columns, with a "%.3f" and with no format, which
+ * are written without printf, and with a "%1.3f" and a "%.17g", which
+ * print the same as those or longer but have to go through printf
+ */
+static void ingest_doubles(size_t rows, const char *name, const char *format)
+{
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_DOUBLE);
+	ptab_column(p, "B", PTAB_DOUBLE);
+	ptab_column(p, "C", PTAB_DOUBLE);
+	ptab_column(p, "D", PTAB_DOUBLE);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < NUM_COLUMNS; c++)
+			ptab_row_data_d(p, format, (double)(r * 7919u % 100003u) / (c + 3));
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(name, rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * the string table again, added a batch at a time with
+ * ptab_append_rows, which leaves out the per-cell calls
+ */
+#define BATCH_ROWS 1024
+
+static void append_strings(size_t rows)
+{
+	ptab_value_t cells[BATCH_ROWS * NUM_COLUMNS];
+	ptab_value_t *v;
+	ptab_t *p;
+	double start, secs;
+	size_t r, i, n;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_STRING);
+	ptab_column(p, "B", PTAB_STRING);
+	ptab_column(p, "C", PTAB_STRING);
+	ptab_column(p, "D", PTAB_STRING);
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r += n) {
+		n = (rows - r < BATCH_ROWS) ? rows - r : BATCH_ROWS;
+
+		for (i = 0, v = cells; i < n; i++) {
+			for (c = 0; c < NUM_COLUMNS; c++, v++)
+				v->data.s = words[(r + i + (size_t)c) % NUM_WORDS];
+		}
+
+		ptab_append_rows(p, cells, n);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report("append-strings", rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+}
+
+/*
+ * the string table once more, loaded a column at a time from arrays
+ * with ptab_column_data_s
+ */
+static void load_strings(size_t rows)
+{
+	const char **columns;
+	ptab_t *p;
+	double start, secs;
+	size_t r;
+	int c;
+
+	columns = malloc(rows * NUM_COLUMNS * sizeof(*columns));
+	if (!columns) {
+		fprintf(stderr, "malloc failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (c = 0; c < NUM_COLUMNS; c++) {
+		for (r = 0; r < rows; r++)
+			columns[(size_t)c * rows + r] = words[(r + (size_t)c) % NUM_WORDS];
+	}
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ptab_column(p, "A", PTAB_STRING);
+	ptab_column(p, "B", PTAB_STRING);
+	ptab_column(p, "C", PTAB_STRING);
+	ptab_column(p, "D", PTAB_STRING);
+
+	start = bench_seconds();
+
+	for (c = 0; c < NUM_COLUMNS; c++)
+		ptab_column_data_s(p, (unsigned int)c, columns + (size_t)c * rows, rows);
+
+	secs = bench_seconds() - start;
+	bench_report("load-strings", rows, rows * NUM_COLUMNS, secs);
+
+	ptab_free(p);
+	free(columns);
+}
+
+void ingest_bench(void)
+{
+	size_t rows;
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_strings(rows);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ref_strings(rows);
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_mixed(rows, MIXED_PRINTF);
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_mixed(rows, MIXED_FORMAT);
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_mixed(rows, MIXED_LAZY);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_ints(rows, "%1d");
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_ints(rows, "%d");
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_u64(rows, "%1" PRIu64);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_u64(rows, "%" PRIu64);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_decimals(rows);
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_timestamps(rows, true);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		ingest_timestamps(rows, false);
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_doubles(rows, "ingest-doubles-printf", "%1.3f");
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_doubles(rows, "ingest-doubles-fixed", "%.3f");
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_doubles(rows, "ingest-doubles-printf-g", "%.17g");
+
+	for (rows = 1000; rows <= 1000000; rows *= 4)
+		ingest_doubles(rows, "ingest-doubles-shortest", NULL);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		append_strings(rows);
+
+	for (rows = 1000; rows <= 4000000; rows *= 4)
+		load_strings(rows);
+}
@@ -0,0 +1,96 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ptab.h>
+
+#include "bench.h"
+
+static const char *names[] = {
+	"north", "south", "east", "west", "central", "remote"
+};
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+/*
+ * fill and render a table of the given shape; the wide table has many
+ * columns for each row, the tall one many rows for each column. the
+ * string columns can be kept as dictionaries
+ */
+static void layout_run(const char *ingest_name,
+		       const char *render_name,
+		       size_t rows,
+		       int columns,
+		       int dict,
+		       FILE *out)
+{
+	ptab_mem_stats_t stats;
+	double start, secs;
+	char name[16];
+	size_t r;
+	ptab_t *p;
+	int c;
+
+	p = ptab_init(NULL);
+	if (!p) {
+		fprintf(stderr, "ptab_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (c = 0; c < columns; c++) {
+		snprintf(name, sizeof(name), "col%d", c);
+		ptab_column(p, name, (c % 2) ? PTAB_INTEGER : PTAB_STRING);
+
+		if (dict && c % 2 == 0)
+			ptab_column_dict(p, (unsigned int)c);
+	}
+
+	start = bench_seconds();
+
+	for (r = 0; r < rows; r++) {
+		ptab_begin_row(p);
+
+		for (c = 0; c < columns; c++) {
+			if (c % 2)
+				ptab_row_data_i(p, "%d", (int)(r + (size_t)c));
+			else
+				ptab_row_data_s(p, names[(r + (size_t)c) % NUM_NAMES]);
+		}
+
+		ptab_end_row(p);
+	}
+
+	secs = bench_seconds() - start;
+	bench_report(ingest_name, rows, rows * (size_t)columns, secs);
+
+	/* how much memory each cell takes once it is in the table */
+	ptab_mem_stats(p, &stats);
+	printf("%-24s used=%-10lu %6.2f bytes/cell\n",
+	       ingest_name,
+	       (unsigned long)stats.used,
+	       (double)stats.used / (double)(rows * (size_t)columns));
+
+	start = bench_seconds();
+	ptab_dumpf(p, out, PTAB_ASCII);
+	secs = bench_seconds() - start;
+	bench_report(render_name, rows, rows * (size_t)columns, secs);
+
+	ptab_free(p);
+}
+
+void layout_bench(void)
+{
+	FILE *out;
+
+	out = fopen("/dev/null", "w");
+	if (!out) {
+		fprintf(stderr, "could not open /dev/null\n");
+		exit(EXIT_FAILURE);
+	}
+
+	layout_run("ingest-wide", "render-wide", 20000, 64, 0, out);
+	layout_run("ingest-tall", "render-tall", 2000000, 4, 0, out);
+	layout_run("ingest-tall-dict", "render-tall-dict", 2000000, 4, 1, out);
+
+	fclose(out);
+}
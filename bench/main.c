@@ -0,0 +1,72 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ptab.h>
+
+#include "bench.h"
+
+struct bench {
+	const char *name;
+	void (*func)(void);
+};
+
+static const struct bench benches[] = {
+	{ "ingest", ingest_bench },
+	{ "arena", arena_bench },
+	{ "concurrent", concurrent_bench },
+	{ "layout", layout_bench },
+	{ NULL, NULL }
+};
+
+double bench_seconds(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+void bench_report(const char *name, size_t rows, size_t cells, double secs)
+{
+	double ns_per_cell = 0.0;
+
+	if (cells > 0)
+		ns_per_cell = (secs * 1e9) / (double)cells;
+
+	printf("%-24s rows=%-9lu cells=%-10lu %9.3f ms %8.2f ns/cell\n",
+	       name,
+	       (unsigned long)rows,
+	       (unsigned long)cells,
+	       secs * 1e3,
+	       ns_per_cell);
+}
+
+static int selected(const char *name, int argc, char **argv)
+{
+	int i;
+
+	/* run everything if no benchmarks were named */
+	if (argc < 2)
+		return 1;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], name) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const struct bench *b;
+
+	printf("libptab %s benchmarks\n", ptab_version());
+
+	for (b = benches; b->name; b++) {
+		if (selected(b->name, argc, argv))
+			b->func();
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -26,6 +26,7 @@
 #define PTAB_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 
@@ -47,6 +48,13 @@ extern "C" {
 #define PTAB_EALIGN      (-6)
 #define PTAB_EFORMAT     (-7)
 #define PTAB_ECOLUMNS    (-8)
+#define PTAB_ESUPPORT    (-9)
+#define PTAB_EIO         (-10)
+
+#define PTAB_DECIMAL_MAX_SCALE  18
+
+#define PTAB_MAP_HUGEPAGE  (1 << 0)
+#define PTAB_MAP_RELEASE   (1 << 1)
 
 
 #ifdef __linux__
@@ -57,9 +65,14 @@ extern "C" {
 /* enums */
 
 enum ptab_type {
-	PTAB_STRING  = 1,
-	PTAB_INTEGER = 2,
-	PTAB_FLOAT   = 3
+	PTAB_STRING    = 1,
+	PTAB_INTEGER   = 2,
+	PTAB_FLOAT     = 3,
+	PTAB_DOUBLE    = 4,
+	PTAB_INT64     = 5,
+	PTAB_UINT64    = 6,
+	PTAB_DECIMAL   = 7,
+	PTAB_TIMESTAMP = 8
 };
 
 enum ptab_align {
@@ -79,8 +92,17 @@ enum ptab_format {
 typedef void *(*ptab_alloc_func)(size_t size, void *opaque);
 typedef void (*ptab_free_func)(void *p, void *opaque);
 
+typedef void *(*ptab_alloc2_func)(size_t size, size_t align, void *opaque);
+typedef void (*ptab_free2_func)(void *p, size_t size, size_t align, void *opaque);
+typedef void *(*ptab_realloc2_func)(void *p,
+				    size_t old_size,
+				    size_t new_size,
+				    size_t align,
+				    void *opaque);
+
 /* opaque library internals */
 typedef struct ptab_internal ptab_t;
+typedef struct ptab_pool ptab_pool_t;
 
 
 /* structures */
@@ -91,11 +113,49 @@ typedef struct ptab_allocator {
 	void *opaque;
 } ptab_allocator_t;
 
+#define PTAB_ALLOCATOR_VERSION 2
+
+typedef struct ptab_allocator2 {
+	unsigned int version;             /* PTAB_ALLOCATOR_VERSION */
+	ptab_alloc2_func alloc_func;
+	ptab_free2_func free_func;
+	ptab_realloc2_func realloc_func;  /* optional, may be NULL */
+	void *opaque;
+} ptab_allocator2_t;
+
 typedef struct ptab_string {
 	const char *str;
 	size_t len;
 } ptab_string_t;
 
+/*
+ * one cell for ptab_append_rows; the column's type says which member
+ * of data is used, and numeric cells are formatted with format as in
+ * ptab_row_data_i, ptab_row_data_f, ptab_row_data_d, ptab_row_data_i64
+ * and ptab_row_data_u64. a PTAB_DECIMAL cell's value is in data.i64,
+ * and it has no format, and the same goes for a PTAB_TIMESTAMP cell
+ */
+typedef struct ptab_value {
+	const char *format;
+	union {
+		const char *s;
+		int i;
+		float f;
+		double d;
+		int64_t i64;
+		uint64_t u64;
+	} data;
+} ptab_value_t;
+
+typedef struct ptab_mem_stats {
+	size_t used;          /* bytes handed out for table data */
+	size_t reserved;      /* bytes currently held from the allocator */
+	size_t wasted;        /* unused space that can't be filled in order */
+	size_t blocks;        /* number of memory blocks held */
+	size_t largest_block; /* size of the largest block, in bytes */
+	size_t peak;          /* highest value reserved has reached */
+} ptab_mem_stats_t;
+
 
 /* functions */
 
@@ -127,6 +187,21 @@ extern PTAB_EXPORT const char *ptab_strerror(int err);
  */
 extern PTAB_EXPORT ptab_t *ptab_init(const ptab_allocator_t *a);
 
+/*
+ * ptab_init2
+ *
+ * Like ptab_init, but with the versioned ptab_allocator2_t, whose
+ * version must be set to PTAB_ALLOCATOR_VERSION. Every call passes the
+ * alignment the memory needs (a power of two), and free_func is also
+ * given the size that was allocated, so no size lookup is needed. The
+ * optional realloc_func must resize the block at p to new_size without
+ * moving it and return p, or return NULL and leave the block alone;
+ * when provided, the table grows its current block in place instead of
+ * starting a new one. NULL is returned if the allocator is invalid or
+ * memory could not be acquired from it.
+ */
+extern PTAB_EXPORT ptab_t *ptab_init2(const ptab_allocator2_t *a);
+
 /*
  * ptab_free
  *
@@ -136,17 +211,133 @@ extern PTAB_EXPORT ptab_t *ptab_init(const ptab_allocator_t *a);
  */
 extern PTAB_EXPORT int ptab_free(ptab_t *p);
 
+/*
+ * ptab_reset
+ *
+ * Remove all of the rows from the table, but keep the columns so that
+ * it can be filled again. The memory that held the rows is kept by the
+ * table and reused for the new rows, so rebuilding a table of the same
+ * shape does not need to go back to the allocator. Any ptab_string_t
+ * objects associated with the table are released.
+ */
+extern PTAB_EXPORT int ptab_reset(ptab_t *p);
+
+/*
+ * ptab_clear
+ *
+ * Remove all of the rows and columns from the table, leaving it in the
+ * same state as a table fresh from ptab_init. As with ptab_reset, the
+ * table keeps its memory for reuse and releases any ptab_string_t
+ * objects associated with it.
+ */
+extern PTAB_EXPORT int ptab_clear(ptab_t *p);
+
+/*
+ * ptab_mem_stats
+ *
+ * Fill out a ptab_mem_stats_t with the memory usage of the table. The
+ * reserved and peak figures include everything the table has taken
+ * from the allocator, including the table structure itself and block
+ * headers. The peak is kept across calls to ptab_reset and ptab_clear.
+ * This walks the table's memory blocks, so avoid calling it for every
+ * row.
+ */
+extern PTAB_EXPORT int ptab_mem_stats(const ptab_t *p, ptab_mem_stats_t *stats);
+
+/*
+ * ptab_mem_map
+ *
+ * Reserve size bytes of virtual memory with mmap and use it for all of
+ * the table's data from then on. The kernel only commits the pages as
+ * they are filled, so a generous size costs little; once it runs out,
+ * the table goes back to its allocator. With PTAB_MAP_HUGEPAGE, the
+ * mapping is aligned for and advised to use transparent huge pages,
+ * which reduces TLB pressure for very large tables. With
+ * PTAB_MAP_RELEASE, ptab_reset and ptab_clear return the pages that
+ * held the rows to the operating system. Only one mapping can be made
+ * per table. Returns PTAB_ESUPPORT on platforms without mmap.
+ */
+extern PTAB_EXPORT int ptab_mem_map(ptab_t *p, size_t size, unsigned int flags);
+
+/*
+ * ptab_set_memory_limit
+ *
+ * Bound the memory used to hold rows to roughly bytes. Once the rows in
+ * memory reach the limit, they are written to an anonymous temporary
+ * file in tmpdir (or $TMPDIR, or /tmp if NULL is passed) and their
+ * memory is reused for the rows that follow. ptab_dumpf streams the
+ * spilled rows back in order, so the output is the same and peak memory
+ * stays bounded; ptab_dumps still needs room for the whole string.
+ * The file is created right away, and PTAB_EIO is returned if that
+ * fails. A limit of 0 stops any further spilling. Returns PTAB_ESUPPORT
+ * on platforms without mkstemp.
+ */
+extern PTAB_EXPORT int
+ptab_set_memory_limit(ptab_t *p, size_t bytes, const char *tmpdir);
+
+/*
+ * ptab_concurrent
+ *
+ * Allow rows to be added to the table from many threads at once. Each
+ * thread gets its own row cursor and memory arena the first time it
+ * calls ptab_begin_row, so threads never wait on each other, and the
+ * column widths are updated atomically. The rows of each thread stay
+ * in order, and are merged into the table one thread after another by
+ * the next ptab_dumps or ptab_dumpf. Everything other than
+ * ptab_reserve, ptab_begin_row, ptab_row_data_* and ptab_end_row must
+ * still be called while no rows are being added, and the allocator
+ * must be safe to call from any thread. This must be called before
+ * any rows are added, and cannot be combined with
+ * ptab_set_memory_limit (PTAB_EORDER is returned).
+ */
+extern PTAB_EXPORT int ptab_concurrent(ptab_t *p);
+
 /*
  * ptab_free_string
  *
- * Release the resources held by a ptab_string_t object. After calling
- * this function, it is no longer safe to access the str compnent of
- * the structure. Note: it is not necessary to call this function if
- * you will be calling ptab_free afterwards, as that function will clean
- * up all ptab_string_t objects associated with the table.
+ * Release the resources held by a ptab_string_t object. The str
+ * component is set to NULL (and len to 0), so releasing the same
+ * ptab_string_t again does nothing. The memory is kept by the table and
+ * reused by the next call to ptab_dumps or ptab_dumpf. Strings that did
+ * not come from this table are ignored; only their pointers are
+ * compared, and their memory is never read.
+ * Note: it is not necessary to call this function if you will be
+ * calling ptab_free afterwards, as that function will clean up all
+ * ptab_string_t objects associated with the table.
  */
 extern PTAB_EXPORT int ptab_free_string(ptab_t *p, ptab_string_t *s);
 
+/*
+ * ptab_pool_init
+ *
+ * Allocate a block pool that can be shared by many tables, using the
+ * provided memory allocation functions (or malloc and free if NULL is
+ * passed). Tables created with the pool's allocator borrow their memory
+ * blocks from the pool and return them when freed, so creating many
+ * short-lived tables does not go back to the allocator every time.
+ * Each thread keeps a small cache of blocks, so the pool can be used
+ * by tables on different threads at the same time. NULL is returned if
+ * memory could not be acquired.
+ */
+extern PTAB_EXPORT ptab_pool_t *ptab_pool_init(const ptab_allocator_t *a);
+
+/*
+ * ptab_pool_allocator
+ *
+ * Fill out a ptab_allocator_t that takes its memory from the pool.
+ * Pass it to ptab_init to create a table that uses the pool.
+ */
+extern PTAB_EXPORT int ptab_pool_allocator(ptab_pool_t *pool, ptab_allocator_t *a);
+
+/*
+ * ptab_pool_free
+ *
+ * Release the pool and all of the memory that it holds. Every table
+ * that uses the pool must have been freed, and no other thread may be
+ * using the pool, before calling this function.
+ */
+extern PTAB_EXPORT int ptab_pool_free(ptab_pool_t *pool);
+
 /*
  * ptab_column
  *
@@ -158,6 +349,19 @@ extern PTAB_EXPORT int ptab_free_string(ptab_t *p, ptab_string_t *s);
  */
 extern PTAB_EXPORT int ptab_column(ptab_t *p, const char *name, enum ptab_type t);
 
+/*
+ * ptab_column_decimal
+ *
+ * Create a PTAB_DECIMAL column, whose values are 64-bit integers
+ * counted in units of 10^-scale: with a scale of 2, 12345 is written
+ * as "123.45". Every value in the column has scale digits after the
+ * point, so they line up on it when the column is right aligned, as it
+ * is by default. The scale may be up to PTAB_DECIMAL_MAX_SCALE, or
+ * else PTAB_ERANGE is returned. The values are written without floating
+ * point or printf. A decimal column made with ptab_column has a scale of 0.
+ */
+extern PTAB_EXPORT int ptab_column_decimal(ptab_t *p, const char *name, unsigned int scale);
+
 /*
  * ptab_column_align
  *
@@ -167,6 +371,69 @@ extern PTAB_EXPORT int ptab_column(ptab_t *p, const char *name, enum ptab_type t
  */
 extern PTAB_EXPORT int ptab_column_align(ptab_t *p, unsigned int col, enum ptab_align a);
 
+/*
+ * ptab_column_dict
+ *
+ * Store a PTAB_STRING column as a dictionary: each distinct value is
+ * kept once, and each cell only refers to it. This saves memory on
+ * columns that repeat a small number of values, such as a status or
+ * a host name, and costs a hash lookup per cell. It must be called
+ * before any rows are added. Borrowed strings added to the column
+ * are copied into the dictionary.
+ */
+extern PTAB_EXPORT int ptab_column_dict(ptab_t *p, unsigned int col);
+
+/*
+ * ptab_column_format
+ *
+ * Give a numeric column a format of its own, which is parsed once here
+ * instead of by printf for every cell. The format must have exactly one
+ * conversion for the column's type (flags, a width and a precision are
+ * allowed, but not length modifiers or a '*', except that a 64-bit
+ * column's conversion has the length of PRId64), and any other text,
+ * with "%%" for a '%'; otherwise PTAB_EFORMAT is returned. A "%'d" (or
+ * "%'" PRId64 or "%'" PRIu64) groups the digits with commas, whatever
+ * the locale, and can't have other flags. A PTAB_DECIMAL column's
+ * conversion is a bare "%f", which is the value to the column's scale,
+ * as in "$%f" or "%f%%". A PTAB_TIMESTAMP column's format is like
+ * strftime's, in UTC, with any of %Y, %m, %d, %H, %M, %S, %F and %T,
+ * and %N for nanoseconds (or %3N and the like for fewer digits, cut off
+ * rather than rounded); its default is "%F %T", and it may be up to 39
+ * characters once written out. The format given when adding data to the
+ * column is not used, and may be NULL. It must be called before any
+ * rows are added.
+ */
+extern PTAB_EXPORT int ptab_column_format(ptab_t *p, unsigned int col, const char *format);
+
+/*
+ * ptab_column_lazy
+ *
+ * Keep only the raw values of a numeric column, and format them with
+ * the given format when the table is written out. The format is
+ * checked the same as for ptab_column_format, and the format given
+ * when adding data to the column is not used, and may be NULL. A lazy
+ * column uses less memory, and its cells are not formatted until they
+ * are written, so the format must be one whose width can be worked out
+ * without it: a plain "%d" or "%'d" (or the 64-bit ones), a "%f" or
+ * "%.<n>f" on a float or double column, or any decimal or timestamp
+ * format, with any text around it. Other formats return PTAB_EFORMAT
+ * and leave the column as it was. It must be called before any rows
+ * are added.
+ */
+extern PTAB_EXPORT int ptab_column_lazy(ptab_t *p, unsigned int col, const char *format);
+
+/*
+ * ptab_reserve
+ *
+ * Make room for the given number of rows up front, when it is known
+ * ahead of time. The string_bytes parameter is the total length of all
+ * of the cells' text, including the formatted text of numeric cells.
+ * Filling the table with no more than this, spread evenly across the
+ * rows, does not need any further memory from the allocator. All of
+ * the columns must be defined before calling this.
+ */
+extern PTAB_EXPORT int ptab_reserve(ptab_t *p, size_t rows, size_t string_bytes);
+
 /*
  * ptab_begin_row
  *
@@ -183,10 +450,43 @@ extern PTAB_EXPORT int ptab_begin_row(ptab_t *p);
  * ptab_row_data_s
  *
  * Add string data to the row. The column must have been defined with
- * a PTAB_STRING type.
+ * a PTAB_STRING type. A cell holds at most 4 GiB - 1 bytes of text, and
+ * longer text returns PTAB_ERANGE.
  */
 extern PTAB_EXPORT int ptab_row_data_s(ptab_t *p, const char *val);
 
+/*
+ * ptab_row_data_sn
+ *
+ * Add the len bytes at s to the row as string data. The bytes are
+ * copied as they are and don't need to be NUL-terminated, so a field
+ * can be added straight from the line it was read from. The column
+ * must have been defined with a PTAB_STRING type. A len over 4 GiB - 1
+ * returns PTAB_ERANGE.
+ */
+extern PTAB_EXPORT int ptab_row_data_sn(ptab_t *p, const char *s, size_t len);
+
+/*
+ * ptab_row_data_str
+ *
+ * Same as ptab_row_data_sn, with the text and length given by a
+ * ptab_string_t, and the same limit of 4 GiB - 1 bytes (PTAB_ERANGE).
+ */
+extern PTAB_EXPORT int ptab_row_data_str(ptab_t *p, const ptab_string_t *s);
+
+/*
+ * ptab_row_data_s_ref
+ *
+ * Add string data to the row without copying it. Only a pointer to
+ * the len bytes at s is kept (they don't need to be NUL-terminated),
+ * so they are copied once, when the table is written out. The bytes
+ * must stay valid and unchanged until the table is reset, cleared or
+ * freed. The column must have been defined with a PTAB_STRING type.
+ * The text isn't copied, but a len over 4 GiB - 1 still returns
+ * PTAB_ERANGE.
+ */
+extern PTAB_EXPORT int ptab_row_data_s_ref(ptab_t *p, const char *s, size_t len);
+
 /*
  * ptab_row_data_i
  *
@@ -209,6 +509,61 @@ extern PTAB_EXPORT int ptab_row_data_i(ptab_t *p, const char *format, int val);
  */
 extern PTAB_EXPORT int ptab_row_data_f(ptab_t *p, const char *format, float val);
 
+/*
+ * ptab_row_data_d
+ *
+ * Add double data to the row. The column must have been defined with
+ * a PTAB_DOUBLE type. The format string is the same as for
+ * ptab_row_data_f, and a "%f" or "%.Nf" (up to 15 places) is written
+ * without going through printf. The format may also be NULL, which
+ * writes the value in the fewest digits that read back as the same
+ * double, switching to an exponent below 1e-4 and from 1e16 up.
+ */
+extern PTAB_EXPORT int ptab_row_data_d(ptab_t *p, const char *format, double val);
+
+/*
+ * ptab_row_data_i64
+ *
+ * Add 64-bit integer data to the row. The column must have been
+ * defined with a PTAB_INT64 type. The format string is the same as for
+ * ptab_row_data_i, but its conversion takes an int64_t, so it is
+ * written with PRId64 (or PRIi64, PRIx64 and so on), as in
+ * "%" PRId64 " bytes". A bare "%" PRId64 is written without going
+ * through printf.
+ */
+extern PTAB_EXPORT int ptab_row_data_i64(ptab_t *p, const char *format, int64_t val);
+
+/*
+ * ptab_row_data_u64
+ *
+ * Add unsigned 64-bit integer data to the row. The column must have
+ * been defined with a PTAB_UINT64 type. The format string's conversion
+ * takes a uint64_t, as with PRIu64, and a bare "%" PRIu64 is written
+ * without going through printf. See ptab_row_data_i64.
+ */
+extern PTAB_EXPORT int ptab_row_data_u64(ptab_t *p, const char *format, uint64_t val);
+
+/*
+ * ptab_row_data_dec
+ *
+ * Add decimal data to the row. The column must have been defined with
+ * a PTAB_DECIMAL type, and the value is in units of 10^-scale, as given
+ * to ptab_column_decimal. There is no format; the column's own is
+ * used, if it has one.
+ */
+extern PTAB_EXPORT int ptab_row_data_dec(ptab_t *p, int64_t val);
+
+/*
+ * ptab_row_data_ts
+ *
+ * Add timestamp data to the row. The column must have been defined
+ * with a PTAB_TIMESTAMP type, and the value is in nanoseconds since
+ * the epoch. It is written with the column's format (see
+ * ptab_column_format); the text of the last minute written is kept,
+ * so rows in time order only write their seconds afresh.
+ */
+extern PTAB_EXPORT int ptab_row_data_ts(ptab_t *p, int64_t ns);
+
 /*
  * ptab_end_row
  *
@@ -219,6 +574,131 @@ extern PTAB_EXPORT int ptab_row_data_f(ptab_t *p, const char *format, float val)
  */
 extern PTAB_EXPORT int ptab_end_row(ptab_t *p);
 
+/*
+ * ptab_append_rows
+ *
+ * Add nrows whole rows at once. The cells array holds nrows * (number
+ * of columns) values, a row at a time, with each row's values in
+ * column order. The whole batch is checked before any of it is added,
+ * and room for all of it is made in one go, so this is much cheaper
+ * per cell than ptab_begin_row, ptab_row_data_* and ptab_end_row. If
+ * a row still fails (for instance with PTAB_EMEM), the rows before it
+ * stay in the table. A string cell of more than 4 GiB - 1 bytes returns
+ * PTAB_ERANGE. Must not be called while a row is in progress.
+ */
+extern PTAB_EXPORT int ptab_append_rows(ptab_t *p, const ptab_value_t *cells, size_t nrows);
+
+/*
+ * ptab_column_data_s
+ *
+ * Load the n strings in vals into column col, which must have been
+ * defined with a PTAB_STRING type. This is for data that is already
+ * kept a column at a time: each of the ptab_column_data_* functions
+ * adds its values after any that were already loaded into the column,
+ * and the rows they make are added to the table once every column has
+ * been given the same number of values. That is checked before the
+ * table is written out, or before rows are added any other way, which
+ * returns PTAB_ECOLUMNS if the counts don't match. A string of more
+ * than 4 GiB - 1 bytes returns PTAB_ERANGE. Columns can't be
+ * loaded into a concurrent table (see ptab_concurrent), or while a row
+ * is in progress; either returns PTAB_EORDER.
+ */
+extern PTAB_EXPORT int ptab_column_data_s(ptab_t *p,
+					  unsigned int col,
+					  const char *const *vals,
+					  size_t n);
+
+/*
+ * ptab_column_data_i
+ *
+ * Load the n integers in vals into column col, which must have been
+ * defined with a PTAB_INTEGER type. Each value is formatted with the
+ * format string, as with ptab_row_data_i. See ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_i(ptab_t *p,
+					  unsigned int col,
+					  const char *format,
+					  const int *vals,
+					  size_t n);
+
+/*
+ * ptab_column_data_f
+ *
+ * Load the n floats in vals into column col, which must have been
+ * defined with a PTAB_FLOAT type. Each value is formatted with the
+ * format string, as with ptab_row_data_f. See ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_f(ptab_t *p,
+					  unsigned int col,
+					  const char *format,
+					  const float *vals,
+					  size_t n);
+
+/*
+ * ptab_column_data_d
+ *
+ * Load the n doubles in vals into column col, which must have been
+ * defined with a PTAB_DOUBLE type. Each value is formatted with the
+ * format string, which may be NULL, as with ptab_row_data_d. See
+ * ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_d(ptab_t *p,
+					  unsigned int col,
+					  const char *format,
+					  const double *vals,
+					  size_t n);
+
+/*
+ * ptab_column_data_i64
+ *
+ * Load the n 64-bit integers in vals into column col, which must have
+ * been defined with a PTAB_INT64 type. Each value is formatted with the
+ * format string, as with ptab_row_data_i64. See ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_i64(ptab_t *p,
+					    unsigned int col,
+					    const char *format,
+					    const int64_t *vals,
+					    size_t n);
+
+/*
+ * ptab_column_data_u64
+ *
+ * Load the n unsigned 64-bit integers in vals into column col, which
+ * must have been defined with a PTAB_UINT64 type. Each value is
+ * formatted with the format string, as with ptab_row_data_u64. See
+ * ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_u64(ptab_t *p,
+					    unsigned int col,
+					    const char *format,
+					    const uint64_t *vals,
+					    size_t n);
+
+/*
+ * ptab_column_data_dec
+ *
+ * Load the n decimals in vals into column col, which must have been
+ * defined with a PTAB_DECIMAL type, as with ptab_row_data_dec. See
+ * ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_dec(ptab_t *p,
+					    unsigned int col,
+					    const int64_t *vals,
+					    size_t n);
+
+/*
+ * ptab_column_data_ts
+ *
+ * Load the n timestamps in vals into column col, which must have been
+ * defined with a PTAB_TIMESTAMP type, as with ptab_row_data_ts. See
+ * ptab_column_data_s.
+ */
+extern PTAB_EXPORT int ptab_column_data_ts(ptab_t *p,
+					   unsigned int col,
+					   const int64_t *vals,
+					   size_t n);
+
 /* Future */
 /* extern PTAB_EXPORT int ptab_sort(ptab_t *p, int column, int order); */
 
@@ -18,6 +18,11 @@ static bool check_type(enum ptab_type type)
 	case PTAB_STRING:
 	case PTAB_INTEGER:
 	case PTAB_FLOAT:
+	case PTAB_DOUBLE:
+	case PTAB_INT64:
+	case PTAB_UINT64:
+	case PTAB_DECIMAL:
+	case PTAB_TIMESTAMP:
 		is_good = true;
 		break;
 
@@ -66,6 +71,11 @@ static enum ptab_align get_default_align(enum ptab_type type)
 
 	case PTAB_INTEGER:
 	case PTAB_FLOAT:
+	case PTAB_DOUBLE:
+	case PTAB_INT64:
+	case PTAB_UINT64:
+	case PTAB_DECIMAL:
+	case PTAB_TIMESTAMP:
 		align = PTAB_RIGHT;
 		break;
 	}
@@ -123,8 +133,21 @@ static int add_column(ptab_t *p,
 	col->align = align;
 	col->name_len = len;
 	col->width = len;
+	col->loaded = 0;
+	col->dict = NULL;
+	col->lazy = false;
+	col->format = NULL;
+	col->formatted = 0;
 	col->next = NULL;
 
+	/* only numeric columns keep their raw values */
+	if (type == PTAB_STRING) {
+		col->value_id = 0;
+	} else {
+		col->value_id = p->num_values;
+		p->num_values++;
+	}
+
 	/* finally, add it to the list */
 	add_to_column_list(p, col);
 
@@ -134,11 +157,12 @@ static int add_column(ptab_t *p,
 int ptab_column(ptab_t *p, const char *name, enum ptab_type type)
 {
 	enum ptab_align align;
+	int err;
 
 	if (!p || !name)
 		return PTAB_ENULL;
 
-	if (p->num_rows > 0 || p->current_row)
+	if (p->num_rows > 0 || p->cursor.chunk || p->load.active || ptab__shard_busy(p))
 		return PTAB_EORDER;
 
 	/* ensure type is valid */
@@ -149,7 +173,38 @@ int ptab_column(ptab_t *p, const char *name, enum ptab_type type)
 	align = get_default_align(type);
 
 	/* allocate the column and add it to the columns list */
-	return add_column(p, name, type, align);
+	err = add_column(p, name, type, align);
+	if (err)
+		return err;
+
+	/* a decimal column is always written to its scale, which is 0 here */
+	if (type == PTAB_DECIMAL)
+		p->columns_tail->format = ptab__format_decimal(0);
+
+	/* and a timestamp column has a format of its own, to keep its last minute */
+	if (type == PTAB_TIMESTAMP)
+		return ptab__time_set(p, p->columns_tail, "%F %T");
+
+	return PTAB_OK;
+}
+
+int ptab_column_decimal(ptab_t *p, const char *name, unsigned int scale)
+{
+	int err;
+
+	if (!p || !name)
+		return PTAB_ENULL;
+
+	if (scale > PTAB_DECIMAL_MAX_SCALE)
+		return PTAB_ERANGE;
+
+	err = ptab_column(p, name, PTAB_DECIMAL);
+	if (err)
+		return err;
+
+	p->columns_tail->format = ptab__format_decimal(scale);
+
+	return PTAB_OK;
 }
 
 int ptab_column_align(ptab_t *p, unsigned int col, enum ptab_align align)
@@ -179,3 +234,94 @@ int ptab_column_align(ptab_t *p, unsigned int col, enum ptab_align align)
 
 	return PTAB_OK;
 }
+
+int ptab_column_dict(ptab_t *p, unsigned int col)
+{
+	struct ptab_col *column;
+
+	if (!p)
+		return PTAB_ENULL;
+
+	if (col >= p->num_columns)
+		return PTAB_ERANGE;
+
+	/* the cells already in the column have their own copies */
+	if (p->num_rows > 0 || p->cursor.chunk || p->load.active || ptab__shard_busy(p))
+		return PTAB_EORDER;
+
+	for (column = p->columns_head; column->id != col; column = column->next)
+		;
+
+	if (column->type != PTAB_STRING)
+		return PTAB_ETYPE;
+
+	if (column->dict)
+		return PTAB_OK;
+
+	/* the dictionary belongs to the schema, its values to the rows */
+	column->dict = ptab__mem_alloc(p, sizeof(struct ptab_dict));
+	if (!column->dict)
+		return PTAB_EMEM;
+
+	memset(column->dict, 0, sizeof(struct ptab_dict));
+
+	return PTAB_OK;
+}
+
+int ptab_column_format(ptab_t *p, unsigned int col, const char *format)
+{
+	struct ptab_col *column;
+
+	if (!p || !format)
+		return PTAB_ENULL;
+
+	if (col >= p->num_columns)
+		return PTAB_ERANGE;
+
+	/* the cells already in the column were formatted with their own */
+	if (p->num_rows > 0 || p->cursor.chunk || p->load.active || ptab__shard_busy(p))
+		return PTAB_EORDER;
+
+	for (column = p->columns_head; column->id != col; column = column->next)
+		;
+
+	if (column->type == PTAB_STRING)
+		return PTAB_ETYPE;
+
+	return ptab__format_set(p, column, format);
+}
+
+int ptab_column_lazy(ptab_t *p, unsigned int col, const char *format)
+{
+	const struct ptab_col_format *before;
+	struct ptab_col *column;
+	int err;
+
+	if (!p || !format)
+		return PTAB_ENULL;
+
+	if (col >= p->num_columns)
+		return PTAB_ERANGE;
+
+	for (column = p->columns_head; column->id != col; column = column->next)
+		;
+
+	before = column->format;
+
+	err = ptab_column_format(p, col, format);
+	if (err)
+		return err;
+
+	/*
+	 * a lazy cell's width is found without formatting it, which
+	 * takes a format that is written here rather than by printf
+	 */
+	if (column->format->kind == FORMAT_PRINTF) {
+		column->format = before;
+		return PTAB_EFORMAT;
+	}
+
+	column->lazy = true;
+
+	return PTAB_OK;
+}
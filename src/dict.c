@@ -0,0 +1,178 @@
+
+#include <assert.h>
+#include <string.h>
+
+#include <ptab.h>
+#include "internal.h"
+
+/*
+ * a dictionary column keeps each distinct value once, in the table's
+ * arena, and its cells hold the value's code in place of an offset
+ * into the string heap. the values are found again through an open
+ * addressing hash table of codes
+ */
+
+#define DICT_MIN_SLOTS 64
+
+/* FNV-1a */
+static uint32_t dict_hash(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*
+ * double the hash table and the values; the old arrays stay in the
+ * arena until the table is reset, the same as a chunk's old heap
+ */
+static int dict_grow(ptab_t *p, struct ptab_dict *dict)
+{
+	uint32_t slots = dict->num_slots ? dict->num_slots * 2 : DICT_MIN_SLOTS;
+	struct ptab_dict_entry *entries;
+	uint32_t *codes;
+	uint32_t i, j;
+
+	if (slots > CELL_MAX / 2)
+		return PTAB_ERANGE;
+
+	codes = ptab__mem_alloc(p, (size_t)slots * sizeof(*codes));
+	entries = ptab__mem_alloc(p, (size_t)slots * sizeof(*entries));
+	if (!codes || !entries)
+		return PTAB_EMEM;
+
+	/* codes are stored plus one, so that zero is an empty slot */
+	memset(codes, 0, (size_t)slots * sizeof(*codes));
+
+	if (dict->count)
+		memcpy(entries, dict->entries, dict->count * sizeof(*entries));
+
+	for (i = 0; i < dict->count; i++) {
+		j = entries[i].hash & (slots - 1);
+		while (codes[j])
+			j = (j + 1) & (slots - 1);
+
+		codes[j] = i + 1;
+	}
+
+	dict->codes = codes;
+	dict->entries = entries;
+	dict->num_slots = slots;
+
+	return PTAB_OK;
+}
+
+/* find the code for a value, adding it if it is new */
+static int dict_intern(ptab_t *p, struct ptab_dict *dict,
+		       const char *s, size_t len, uint32_t *code)
+{
+	const struct ptab_dict_entry *e;
+	uint32_t hash = dict_hash(s, len);
+	uint32_t i;
+	char *str;
+	int err;
+
+	if (dict->num_slots) {
+		for (i = hash & (dict->num_slots - 1); dict->codes[i];
+		     i = (i + 1) & (dict->num_slots - 1)) {
+			e = &dict->entries[dict->codes[i] - 1];
+
+			if (e->hash == hash && e->len == len &&
+			    memcmp(e->str, s, len) == 0) {
+				*code = dict->codes[i] - 1;
+				return PTAB_OK;
+			}
+		}
+	}
+
+	/*
+	 * the values go with the rows when the table is reset, so the
+	 * schema has to be marked before any of them are allocated (a
+	 * concurrent table's rows never mark it themselves)
+	 */
+	if (!p->mem.marked)
+		ptab__mem_mark(p);
+
+	/* keep the hash table no more than three quarters full */
+	if ((size_t)(dict->count + 1) * 4 > (size_t)dict->num_slots * 3) {
+		err = dict_grow(p, dict);
+		if (err)
+			return err;
+	}
+
+	str = ptab__mem_alloc_str(p, len ? len : 1);
+	if (!str)
+		return PTAB_EMEM;
+
+	memcpy(str, s, len);
+
+	*code = dict->count;
+
+	dict->entries[dict->count].str = str;
+	dict->entries[dict->count].len = (uint32_t)len;
+	dict->entries[dict->count].hash = hash;
+	dict->count++;
+
+	for (i = hash & (dict->num_slots - 1); dict->codes[i];
+	     i = (i + 1) & (dict->num_slots - 1))
+		;
+
+	dict->codes[i] = *code + 1;
+
+	return PTAB_OK;
+}
+
+/*
+ * store a value of a dictionary column in a cell; the threads of a
+ * concurrent table share the dictionary, so they take turns with it
+ */
+int ptab__dict_cell(ptab_t *p, struct ptab_col *col, struct ptab_chunk *chunk,
+		    struct ptab_cell *cell, const char *s, size_t len)
+{
+	uint32_t code;
+	int err;
+
+	assert(col->dict != NULL);
+
+	if (len > CELL_MAX)
+		return PTAB_ERANGE;
+
+	if (p->shards.enabled)
+		pthread_mutex_lock(&p->shards.lock);
+
+	err = dict_intern(p, col->dict, s, len, &code);
+
+	if (p->shards.enabled)
+		pthread_mutex_unlock(&p->shards.lock);
+
+	if (err)
+		return err;
+
+	cell_set(chunk, cell, code, (uint32_t)len, CELL_DICT);
+
+	return PTAB_OK;
+}
+
+/* forget the values, whose memory went with the rows */
+void ptab__dict_reset(ptab_t *p)
+{
+	struct ptab_col *col;
+
+	assert(p != NULL);
+
+	for (col = p->columns_head; col; col = col->next) {
+		if (!col->dict)
+			continue;
+
+		col->dict->count = 0;
+		col->dict->num_slots = 0;
+		col->dict->codes = NULL;
+		col->dict->entries = NULL;
+	}
+}
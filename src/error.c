@@ -15,7 +15,9 @@ static struct error_description descriptions[] = {
 	{ PTAB_ETYPE, "unknown type or type mismatch" },
 	{ PTAB_EALIGN, "unknown alignment" },
 	{ PTAB_EFORMAT, "unknown format" },
-	{ PTAB_ECOLUMNS, "row data does not match column count" }
+	{ PTAB_ECOLUMNS, "row data does not match column count" },
+	{ PTAB_ESUPPORT, "not supported on this platform" },
+	{ PTAB_EIO, "could not read or write a spill file" }
 };
 
 const char *ptab_strerror(int err)
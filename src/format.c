@@ -0,0 +1,565 @@
+
+#include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <ptab.h>
+#include "internal.h"
+
+/*
+ * a column's format is parsed once into the text before and after its
+ * one conversion, and the conversion on its own, so that a cell only
+ * costs printf the conversion. the common conversions don't need
+ * printf at all: a plain %d (or %'d, grouped by thousands, and the
+ * same for the 64-bit types), whose length is known before it is
+ * written, as is a decimal column's value to its scale, and a %.Nf,
+ * along with the shortest form of a double that has no format (see
+ * number.c). a timestamp column's format is its own (see
+ * timestamp.c), and is also known to be a length in advance. a lazy
+ * column keeps only the raw values of its cells, and formats them when
+ * the table is written out; the length of each cell is still needed
+ * up front for the width, which for a plain %d is just a digit count
+ */
+
+/*
+ * the format of a cell given "%d" (or a 64-bit column's "%" PRId64),
+ * so that it can go the same way
+ */
+const struct ptab_col_format ptab__format_plain = {
+	"", 0, "", 0, "%d", FORMAT_INT, false, 0, NULL
+};
+
+/* and of a double given no format */
+static const struct ptab_col_format shortest_format = {
+	"", 0, "", 0, "", FORMAT_SHORTEST, false, 0, NULL
+};
+
+/* and of a decimal column, to its scale */
+#define DECIMAL_FORMAT(n) { "", 0, "", 0, "%f", FORMAT_DECIMAL, false, n, NULL }
+
+static const struct ptab_col_format decimal_formats[] = {
+	DECIMAL_FORMAT(0), DECIMAL_FORMAT(1), DECIMAL_FORMAT(2), DECIMAL_FORMAT(3),
+	DECIMAL_FORMAT(4), DECIMAL_FORMAT(5), DECIMAL_FORMAT(6), DECIMAL_FORMAT(7),
+	DECIMAL_FORMAT(8), DECIMAL_FORMAT(9), DECIMAL_FORMAT(10), DECIMAL_FORMAT(11),
+	DECIMAL_FORMAT(12), DECIMAL_FORMAT(13), DECIMAL_FORMAT(14), DECIMAL_FORMAT(15),
+	DECIMAL_FORMAT(16), DECIMAL_FORMAT(17), DECIMAL_FORMAT(18)
+};
+
+/* and of a cell given "%.Nf" */
+#define FIXED_FORMAT(n) { "", 0, "", 0, "%." #n "f", FORMAT_FIXED, false, n, NULL }
+
+static const struct ptab_col_format fixed_formats[] = {
+	FIXED_FORMAT(0), FIXED_FORMAT(1), FIXED_FORMAT(2), FIXED_FORMAT(3),
+	FIXED_FORMAT(4), FIXED_FORMAT(5), FIXED_FORMAT(6), FIXED_FORMAT(7),
+	FIXED_FORMAT(8), FIXED_FORMAT(9)
+};
+
+/* the size of an integer value, and whether it is negative */
+static uint64_t int_magnitude(enum ptab_type type, union ptab_cell_value v, bool *neg)
+{
+	switch (type) {
+	case PTAB_INTEGER:
+		*neg = v.i < 0;
+		return *neg ? 0u - (uint64_t)v.i : (uint64_t)v.i;
+	case PTAB_INT64:
+	case PTAB_DECIMAL:
+		*neg = v.l < 0;
+		return *neg ? 0u - (uint64_t)v.l : (uint64_t)v.l;
+	default:
+		*neg = false;
+		return v.u;
+	}
+}
+
+/*
+ * the length of an integer in decimal, with a comma every three digits
+ * if grouped, or with a point at the scale of a decimal
+ */
+static size_t int_len(const struct ptab_col_format *f, uint64_t u, bool neg)
+{
+	unsigned int n;
+
+	if (f->kind == FORMAT_DECIMAL)
+		return ptab__num_decimal_len(u, f->places) + neg;
+
+	n = ptab__num_len(u);
+
+	if (f->grouped)
+		n += (n - 1) / 3;
+
+	return n + neg;
+}
+
+/*
+ * write an integer to buf, which has room for exactly
+ * len = int_len(f, u, neg) bytes; nothing else is written
+ */
+static void int_put(const struct ptab_col_format *f, char *buf, size_t len,
+		    uint64_t u, bool neg)
+{
+	if (neg)
+		*buf = '-';
+
+	if (f->kind == FORMAT_DECIMAL)
+		ptab__num_put_decimal(buf + len, u, f->places);
+	else if (f->grouped)
+		ptab__num_put_grouped(buf + len, u);
+	else
+		ptab__num_put(buf + len, u);
+}
+
+static bool is_flag(char c)
+{
+	return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0' || c == '\'';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* the conversions that take the column's type of value */
+static bool check_conversion(enum ptab_type type, char c)
+{
+	if (type == PTAB_INTEGER)
+		return c != '\0' && strchr("diouxXc", c) != NULL;
+
+	if (type_is_int(type))
+		return c != '\0' && strchr("diouxX", c) != NULL;
+
+	return c != '\0' && strchr("fFeEgGaA", c) != NULL;
+}
+
+/*
+ * the length modifier of a 64-bit conversion, which is whatever
+ * PRId64 has on this platform: "l" or "ll"
+ */
+static const char int64_modifier[] = PRId64;
+
+#define INT64_MODIFIER_LEN (sizeof(int64_modifier) - 2)
+
+/*
+ * copy literal text from the format, turning each %% into %; returns
+ * the length of the copy
+ */
+static size_t copy_text(char *to, const char *from, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < len; i++, n++) {
+		to[n] = from[i];
+
+		if (from[i] == '%')
+			i++;
+	}
+
+	return n;
+}
+
+/*
+ * find the one conversion in the format; its start and length are
+ * returned through spec and spec_len
+ */
+static int parse_spec(enum ptab_type type, const char *format,
+		      const char **spec, size_t *spec_len)
+{
+	const char *c, *start = NULL;
+	size_t len = 0;
+
+	for (c = format; *c; c++) {
+		if (*c != '%')
+			continue;
+
+		if (c[1] == '%') {
+			c++;
+			continue;
+		}
+
+		/* more than one conversion needs more than one value */
+		if (start)
+			return PTAB_EFORMAT;
+
+		start = c++;
+
+		while (is_flag(*c))
+			c++;
+		while (is_digit(*c))
+			c++;
+
+		if (*c == '.') {
+			c++;
+			while (is_digit(*c))
+				c++;
+		}
+
+		/* a 64-bit value's, and no other length modifiers */
+		if (type == PTAB_INT64 || type == PTAB_UINT64) {
+			if (strncmp(c, int64_modifier, INT64_MODIFIER_LEN) != 0)
+				return PTAB_EFORMAT;
+
+			c += INT64_MODIFIER_LEN;
+		}
+
+		/* or widths given as arguments */
+		if (!check_conversion(type, *c))
+			return PTAB_EFORMAT;
+
+		len = (size_t)(c - start) + 1;
+		if (len >= FORMAT_SPEC_SIZE)
+			return PTAB_EFORMAT;
+	}
+
+	if (!start)
+		return PTAB_EFORMAT;
+
+	*spec = start;
+	*spec_len = len;
+
+	return PTAB_OK;
+}
+
+/* see which conversions can be written without printf */
+static void set_kind(struct ptab_col_format *f, enum ptab_type type)
+{
+	const char *c = f->spec + 1;
+	unsigned int places = 0;
+
+	bool grouped;
+
+	f->kind = FORMAT_PRINTF;
+	f->grouped = false;
+	f->places = 0;
+
+	/* a decimal's only conversion is a bare %f, to the column's scale */
+	if (type == PTAB_DECIMAL) {
+		if (*c == 'f' && c[1] == '\0')
+			f->kind = FORMAT_DECIMAL;
+
+		return;
+	}
+
+	if (type_is_int(type)) {
+		grouped = *c == '\'';
+		if (grouped)
+			c++;
+
+		if (type != PTAB_INTEGER)
+			c += INT64_MODIFIER_LEN;
+
+		/* an unsigned value's %d isn't plain, and nor is a signed one's %u */
+		if (c[1] == '\0' && (type == PTAB_UINT64 ? *c == 'u' : (*c == 'd' || *c == 'i'))) {
+			f->kind = FORMAT_INT;
+			f->grouped = grouped;
+		}
+
+		return;
+	}
+
+	/* a %f has six places */
+	if (*c == 'f' && c[1] == '\0') {
+		f->kind = FORMAT_FIXED;
+		f->places = 6;
+		return;
+	}
+
+	if (*c++ != '.' || !is_digit(*c))
+		return;
+
+	while (is_digit(*c) && places <= NUM_FIXED_MAX)
+		places = places * 10 + (unsigned int)(*c++ - '0');
+
+	if (places <= NUM_FIXED_MAX && *c == 'f' && c[1] == '\0') {
+		f->kind = FORMAT_FIXED;
+		f->places = places;
+	}
+}
+
+int ptab__format_set(ptab_t *p, struct ptab_col *col, const char *format)
+{
+	struct ptab_col_format parsed, *f;
+	const char *spec;
+	size_t spec_len, before, after;
+	char *text;
+	int err;
+
+	assert(col->type != PTAB_STRING);
+
+	if (col->type == PTAB_TIMESTAMP)
+		return ptab__time_set(p, col, format);
+
+	err = parse_spec(col->type, format, &spec, &spec_len);
+	if (err)
+		return err;
+
+	memcpy(parsed.spec, spec, spec_len);
+	parsed.spec[spec_len] = '\0';
+
+	set_kind(&parsed, col->type);
+	parsed.time = NULL;
+
+	/* only a bare %'d is grouped here; printf would leave it to the locale */
+	if (memchr(spec, '\'', spec_len) && !parsed.grouped)
+		return PTAB_EFORMAT;
+
+	/* and a decimal column keeps the scale it was made with */
+	if (col->type == PTAB_DECIMAL) {
+		if (parsed.kind != FORMAT_DECIMAL)
+			return PTAB_EFORMAT;
+
+		parsed.places = col->format->places;
+	}
+
+	before = (size_t)(spec - format);
+	after = strlen(spec + spec_len);
+
+	/* the literal text only gets shorter without the extra %s */
+	f = ptab__mem_alloc(p, sizeof(*f) + before + after);
+	if (!f)
+		return PTAB_EMEM;
+
+	*f = parsed;
+	text = (char *)(f + 1);
+
+	f->prefix = text;
+	f->prefix_len = copy_text(text, format, before);
+	f->suffix = text + f->prefix_len;
+	f->suffix_len = copy_text(text + f->prefix_len, spec + spec_len, after);
+
+	col->format = f;
+
+	return PTAB_OK;
+}
+
+size_t ptab__format_int_len(const struct ptab_col_format *f, enum ptab_type type,
+			    union ptab_cell_value v)
+{
+	uint64_t u;
+	bool neg;
+
+	assert(format_is_int(f));
+
+	if (f->kind == FORMAT_TIME)
+		return f->time->len;
+
+	u = int_magnitude(type, v, &neg);
+
+	return f->prefix_len + int_len(f, u, neg) + f->suffix_len;
+}
+
+/* write an int format's len = ptab__format_int_len bytes, and no NUL */
+void ptab__format_int_put(const struct ptab_col_format *f, enum ptab_type type,
+			  union ptab_cell_value v, char *buf, size_t len)
+{
+	uint64_t u;
+	bool neg;
+
+	assert(format_is_int(f));
+
+	if (f->kind == FORMAT_TIME) {
+		assert(len == f->time->len);
+		ptab__time_put(f->time, v.l, buf);
+		return;
+	}
+
+	u = int_magnitude(type, v, &neg);
+
+	if (f->prefix_len)
+		memcpy(buf, f->prefix, f->prefix_len);
+
+	if (f->suffix_len)
+		memcpy(buf + len - f->suffix_len, f->suffix, f->suffix_len);
+
+	int_put(f, buf + f->prefix_len, len - f->prefix_len - f->suffix_len, u, neg);
+}
+
+/* add len bytes to buf, which has room for size bytes and a NUL */
+static size_t put_text(char *buf, size_t used, size_t size,
+		       const char *text, size_t len)
+{
+	if (used < size)
+		memcpy(buf + used, text, len < size - used ? len : size - used);
+
+	return used + len;
+}
+
+/*
+ * write a value with the column's format, the same way snprintf would:
+ * the text is cut off to fit in size bytes with a NUL, and the length
+ * it would have had is returned
+ */
+static int format_value(const struct ptab_col_format *f, enum ptab_type type,
+			union ptab_cell_value v, char *buf, size_t size)
+{
+	char num[NUM_BUF_SIZE];
+	char *at = NULL;
+	size_t used, room = 0, n = 0;
+	uint64_t u;
+	bool neg;
+	int len;
+
+	assert(size > 0);
+
+	/* leave room for the NUL */
+	size--;
+
+	switch (f->kind) {
+	case FORMAT_INT:
+	case FORMAT_DECIMAL:
+		used = ptab__format_int_len(f, type, v);
+		if (used <= size) {
+			ptab__format_int_put(f, type, v, buf, used);
+			buf[used] = '\0';
+			return used <= INT_MAX ? (int)used : -1;
+		}
+
+		u = int_magnitude(type, v, &neg);
+		n = int_len(f, u, neg);
+		int_put(f, num, n, u, neg);
+		break;
+	case FORMAT_TIME:
+		n = f->time->len;
+		ptab__time_put(f->time, v.l, num);
+		break;
+	case FORMAT_FIXED:
+		/* which is left to printf if it is too big to round here */
+		n = ptab__num_fixed(v.f, f->places, num);
+		break;
+	case FORMAT_SHORTEST:
+		n = ptab__num_shortest(v.f, num);
+		break;
+	default:
+		break;
+	}
+
+	used = put_text(buf, 0, size, f->prefix, f->prefix_len);
+
+	if (n > 0) {
+		used = put_text(buf, used, size, num, n);
+	} else {
+		if (used < size) {
+			at = buf + used;
+			room = size - used + 1;
+		}
+
+		switch (type) {
+		case PTAB_INTEGER:
+			len = snprintf(at, room, f->spec, v.i);
+			break;
+		case PTAB_INT64:
+			len = snprintf(at, room, f->spec, v.l);
+			break;
+		case PTAB_UINT64:
+			len = snprintf(at, room, f->spec, v.u);
+			break;
+		default:
+			len = snprintf(at, room, f->spec, v.f);
+			break;
+		}
+
+		if (len < 0)
+			return len;
+
+		used += (size_t)len;
+	}
+
+	used = put_text(buf, used, size, f->suffix, f->suffix_len);
+	buf[used < size ? used : size] = '\0';
+
+	return used <= INT_MAX ? (int)used : -1;
+}
+
+/*
+ * format a cell from its raw value, as a lazy cell is when the table
+ * is written out; the column counts them, which is only ever done by
+ * one thread at a time
+ */
+int ptab__format_cell(struct ptab_col *col, union ptab_cell_value v,
+		      char *buf, size_t size)
+{
+	col->formatted++;
+
+	return format_value(col->format, col->type, v, buf, size);
+}
+
+/*
+ * the parsed format of a cell given the format passed with it: the
+ * column's, or one of the formats that are common enough to look for.
+ * NULL means it's up to printf
+ */
+const struct ptab_col_format *ptab__format_of(const struct ptab_col *col,
+					      const char *format)
+{
+	if (col->format)
+		return col->format;
+
+	/* only a double can do without a format */
+	if (!format) {
+		assert(col->type == PTAB_DOUBLE);
+		return &shortest_format;
+	}
+
+	if (format[0] != '%')
+		return NULL;
+
+	if (col->type == PTAB_INTEGER) {
+		if ((format[1] == 'd' || format[1] == 'i') && format[2] == '\0')
+			return &ptab__format_plain;
+	} else if (col->type == PTAB_INT64) {
+		if (strcmp(format, "%" PRId64) == 0 || strcmp(format, "%" PRIi64) == 0)
+			return &ptab__format_plain;
+	} else if (col->type == PTAB_UINT64) {
+		if (strcmp(format, "%" PRIu64) == 0)
+			return &ptab__format_plain;
+	} else if (format[1] == '.' && is_digit(format[2]) &&
+		   format[3] == 'f' && format[4] == '\0') {
+		return &fixed_formats[format[2] - '0'];
+	}
+
+	return NULL;
+}
+
+/* the format of a decimal column with the given scale, and no other text */
+const struct ptab_col_format *ptab__format_decimal(unsigned int scale)
+{
+	assert(scale <= PTAB_DECIMAL_MAX_SCALE);
+
+	return &decimal_formats[scale];
+}
+
+/* the same as ptab__format_cell, for a format that isn't a column's */
+int ptab__format_value(const struct ptab_col_format *f, enum ptab_type type,
+		       union ptab_cell_value v, char *buf, size_t size)
+{
+	return format_value(f, type, v, buf, size);
+}
+
+int ptab__format_len(const struct ptab_col *col, union ptab_cell_value v)
+{
+	const struct ptab_col_format *f = col->format;
+	char buf[FORMAT_BUF_SIZE];
+	size_t len, n = 0;
+	int ret;
+
+	if (f->kind == FORMAT_FIXED)
+		n = ptab__num_fixed_len(v.f, f->places);
+
+	if (format_is_int(f)) {
+		len = ptab__format_int_len(f, col->type, v);
+	} else if (n > 0) {
+		len = f->prefix_len + n + f->suffix_len;
+	} else {
+		/*
+		 * only a value too big to round without printf (or an
+		 * infinity or NaN) takes formatting to measure
+		 */
+		ret = format_value(f, col->type, v, buf, sizeof(buf));
+		if (ret < 0)
+			return ret;
+
+		len = (size_t)ret;
+	}
+
+	return len < FORMAT_BUF_SIZE ? (int)len : FORMAT_BUF_SIZE - 1;
+}
@@ -1,15 +1,41 @@
 #ifndef INTERNAL_H
 #define INTERNAL_H
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
 #include <ptab.h>
 
+/*
+ * blocks with free space are indexed by size class, where class n
+ * holds the blocks that have at least 2^n bytes available
+ */
+#define MEM_NUM_BINS (sizeof(size_t) * CHAR_BIT)
+
+/* alignment of memory returned by ptab__mem_alloc */
+#define MEM_ALIGN (sizeof(double) > sizeof(void *) ? sizeof(double) : sizeof(void *))
+
+/* tags stored in each block header to identify what it holds */
+#define MEM_MAGIC_ARENA  0x70746162u
+#define MEM_MAGIC_OUTPUT 0x7074616fu
+#define MEM_MAGIC_SPARE  0x70746173u
+#define MEM_MAGIC_MAPPED 0x7074616du
+
 struct mem_block {
+	unsigned int magic;
+	unsigned int bin;
+	const struct ptab_internal *owner;
 	unsigned char *buf;
+	size_t size;
+	size_t base;
 	size_t used;
 	size_t avail;
 	struct mem_block *prev;
 	struct mem_block *next;
+	struct mem_block *bin_prev;
+	struct mem_block *bin_next;
 };
 
 struct mem_block_cache {
@@ -19,14 +45,79 @@ struct mem_block_cache {
 	struct mem_block *head;
 	struct mem_block *tail;
 	struct mem_block *root;
+	struct mem_block *current;
+	struct mem_block *spare;
+	struct mem_block *output;
+	struct mem_block *bins[MEM_NUM_BINS];
 };
 
 struct mem_internal {
 	bool disabled;
-	struct ptab_allocator funcs;
+	bool marked;
+	size_t reserved;
+	size_t peak;
+	unsigned int map_flags;
+	struct mem_block *map;
+	struct ptab_allocator2 funcs;
+	struct ptab_allocator legacy;
 	struct mem_block_cache cache;
 };
 
+struct spill_internal {
+	size_t limit;
+	size_t bytes;
+	size_t row_start;
+	unsigned int num_rows;
+	FILE *file;
+};
+
+/* a distinct value of a dictionary column */
+struct ptab_dict_entry {
+	const char *str;
+	uint32_t len;
+	uint32_t hash;
+};
+
+/*
+ * the values of a dictionary column, and a hash table of their codes
+ * (plus one) with num_slots slots, a power of two
+ */
+struct ptab_dict {
+	uint32_t count;
+	uint32_t num_slots;
+	uint32_t *codes;
+	struct ptab_dict_entry *entries;
+};
+
+/* longest conversion a column format can have, with its NUL */
+#define FORMAT_SPEC_SIZE 16
+
+/* how a column format's conversion is written */
+enum format_kind {
+	FORMAT_PRINTF,   /* by printf */
+	FORMAT_INT,      /* %d or %i, or %'d or %'i grouped by thousands */
+	FORMAT_FIXED,    /* %f or %.Nf, to places places */
+	FORMAT_SHORTEST, /* a double with no format, in its fewest digits */
+	FORMAT_DECIMAL,  /* a decimal's %f, to the column's scale in places */
+	FORMAT_TIME      /* a timestamp, from the template in time */
+};
+
+/*
+ * a column's format, split into the literal text around its one
+ * conversion (with each %% already made a %) and the conversion
+ */
+struct ptab_col_format {
+	const char *prefix;
+	size_t prefix_len;
+	const char *suffix;
+	size_t suffix_len;
+	char spec[FORMAT_SPEC_SIZE];
+	enum format_kind kind;
+	bool grouped;
+	unsigned int places;
+	struct ptab_time_format *time;
+};
+
 struct ptab_col {
 	unsigned int id;
 	char *name;
@@ -34,45 +125,385 @@ struct ptab_col {
 	enum ptab_align align;
 	size_t name_len;
 	size_t width;
+	unsigned int value_id;
+	size_t loaded;
+	struct ptab_dict *dict;
+	bool lazy;
+	const struct ptab_col_format *format;
+	size_t formatted;
 	struct ptab_col *next;
 };
 
-union ptab_row_data {
-	char *s;
+/* the raw value of a cell, which only numeric columns keep */
+union ptab_cell_value {
 	int i;
+	int64_t l;
+	uint64_t u;
 	double f;
 };
 
-struct ptab_row {
-	union ptab_row_data *data;
-	char **strings;
-	size_t *lengths;
-	struct ptab_row *next;
+/* the column types whose values are integers, which share their formats */
+static inline bool type_is_int(enum ptab_type type)
+{
+	return type == PTAB_INTEGER || type == PTAB_INT64 || type == PTAB_UINT64;
+}
+
+/*
+ * the formats of integers (timestamps included), whose length is known
+ * before they are written
+ */
+static inline bool format_is_int(const struct ptab_col_format *f)
+{
+	return f->kind == FORMAT_INT || f->kind == FORMAT_DECIMAL || f->kind == FORMAT_TIME;
+}
+
+/*
+ * a cell's text is in its chunk's string heap, which is limited to
+ * 4 GiB so that a cell fits in 8 bytes. what kind of cell it is goes
+ * in a byte of the chunk's flags at the same index, so that all of len
+ * is the length. a borrowed cell (CELL_REF) keeps a pointer to the
+ * caller's text in the heap instead, and a dictionary cell (CELL_DICT)
+ * has the code of its column's value in place of the offset. text that
+ * fits in the offset is kept there (CELL_INLINE), and needs no heap at
+ * all. a lazy cell (CELL_LAZY) has no text until it is written out,
+ * only its column's raw value
+ */
+struct ptab_cell {
+	uint32_t offset;
+	uint32_t len;
+};
+
+#define CELL_MAX UINT32_MAX
+#define CELL_REF 0x01
+#define CELL_DICT 0x02
+#define CELL_INLINE 0x04
+#define CELL_LAZY 0x08
+#define CELL_INLINE_MAX sizeof(((struct ptab_cell *)0)->offset)
+
+/* rows per chunk; each new chunk doubles in size up to the limit */
+#define CHUNK_MIN_ROWS 16
+#define CHUNK_MAX_ROWS 4096
+
+/*
+ * extra cells between columns, so that walking across a row doesn't
+ * hit addresses a power of two apart (which share a cache set)
+ */
+#define CHUNK_PAD 8
+
+/*
+ * rows are stored in chunks, with each column's cells kept together
+ * so that a column can be walked straight through memory: column c
+ * of row r is at index c * stride + r of the cells, and numeric
+ * column c keeps its raw values at value_id * stride + r
+ */
+struct ptab_chunk {
+	unsigned int capacity;
+	unsigned int stride;
+	unsigned int num_rows;
+	union ptab_cell_value *values;
+	struct ptab_cell *cells;
+	uint8_t *flags;
+	char *heap;
+	uint32_t heap_size;
+	uint32_t heap_used;
+	struct ptab_chunk *next;
+};
+
+/*
+ * the rows added through one cursor; capacity and row_bytes size the
+ * next chunk and its string heap
+ */
+struct chunk_list {
+	struct ptab_chunk *head;
+	struct ptab_chunk *tail;
+	unsigned int capacity;
+	size_t row_bytes;
+};
+
+static inline size_t chunk_cell(const struct ptab_chunk *c, unsigned int col, unsigned int row)
+{
+	return (size_t)col * c->stride + row;
+}
+
+/* a cell's CELL_* flags */
+static inline uint8_t cell_flags(const struct ptab_chunk *c, const struct ptab_cell *cell)
+{
+	return c->flags[cell - c->cells];
+}
+
+static inline void cell_set(struct ptab_chunk *c, struct ptab_cell *cell,
+			    uint32_t offset, uint32_t len, uint8_t flags)
+{
+	cell->offset = offset;
+	cell->len = len;
+	c->flags[cell - c->cells] = flags;
+}
+
+/* the bytes a cell takes up in the string heap */
+static inline uint32_t cell_size(const struct ptab_chunk *c, const struct ptab_cell *cell)
+{
+	uint8_t flags = cell_flags(c, cell);
+
+	if (flags & (CELL_DICT | CELL_INLINE | CELL_LAZY))
+		return 0;
+
+	return (flags & CELL_REF) ? (uint32_t)sizeof(const char *) : cell->len;
+}
+
+/* keep text of up to CELL_INLINE_MAX bytes in the cell itself */
+static inline void cell_set_inline(struct ptab_chunk *c, struct ptab_cell *cell,
+				   const char *s, size_t len)
+{
+	cell_set(c, cell, 0, (uint32_t)len, CELL_INLINE);
+	memcpy(&cell->offset, s, len);
+}
+
+static inline const char *chunk_str(const struct ptab_chunk *c, const struct ptab_cell *cell)
+{
+	uint8_t flags = cell_flags(c, cell);
+	const char *s;
+
+	if (!(flags & (CELL_REF | CELL_INLINE)))
+		return c->heap + cell->offset;
+
+	if (flags & CELL_INLINE)
+		return (const char *)&cell->offset;
+
+	/* heap offsets aren't aligned for a pointer */
+	memcpy(&s, c->heap + cell->offset, sizeof(s));
+
+	return s;
+}
+
+/* the text of any cell in the column */
+static inline const char *cell_str(const struct ptab_col *col,
+				   const struct ptab_chunk *c,
+				   const struct ptab_cell *cell)
+{
+	if (cell_flags(c, cell) & CELL_DICT)
+		return col->dict->entries[cell->offset].str;
+
+	return chunk_str(c, cell);
+}
+
+/*
+ * where the next row data goes, and which arena it comes from; a
+ * concurrent table has one of these for each thread
+ */
+struct ptab_cursor {
+	struct ptab_chunk *chunk;
+	unsigned int row;
+	struct ptab_col *column;
+	struct chunk_list *rows;
+	unsigned int *num_rows;
+	struct mem_block_cache *cache;
+	struct ptab_shard *shard;
+};
+
+/*
+ * the rows a thread has finished, kept apart until they are merged
+ * into the table; the shard lives at the front of its arena's root
+ * block, the same way the table does
+ */
+struct ptab_shard {
+	struct mem_block_cache cache;
+	struct ptab_cursor cursor;
+	struct chunk_list rows;
+	unsigned int num_rows;
+	struct ptab_shard *next;
+};
+
+struct shard_internal {
+	bool enabled;
+	pthread_key_t key;
+	pthread_mutex_t lock;
+	struct ptab_shard *head;
+	struct ptab_shard *tail;
+};
+
+/*
+ * rows being loaded a column at a time; they start at first_row of
+ * the first chunk, and there is room for capacity of them in the
+ * chunks from there on
+ */
+struct load_internal {
+	bool active;
+	struct ptab_chunk *first;
+	unsigned int first_row;
+	size_t capacity;
 };
 
 struct ptab_internal {
 	struct mem_internal mem;
+	struct spill_internal spill;
+	struct shard_internal shards;
+	struct load_internal load;
 
 	unsigned int num_columns;
+	unsigned int num_values;
 	unsigned int num_rows;
 
 	struct ptab_col *columns_head;
 	struct ptab_col *columns_tail;
 
-	struct ptab_row *rows_head;
-	struct ptab_row *rows_tail;
+	struct chunk_list rows;
 
-	struct ptab_row *current_row;
-	struct ptab_col *current_column;
+	struct ptab_cursor cursor;
 };
 
 /* mem.c */
-extern ptab_t *ptab__mem_init(const ptab_allocator_t *funcs);
+extern ptab_t *ptab__mem_init(const ptab_allocator2_t *funcs,
+			       const ptab_allocator_t *legacy);
 extern void ptab__mem_free(ptab_t *p);
+extern void ptab__mem_mark(ptab_t *p);
+extern void ptab__mem_rewind(ptab_t *p);
 extern void ptab__mem_free_block(ptab_t *p, void *block);
 extern void *ptab__mem_alloc(ptab_t *p, size_t size);
+extern void *ptab__mem_alloc_str(ptab_t *p, size_t size);
+extern void *ptab__mem_cache_alloc(ptab_t *p, struct mem_block_cache *c, size_t size);
+extern void *
+ptab__mem_cache_alloc_str(ptab_t *p, struct mem_block_cache *c, size_t size);
 extern void *ptab__mem_alloc_block(ptab_t *p, size_t size);
+extern int ptab__mem_reserve(ptab_t *p, struct mem_block_cache *c, size_t size);
+extern struct ptab_shard *ptab__mem_shard_create(ptab_t *p);
+extern void ptab__mem_shard_rewind(ptab_t *p, struct ptab_shard *s);
+extern void ptab__mem_shard_free(ptab_t *p, struct ptab_shard *s);
 extern void ptab__mem_enable(ptab_t *p);
 extern void ptab__mem_disable(ptab_t *p);
 
+/* row.c */
+extern struct ptab_chunk *
+ptab__row_add_chunk(ptab_t *p, struct ptab_cursor *cursor, size_t min_heap);
+extern int ptab__row_check_limit(ptab_t *p);
+
+/* format.c */
+
+/*
+ * numeric cells are formatted into a buffer of FORMAT_BUF_SIZE bytes,
+ * and longer text is cut off
+ */
+#define FORMAT_BUF_SIZE 128
+
+extern int ptab__format_set(ptab_t *p, struct ptab_col *col, const char *format);
+extern int ptab__format_cell(struct ptab_col *col, union ptab_cell_value v,
+			     char *buf, size_t size);
+extern int ptab__format_len(const struct ptab_col *col, union ptab_cell_value v);
+extern const struct ptab_col_format *ptab__format_of(const struct ptab_col *col,
+						     const char *format);
+extern int ptab__format_value(const struct ptab_col_format *f, enum ptab_type type,
+			      union ptab_cell_value v, char *buf, size_t size);
+extern size_t ptab__format_int_len(const struct ptab_col_format *f, enum ptab_type type,
+				   union ptab_cell_value v);
+extern void ptab__format_int_put(const struct ptab_col_format *f, enum ptab_type type,
+				 union ptab_cell_value v, char *buf, size_t len);
+extern const struct ptab_col_format *ptab__format_decimal(unsigned int scale);
+extern const struct ptab_col_format ptab__format_plain;
+
+/* number.c */
+
+/*
+ * the most places a %.Nf is written to without printf, and the room
+ * the text of a number written here takes
+ */
+#define NUM_FIXED_MAX 15
+#define NUM_BUF_SIZE 40
+
+extern unsigned int ptab__num_len(uint64_t u);
+extern void ptab__num_put(char *end, uint64_t u);
+extern void ptab__num_put_grouped(char *end, uint64_t u);
+extern unsigned int ptab__num_decimal_len(uint64_t u, unsigned int places);
+extern void ptab__num_put_decimal(char *end, uint64_t u, unsigned int places);
+extern size_t ptab__num_shortest(double v, char *buf);
+extern size_t ptab__num_fixed(double v, unsigned int places, char *buf);
+extern size_t ptab__num_fixed_len(double v, unsigned int places);
+
+/* timestamp.c */
+
+/*
+ * a timestamp column's format, parsed into literal text with room for
+ * each field, all of which have a fixed width; the text of the last
+ * minute written is kept, so that the next timestamp in that minute
+ * only writes its seconds. a concurrent table's columns are shared by
+ * its threads, so they don't keep it
+ */
+#define TIME_FIELDS_MAX 16
+
+enum time_field_kind {
+	TIME_YEAR,
+	TIME_MONTH,
+	TIME_DAY,
+	TIME_HOUR,
+	TIME_MINUTE,
+	TIME_SECOND,
+	TIME_FRACTION
+};
+
+struct time_field {
+	enum time_field_kind kind;
+	unsigned int offset;
+	unsigned int width;
+};
+
+struct ptab_time_format {
+	struct time_field fields[TIME_FIELDS_MAX];
+	unsigned int num_fields;
+	unsigned int len;
+	const bool *shared;
+	bool cached;
+	int64_t minute;
+	char text[NUM_BUF_SIZE];
+	char last[NUM_BUF_SIZE];
+};
+
+extern int ptab__time_set(ptab_t *p, struct ptab_col *col, const char *format);
+extern void ptab__time_put(struct ptab_time_format *t, int64_t ns, char *buf);
+
+/* dict.c */
+extern int ptab__dict_cell(ptab_t *p, struct ptab_col *col, struct ptab_chunk *chunk,
+			   struct ptab_cell *cell, const char *s, size_t len);
+extern void ptab__dict_reset(ptab_t *p);
+
+/* load.c */
+extern int ptab__load_finish(ptab_t *p);
+extern void ptab__load_reset(ptab_t *p);
+
+/* shard.c */
+extern struct ptab_cursor *ptab__shard_cursor(ptab_t *p);
+extern bool ptab__shard_busy(const ptab_t *p);
+extern void ptab__shard_merge(ptab_t *p);
+extern void ptab__shard_reset(ptab_t *p);
+extern void ptab__shard_free(ptab_t *p);
+
+/*
+ * grow a column to fit a cell; concurrent tables have many threads
+ * doing this at once, so they take the maximum atomically
+ */
+static inline void ptab__col_fit(const ptab_t *p, struct ptab_col *col, size_t len)
+{
+	size_t width;
+
+	if (!p->shards.enabled) {
+		if (len > col->width)
+			col->width = len;
+
+		return;
+	}
+
+	width = __atomic_load_n(&col->width, __ATOMIC_RELAXED);
+
+	while (len > width &&
+	       !__atomic_compare_exchange_n(&col->width, &width, len, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/* spill.c */
+extern int ptab__spill_rows(ptab_t *p);
+extern void ptab__spill_discard(ptab_t *p);
+extern void ptab__spill_close(ptab_t *p);
+extern int ptab__spill_read_begin(const ptab_t *p);
+extern int
+ptab__spill_read_row(const ptab_t *p, struct ptab_chunk *chunk);
+extern int ptab__spill_read_end(const ptab_t *p);
+
 #endif
@@ -0,0 +1,474 @@
+
+#include <assert.h>
+#include <string.h>
+
+#include <ptab.h>
+#include "internal.h"
+
+/*
+ * columns can be loaded from an array at a time, straight into the
+ * chunks' column-major cells. the rows that makes are pending until
+ * the load is finished, which happens as soon as every column has the
+ * same number of rows, or else before the table is written out or
+ * rows are added the other ways, when it is an error for them not to
+ */
+
+/* the chunk that pending row r is in, and its row within the chunk */
+static struct ptab_chunk *load_chunk(const ptab_t *p, size_t r, unsigned int *row)
+{
+	struct ptab_chunk *chunk = p->load.first;
+
+	r += p->load.first_row;
+
+	while (r >= chunk->capacity) {
+		r -= chunk->capacity;
+		chunk = chunk->next;
+	}
+
+	*row = (unsigned int)r;
+
+	return chunk;
+}
+
+/* make sure the chunks have room for the given number of pending rows */
+static int load_reserve(ptab_t *p, size_t rows)
+{
+	struct ptab_cursor *cursor = &p->cursor;
+	struct chunk_list *list = cursor->rows;
+	struct ptab_chunk *chunk;
+
+	if (!p->load.active) {
+		/*
+		 * the schema is done once rows start coming in, the same
+		 * as for ptab_begin_row
+		 */
+		if (!p->mem.marked)
+			ptab__mem_mark(p);
+
+		p->spill.row_start = p->mem.cache.total_used;
+
+		/* pending rows pick up where the last chunk left off */
+		chunk = list->tail;
+		if (chunk && chunk->num_rows < chunk->capacity) {
+			p->load.first = chunk;
+			p->load.first_row = chunk->num_rows;
+			p->load.capacity = chunk->capacity - chunk->num_rows;
+		} else {
+			p->load.first = NULL;
+			p->load.first_row = 0;
+			p->load.capacity = 0;
+		}
+
+		p->load.active = true;
+	}
+
+	/* a big load may as well have big chunks */
+	if (rows > list->capacity)
+		list->capacity = rows < CHUNK_MAX_ROWS ? (unsigned int)rows : CHUNK_MAX_ROWS;
+
+	while (p->load.capacity < rows) {
+		chunk = ptab__row_add_chunk(p, cursor, 0);
+		if (!chunk)
+			return PTAB_EMEM;
+
+		if (!p->load.first)
+			p->load.first = chunk;
+
+		p->load.capacity += chunk->capacity;
+	}
+
+	return PTAB_OK;
+}
+
+/*
+ * the columns take turns filling a chunk's heap, so it can't be sized
+ * up front; when it runs out, it moves to a bigger allocation, which
+ * the cells' offsets still work in
+ */
+static int grow_heap(ptab_t *p, struct ptab_chunk *chunk, size_t need)
+{
+	size_t size;
+	char *heap;
+
+	if (need > CELL_MAX - chunk->heap_used)
+		return PTAB_ERANGE;
+
+	size = (size_t)chunk->heap_size * 2;
+	if (size < chunk->heap_used + need)
+		size = chunk->heap_used + need;
+	if (size > CELL_MAX)
+		size = CELL_MAX;
+
+	heap = ptab__mem_alloc_str(p, size);
+	if (!heap)
+		return PTAB_EMEM;
+
+	memcpy(heap, chunk->heap, chunk->heap_used);
+
+	chunk->heap = heap;
+	chunk->heap_size = (uint32_t)size;
+
+	return PTAB_OK;
+}
+
+static int load_cell(ptab_t *p, struct ptab_chunk *chunk,
+		     struct ptab_cell *cell, const char *str, size_t len)
+{
+	int err;
+
+	if (len <= CELL_INLINE_MAX) {
+		cell_set_inline(chunk, cell, str, len);
+		return PTAB_OK;
+	}
+
+	if (len > CELL_MAX)
+		return PTAB_ERANGE;
+
+	if (len > (size_t)(chunk->heap_size - chunk->heap_used)) {
+		err = grow_heap(p, chunk, len);
+		if (err)
+			return err;
+	}
+
+	cell_set(chunk, cell, chunk->heap_used, (uint32_t)len, 0);
+
+	memcpy(chunk->heap + chunk->heap_used, str, len);
+	chunk->heap_used += (uint32_t)len;
+
+	return PTAB_OK;
+}
+
+/* the widest of a run of cells, in a loop the compiler can vectorize */
+static uint32_t max_len(const struct ptab_cell *cells, unsigned int n)
+{
+	uint32_t width = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		width = cells[i].len > width ? cells[i].len : width;
+
+	return width;
+}
+
+/*
+ * check that n values can be loaded into column col, and make room
+ * for them; the column is returned through column
+ */
+static int load_begin(ptab_t *p, unsigned int col, enum ptab_type type,
+		      const char *format, size_t n, struct ptab_col **column)
+{
+	struct ptab_col *c;
+
+	/* the rows of a concurrent table are spread across threads */
+	if (p->shards.enabled || p->cursor.chunk)
+		return PTAB_EORDER;
+
+	if (col >= p->num_columns)
+		return PTAB_ERANGE;
+
+	for (c = p->columns_head; c->id != col; c = c->next)
+		;
+
+	if (c->type != type)
+		return PTAB_ETYPE;
+
+	/* a column format takes the place of the one given here */
+	if (type != PTAB_STRING && type != PTAB_DOUBLE && !format && !c->format)
+		return PTAB_ENULL;
+
+	if (n > UINT_MAX - p->num_rows - c->loaded)
+		return PTAB_ERANGE;
+
+	*column = c;
+
+	if (n == 0)
+		return PTAB_OK;
+
+	return load_reserve(p, c->loaded + n);
+}
+
+/*
+ * store count values, starting at the given row of chunk; the number
+ * stored is returned through stored even if some of them fail
+ */
+static int load_run(ptab_t *p,
+		    struct ptab_col *column,
+		    struct ptab_chunk *chunk,
+		    unsigned int row,
+		    unsigned int count,
+		    const char *format,
+		    const void *vals,
+		    unsigned int *stored)
+{
+	struct ptab_cell *cells = chunk->cells + chunk_cell(chunk, column->id, row);
+	const struct ptab_col_format *fmt = NULL;
+	union ptab_cell_value *values = NULL;
+	char buf[FORMAT_BUF_SIZE];
+	const char *str = buf;
+	unsigned int i;
+	size_t len;
+	int ret = 0;
+	int err = PTAB_OK;
+
+	if (column->type != PTAB_STRING)
+		values = chunk->values + chunk_cell(chunk, column->value_id, row);
+
+	/* the common formats needn't go through printf */
+	if (column->type != PTAB_STRING && !column->format)
+		fmt = ptab__format_of(column, format);
+
+	for (i = 0; i < count; i++) {
+		switch (column->type) {
+		case PTAB_STRING:
+			str = ((const char *const *)vals)[i];
+			break;
+		case PTAB_INTEGER:
+			values[i].i = ((const int *)vals)[i];
+			if (!fmt && !column->format)
+				ret = snprintf(buf, FORMAT_BUF_SIZE, format, values[i].i);
+			break;
+		case PTAB_INT64:
+		case PTAB_DECIMAL:
+		case PTAB_TIMESTAMP:
+			values[i].l = ((const int64_t *)vals)[i];
+			if (!fmt && !column->format)
+				ret = snprintf(buf, FORMAT_BUF_SIZE, format, values[i].l);
+			break;
+		case PTAB_UINT64:
+			values[i].u = ((const uint64_t *)vals)[i];
+			if (!fmt && !column->format)
+				ret = snprintf(buf, FORMAT_BUF_SIZE, format, values[i].u);
+			break;
+		case PTAB_FLOAT:
+			values[i].f = ((const float *)vals)[i];
+			if (!fmt && !column->format)
+				ret = snprintf(buf, FORMAT_BUF_SIZE, format, values[i].f);
+			break;
+		default:
+			values[i].f = ((const double *)vals)[i];
+			if (!fmt && !column->format)
+				ret = snprintf(buf, FORMAT_BUF_SIZE, format, values[i].f);
+			break;
+		}
+
+		if (column->lazy) {
+			ret = ptab__format_len(column, values[i]);
+			if (ret < 0) {
+				err = PTAB_EFORMAT;
+				break;
+			}
+
+			cell_set(chunk, &cells[i], 0, (uint32_t)ret, CELL_LAZY);
+			continue;
+		}
+
+		if (column->format)
+			ret = ptab__format_cell(column, values[i], buf, FORMAT_BUF_SIZE);
+		else if (fmt)
+			ret = ptab__format_value(fmt, column->type, values[i], buf, FORMAT_BUF_SIZE);
+
+		if (!str) {
+			err = PTAB_ENULL;
+			break;
+		}
+
+		if (ret < 0) {
+			err = PTAB_EFORMAT;
+			break;
+		}
+
+		if (str == buf)
+			len = ret < FORMAT_BUF_SIZE ? (size_t)ret : FORMAT_BUF_SIZE - 1;
+		else
+			len = strlen(str);
+
+		if (column->dict)
+			err = ptab__dict_cell(p, column, chunk, &cells[i], str, len);
+		else
+			err = load_cell(p, chunk, &cells[i], str, len);
+		if (err)
+			break;
+	}
+
+	ptab__col_fit(p, column, max_len(cells, i));
+	*stored = i;
+
+	return err;
+}
+
+static int load_column(ptab_t *p, unsigned int col, enum ptab_type type,
+		       const char *format, const void *vals, size_t size, size_t n)
+{
+	struct ptab_chunk *chunk;
+	struct ptab_col *column, *c;
+	unsigned int row, count, stored;
+	size_t done;
+	int err;
+
+	err = load_begin(p, col, type, format, n, &column);
+	if (err || n == 0)
+		return err;
+
+	chunk = load_chunk(p, column->loaded, &row);
+
+	for (done = 0; done < n; done += count) {
+		if (row == chunk->capacity) {
+			chunk = chunk->next;
+			row = 0;
+		}
+
+		count = chunk->capacity - row;
+		if (count > n - done)
+			count = (unsigned int)(n - done);
+
+		err = load_run(p, column, chunk, row, count, format,
+			       (const char *)vals + done * size, &stored);
+
+		column->loaded += stored;
+
+		if (err)
+			return err;
+
+		row += count;
+	}
+
+	/* once every column has caught up, the rows are complete */
+	for (c = p->columns_head; c; c = c->next) {
+		if (c->loaded != column->loaded)
+			return PTAB_OK;
+	}
+
+	return ptab__load_finish(p);
+}
+
+int ptab_column_data_s(ptab_t *p, unsigned int col,
+		       const char *const *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_STRING, NULL, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_i(ptab_t *p, unsigned int col, const char *format,
+		       const int *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_INTEGER, format, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_f(ptab_t *p, unsigned int col, const char *format,
+		       const float *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_FLOAT, format, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_d(ptab_t *p, unsigned int col, const char *format,
+		       const double *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_DOUBLE, format, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_i64(ptab_t *p, unsigned int col, const char *format,
+			 const int64_t *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_INT64, format, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_u64(ptab_t *p, unsigned int col, const char *format,
+			 const uint64_t *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_UINT64, format, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_dec(ptab_t *p, unsigned int col, const int64_t *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_DECIMAL, NULL, vals, sizeof(*vals), n);
+}
+
+int ptab_column_data_ts(ptab_t *p, unsigned int col, const int64_t *vals, size_t n)
+{
+	if (!p || (!vals && n > 0))
+		return PTAB_ENULL;
+
+	return load_column(p, col, PTAB_TIMESTAMP, NULL, vals, sizeof(*vals), n);
+}
+
+/*
+ * check that every column was given the same number of rows, then
+ * add them to the table
+ */
+int ptab__load_finish(ptab_t *p)
+{
+	struct ptab_chunk *chunk;
+	struct ptab_col *col;
+	unsigned int row, count;
+	size_t n, left;
+
+	assert(p != NULL);
+
+	if (!p->load.active)
+		return PTAB_OK;
+
+	n = p->columns_head->loaded;
+
+	for (col = p->columns_head; col; col = col->next) {
+		if (col->loaded != n)
+			return PTAB_ECOLUMNS;
+	}
+
+	chunk = p->load.first;
+	row = p->load.first_row;
+
+	for (left = n; left > 0; left -= count) {
+		count = chunk->capacity - row;
+		if (count > left)
+			count = (unsigned int)left;
+
+		chunk->num_rows = row + count;
+		chunk = chunk->next;
+		row = 0;
+	}
+
+	p->num_rows += (unsigned int)n;
+
+	ptab__load_reset(p);
+
+	if (p->spill.limit)
+		return ptab__row_check_limit(p);
+
+	return PTAB_OK;
+}
+
+/* forget about any rows that were being loaded */
+void ptab__load_reset(ptab_t *p)
+{
+	struct ptab_col *col;
+
+	assert(p != NULL);
+
+	for (col = p->columns_head; col; col = col->next)
+		col->loaded = 0;
+
+	p->load.active = false;
+	p->load.first = NULL;
+	p->load.first_row = 0;
+	p->load.capacity = 0;
+}
@@ -1,235 +1,365 @@
 
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
+#ifdef PTAB_HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "internal.h"
 
 #define MEM_BLOCK_SIZE 4096
+#define MEM_BLOCK_SHIFT_MAX 11
+
+/* blocks with less than this many bytes free are not indexed */
+#define MEM_MIN_AVAIL 16
+
+/* transparent huge pages are 2 MiB on the common platforms */
+#define MEM_HUGE_PAGE (2 << 20)
 
-static void *default_alloc(size_t size, void *opaque)
+/* marks a block that is not in any of the size class bins */
+#define MEM_NO_BIN ((unsigned int)MEM_NUM_BINS)
+
+static void *default_alloc(size_t size, size_t align, void *opaque)
 {
 	(void)opaque;
+
+	/* nothing asks for more than malloc already guarantees */
+	assert(align <= MEM_ALIGN);
+	(void)align;
+
 	return malloc(size);
 }
 
-static void default_free(void *p, void *opaque)
+static void default_free(void *p, size_t size, size_t align, void *opaque)
 {
+	(void)size;
+	(void)align;
 	(void)opaque;
 	free(p);
 }
 
-static bool block_valid(struct mem_block *b)
+/*
+ * the original allocator interface is adapted to the sized one; the
+ * opaque pointer is the ptab_allocator_t, which has its own opaque
+ */
+static void *legacy_alloc(size_t size, size_t align, void *opaque)
 {
-	bool retval = true;
+	const ptab_allocator_t *a = opaque;
 
-	if (b->prev && (b->prev->avail < b->avail))
-		retval = false;
+	(void)align;
+	return a->alloc_func(size, a->opaque);
+}
 
-	if (b->next && (b->next->avail > b->avail))
-		retval = false;
+static void legacy_free(void *p, size_t size, size_t align, void *opaque)
+{
+	const ptab_allocator_t *a = opaque;
 
-	return retval;
+	(void)size;
+	(void)align;
+	a->free_func(p, a->opaque);
+}
+
+/*
+ * the footprint is shared by every thread filling a concurrent table,
+ * so it is always updated atomically; this only happens when a block
+ * is taken or given back, so it costs next to nothing
+ */
+static void mem_account(struct mem_internal *mem, size_t size)
+{
+	size_t reserved, peak;
+
+	reserved = __atomic_add_fetch(&mem->reserved, size, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&mem->peak, __ATOMIC_RELAXED);
+
+	while (reserved > peak &&
+	       !__atomic_compare_exchange_n(&mem->peak, &peak, reserved, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
 }
 
-static void *block_alloc(struct mem_block *b, size_t size)
+/*
+ * all memory taken from and given back to the allocator goes through
+ * these two functions so that the footprint is accounted for
+ */
+static void *mem_get(struct mem_internal *mem, size_t size)
 {
-	assert(b->avail >= size);
+	void *ptr = mem->funcs.alloc_func(size, MEM_ALIGN, mem->funcs.opaque);
 
-	void *retval = (void *)(b->buf + b->used);
-	b->used += size;
-	b->avail -= size;
+	if (ptr)
+		mem_account(mem, size);
 
-	return retval;
+	return ptr;
 }
 
-static void cache_insert(struct mem_block_cache *c, struct mem_block *b)
+static void mem_put(struct mem_internal *mem, struct mem_block *b)
 {
-	if (c->head == NULL) {
-		/*
-		 * if head is NULL, this will be the first block
-		 * in the cache; just add it to the head of the list
-		 * and get out of here
-		 */
-		assert(c->num_blocks == 0);
-		assert(c->total_used == 0);
-		assert(c->total_avail == 0);
-		assert(c->tail == NULL);
-		assert(c->root == NULL);
-
-		b->prev = NULL;
-		b->next = NULL;
-
-		c->num_blocks = 1;
-		c->total_used = b->used;
-		c->total_avail = b->avail;
-		c->head = b;
-		c->tail = b;
-		c->root = b;
+	__atomic_sub_fetch(&mem->reserved, b->size, __ATOMIC_RELAXED);
 
+#ifdef PTAB_HAVE_MMAP
+	if (b->magic == MEM_MAGIC_MAPPED) {
+		munmap(b, b->size);
 		return;
 	}
+#endif
+
+	mem->funcs.free_func(b, b->size, MEM_ALIGN, mem->funcs.opaque);
+}
 
-	struct mem_block *node = c->head;
-	bool inserted = false;
+static unsigned int floor_log2(size_t v)
+{
+	unsigned int n = 0;
 
-	assert(c->head != NULL);
-	assert(c->tail != NULL);
+	assert(v != 0);
 
-	/*
-	 * loop through each block in the cache. insert this
-	 * block so that the list will be sorted in descending
-	 * order based on avail size
-	 */
-	while (node) {
-		if (b->avail > node->avail) {
-			b->prev = node->prev;
-			b->next = node;
-
-			if (c->head == node) {
-				/* this block will be the new head */
-				assert(node->prev == NULL);
-				c->head = b;
-			} else {
-				/*
-				 * this block will be inserted in the middle
-				 * of the list
-				 */
-				assert(node->prev != NULL);
-				node->prev->next = b;
-			}
-
-			node->prev = b;
-			inserted = true;
-			break;
-		}
+	while (v >>= 1)
+		n++;
 
-		node = node->next;
-	}
+	return n;
+}
 
-	if (!inserted) {
-		/*
-		 * if this block is smaller than all the others
-		 * insert it at the end of the list
-		 */
-		b->prev = c->tail;
-		b->next = NULL;
-		c->tail->next = b;
-		c->tail = b;
-	}
+static unsigned int ceil_log2(size_t v)
+{
+	unsigned int n = floor_log2(v);
 
-	/* finally, update the cache counters */
-	c->num_blocks++;
-	c->total_used += b->used;
-	c->total_avail += b->avail;
+	if (v & (v - 1))
+		n++;
+
+	return n;
 }
 
-static void cache_remove(struct mem_block_cache *c, struct mem_block *b)
+/* number of padding bytes needed to align the next allocation */
+static size_t block_padding(const struct mem_block *b, size_t align)
 {
-	const bool is_head = (c->head == b);
-	const bool is_tail = (c->tail == b);
+	uintptr_t addr = (uintptr_t)(b->buf + b->used);
 
-	if (b->prev) {
-		assert(c->head != b);
-		b->prev->next = b->next;
+	return (size_t)(-addr & (align - 1));
+}
 
-		if (is_tail)
-			c->tail = b->prev;
-	}
+static bool block_fits(const struct mem_block *b, size_t size, size_t align)
+{
+	return b->avail >= size && b->avail - size >= block_padding(b, align);
+}
 
-	if (b->next) {
-		assert(c->tail != b);
-		b->next->prev = b->prev;
+static void *
+block_alloc(struct mem_block_cache *c, struct mem_block *b, size_t size, size_t align)
+{
+	size_t total = block_padding(b, align) + size;
+
+	assert(b->avail >= total);
 
-		if (is_head)
-			c->head = b->next;
+	void *retval = (void *)(b->buf + b->used + (total - size));
+	b->used += total;
+	b->avail -= total;
+
+	c->total_used += total;
+	c->total_avail -= total;
+
+	return retval;
+}
+
+static void bin_insert(struct mem_block_cache *c, struct mem_block *b)
+{
+	/* blocks that are nearly full are not worth tracking */
+	if (b->avail < MEM_MIN_AVAIL) {
+		b->bin = MEM_NO_BIN;
+		return;
 	}
 
-	c->num_blocks--;
+	b->bin = floor_log2(b->avail);
+	b->bin_prev = NULL;
+	b->bin_next = c->bins[b->bin];
+
+	if (b->bin_next)
+		b->bin_next->bin_prev = b;
+
+	c->bins[b->bin] = b;
+}
+
+static void bin_remove(struct mem_block_cache *c, struct mem_block *b)
+{
+	if (b->bin == MEM_NO_BIN)
+		return;
+
+	if (b->bin_prev)
+		b->bin_prev->bin_next = b->bin_next;
+	else
+		c->bins[b->bin] = b->bin_next;
+
+	if (b->bin_next)
+		b->bin_next->bin_prev = b->bin_prev;
+
+	b->bin = MEM_NO_BIN;
 }
 
 /*
- * find a block that can satisfy an allocation of
- * the given size
+ * find a block that can satisfy an allocation of the given size;
+ * every block in bin n has at least 2^n bytes available, so the
+ * first non-empty bin at or above the rounded-up size class is
+ * guaranteed to fit. a block made for an allocation of this size
+ * sits in the bin below, so that one is searched first
  */
-static struct mem_block *cache_find(struct mem_block_cache *c, size_t size)
+static struct mem_block *bin_find(struct mem_block_cache *c, size_t size)
 {
-	struct mem_block *block = c->head;
-	struct mem_block *retval = NULL;
+	struct mem_block *b;
+	unsigned int i;
 
-	/* find the smallest block that has size available */
-	while (block) {
-		if (block->avail >= size)
-			retval = block;
-		else
-			break;
+	if (size & (size - 1)) {
+		for (b = c->bins[floor_log2(size)]; b; b = b->bin_next) {
+			if (b->avail >= size)
+				return b;
+		}
+	}
 
-		block = block->next;
+	for (i = ceil_log2(size); i < MEM_NUM_BINS; i++) {
+		if (c->bins[i])
+			return c->bins[i];
 	}
 
-	return retval;
+	return NULL;
 }
 
-/* check if the block exists in the cache */
-static bool cache_exists(const struct mem_block_cache *c,
-			 const struct mem_block *b)
+static void cache_insert(struct mem_block_cache *c, struct mem_block *b)
 {
-	struct mem_block *block = c->head;
-	bool retval = false;
+	/* new blocks always go on the end of the list */
+	b->prev = c->tail;
+	b->next = NULL;
+	b->bin = MEM_NO_BIN;
 
-	/*
-	 * just iterate through the block cache looking
-	 * for a block with the same memory location
-	 */
-	while (block) {
-		if (block == b) {
-			retval = true;
-			break;
-		}
+	if (c->tail)
+		c->tail->next = b;
+	else
+		c->head = b;
 
-		block = block->next;
-	}
+	c->tail = b;
 
-	return retval;
+	/* finally, update the cache counters */
+	c->num_blocks++;
+	c->total_used += b->used;
+	c->total_avail += b->avail;
 }
 
-static struct mem_block *create_block(struct mem_internal *mem, size_t min_size)
+static void cache_remove(struct mem_block_cache *c, struct mem_block *b)
 {
-	size_t size;
+	assert(b != c->root);
+	assert(b != c->current);
+
+	bin_remove(c, b);
+
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		c->head = b->next;
+
+	if (b->next)
+		b->next->prev = b->prev;
+	else
+		c->tail = b->prev;
+
+	c->num_blocks--;
+	c->total_used -= b->used;
+	c->total_avail -= b->avail;
+}
+
+static struct mem_block *
+create_block(ptab_t *p, const struct mem_block_cache *c, size_t min_size)
+{
+	struct mem_internal *mem = &p->mem;
 	size_t alloc_size;
 
-	/* grow the allocation size by two every time */
-	size = MEM_BLOCK_SIZE << mem->cache.num_blocks;
+	/*
+	 * grow the allocation size by two every time, up to a limit;
+	 * the mem_block structure lives at the front of the allocation
+	 * so that the whole thing is a power of two
+	 */
+	if (c->num_blocks < MEM_BLOCK_SHIFT_MAX)
+		alloc_size = MEM_BLOCK_SIZE << c->num_blocks;
+	else
+		alloc_size = MEM_BLOCK_SIZE << MEM_BLOCK_SHIFT_MAX;
 
 	/*
 	 * if the requested allocation is larger than
 	 * the computed block size, use that size
 	 * instead
 	 */
-	if (min_size > size)
-		size = min_size;
+	if (min_size > alloc_size - sizeof(struct mem_block))
+		alloc_size = min_size + sizeof(struct mem_block);
 
 	/* allocate the new block */
 	struct mem_block *b;
 
-	/* need to account for the mem_block structure overhead */
-	alloc_size = size + sizeof(struct mem_block);
-
-	b = mem->funcs.alloc_func(alloc_size, mem->funcs.opaque);
+	b = mem_get(mem, alloc_size);
 	if (!b)
 		return NULL;
 
 	/* initialize the new block */
+	b->magic = MEM_MAGIC_ARENA;
+	b->owner = p;
 	b->buf = (unsigned char *)(b + 1);
+	b->size = alloc_size;
+	b->base = 0;
 	b->used = 0;
-	b->avail = size;
+	b->avail = alloc_size - sizeof(struct mem_block);
 
 	return b;
 }
 
-void *ptab__mem_alloc(ptab_t *p, size_t size)
+/*
+ * try to make room for min_size more bytes by growing the current
+ * block in place, which saves starting a new block and leaves the
+ * rest of the block's space in one piece; the root block is skipped
+ * since its allocation starts at the ptab_internal structure
+ */
+static bool grow_block(struct mem_internal *mem,
+		       struct mem_block_cache *c,
+		       struct mem_block *b,
+		       size_t min_size)
+{
+	size_t grow, new_size;
+
+	if (!mem->funcs.realloc_func)
+		return false;
+
+	if (b->magic != MEM_MAGIC_ARENA || b == c->root)
+		return false;
+
+	/* double the block, with the same limit as new blocks */
+	grow = b->size;
+	if (grow > (size_t)MEM_BLOCK_SIZE << MEM_BLOCK_SHIFT_MAX)
+		grow = (size_t)MEM_BLOCK_SIZE << MEM_BLOCK_SHIFT_MAX;
+
+	if (grow < min_size)
+		grow = min_size;
+
+	if (b->size > (size_t)-1 - grow)
+		return false;
+
+	new_size = b->size + grow;
+
+	if (mem->funcs.realloc_func(b, b->size, new_size, MEM_ALIGN,
+				    mem->funcs.opaque) != b)
+		return false;
+
+	b->size = new_size;
+	b->avail += grow;
+	c->total_avail += grow;
+
+	mem_account(mem, grow);
+
+	return true;
+}
+
+static void *
+mem_alloc(ptab_t *p, struct mem_block_cache *cache, size_t size, size_t align)
 {
 	assert(p != NULL);
 
@@ -237,46 +367,229 @@ void *ptab__mem_alloc(ptab_t *p, size_t size)
 	if (p->mem.disabled)
 		return NULL;
 
-	struct mem_block_cache *cache = &p->mem.cache;
 	struct mem_block *block;
 
-	/* find a block large enough to allocate size */
-	block = cache_find(cache, size);
-	if (!block) {
-		/* if none are large enough, then create a new one */
-		block = create_block(&p->mem, size);
-		if (!block)
-			return NULL;
+	/* fast path: bump allocate from the current block */
+	block = cache->current;
+	if (block_fits(block, size, align))
+		return block_alloc(cache, block, size, align);
 
-		/*
-		 * insert the new block into the list for consistency
-		 * with the other code path
-		 */
-		cache_insert(cache, block);
+	/*
+	 * otherwise, look for an older block with enough space left;
+	 * if one is found, it has more room than the current block
+	 * so they trade places
+	 */
+	block = bin_find(cache, size + align - 1);
+	if (block) {
+		bin_remove(cache, block);
+		bin_insert(cache, cache->current);
+		cache->current = block;
+
+		return block_alloc(cache, block, size, align);
 	}
 
+	/* the allocator may be able to extend the current block */
+	block = cache->current;
+	if (grow_block(&p->mem, cache, block, size + align - 1))
+		return block_alloc(cache, block, size, align);
+
+	/* if none are large enough, then create a new one */
+	block = create_block(p, cache, size + align - 1);
+	if (!block)
+		return NULL;
+
+	cache_insert(cache, block);
+
 	/* make the allocation */
 	void *retval;
-	retval = block_alloc(block, size);
+	retval = block_alloc(cache, block, size, align);
 	assert(retval != NULL);
 
 	/*
-	 * check if the block is in the right place:
-	 *  - it is smaller than prev
-	 *  - it is greater than next
+	 * keep whichever block has the most room left as the
+	 * current block and index the other one
 	 */
-	if (!block_valid(block)) {
-		/*
-		 * if it's not valid, remove it and add it again
-		 * so that it will be in the right place
-		 */
-		cache_remove(cache, block);
-		cache_insert(cache, block);
+	if (block->avail > cache->current->avail) {
+		bin_insert(cache, cache->current);
+		cache->current = block;
+	} else {
+		bin_insert(cache, block);
 	}
 
 	return retval;
 }
 
+void *ptab__mem_alloc(ptab_t *p, size_t size)
+{
+	return mem_alloc(p, &p->mem.cache, size, MEM_ALIGN);
+}
+
+void *ptab__mem_alloc_str(ptab_t *p, size_t size)
+{
+	return mem_alloc(p, &p->mem.cache, size, 1);
+}
+
+void *ptab__mem_cache_alloc(ptab_t *p, struct mem_block_cache *c, size_t size)
+{
+	return mem_alloc(p, c, size, MEM_ALIGN);
+}
+
+void *ptab__mem_cache_alloc_str(ptab_t *p, struct mem_block_cache *c, size_t size)
+{
+	return mem_alloc(p, c, size, 1);
+}
+
+int ptab__mem_reserve(ptab_t *p, struct mem_block_cache *cache, size_t size)
+{
+	assert(p != NULL);
+
+	/* check if memory allocations have been disabled */
+	if (p->mem.disabled)
+		return PTAB_EMEM;
+
+	struct mem_block *block;
+	size_t alloc_size;
+
+	if (cache->current->avail >= size)
+		return PTAB_OK;
+
+	/*
+	 * an existing block may already be big enough; since this
+	 * isn't a hot path, also check the blocks in the size class
+	 * below, one of which might be an earlier exact reservation
+	 */
+	block = bin_find(cache, size);
+	if (!block) {
+		block = cache->bins[floor_log2(size)];
+
+		while (block && block->avail < size)
+			block = block->bin_next;
+	}
+
+	if (block) {
+		bin_remove(cache, block);
+	} else {
+		if (size > (size_t)-1 - sizeof(struct mem_block))
+			return PTAB_ERANGE;
+
+		/* allocate a block with exactly the space needed */
+		alloc_size = size + sizeof(struct mem_block);
+
+		block = mem_get(&p->mem, alloc_size);
+		if (!block)
+			return PTAB_EMEM;
+
+		block->magic = MEM_MAGIC_ARENA;
+		block->owner = p;
+		block->buf = (unsigned char *)(block + 1);
+		block->size = alloc_size;
+		block->base = 0;
+		block->used = 0;
+		block->avail = size;
+
+		cache_insert(cache, block);
+	}
+
+	/* make it the current block so it is filled next */
+	bin_insert(cache, cache->current);
+	cache->current = block;
+
+	return PTAB_OK;
+}
+
+/*
+ * output blocks are handed out to the user, who gives them back with
+ * ptab_free_string. they are never in a bin, so the bin links keep a
+ * list of the ones the user still has, which is usually one or two
+ */
+static void output_insert(struct mem_block_cache *c, struct mem_block *b)
+{
+	b->bin_prev = NULL;
+	b->bin_next = c->output;
+
+	if (c->output)
+		c->output->bin_prev = b;
+
+	c->output = b;
+}
+
+static void output_remove(struct mem_block_cache *c, struct mem_block *b)
+{
+	if (b->bin_prev)
+		b->bin_prev->bin_next = b->bin_next;
+	else
+		c->output = b->bin_next;
+
+	if (b->bin_next)
+		b->bin_next->bin_prev = b->bin_prev;
+}
+
+/*
+ * find the output block whose buffer the user was given; only the
+ * pointers are compared, since a string that didn't come from this
+ * table (or was already released) has no header to look at
+ */
+static struct mem_block *output_block(const struct mem_block_cache *c, const void *buf)
+{
+	struct mem_block *block;
+
+	for (block = c->output; block; block = block->bin_next) {
+		if (block->buf == buf)
+			return block;
+	}
+
+	return NULL;
+}
+
+/* hold on to a released output block so that a later one can reuse it */
+static void spare_insert(struct mem_block_cache *c, struct mem_block *b)
+{
+	b->magic = MEM_MAGIC_SPARE;
+	b->prev = NULL;
+	b->next = c->spare;
+
+	if (c->spare)
+		c->spare->prev = b;
+
+	c->spare = b;
+}
+
+static void spare_remove(struct mem_block_cache *c, struct mem_block *b)
+{
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		c->spare = b->next;
+
+	if (b->next)
+		b->next->prev = b->prev;
+}
+
+/* find the smallest spare block with room for size bytes */
+static struct mem_block *spare_find(struct mem_block_cache *c, size_t size)
+{
+	struct mem_block *b, *best = NULL;
+
+	for (b = c->spare; b; b = b->next) {
+		if (b->size >= size && (!best || b->size < best->size))
+			best = b;
+	}
+
+	return best;
+}
+
+static void spare_release(struct mem_internal *mem)
+{
+	struct mem_block *b, *next;
+
+	for (b = mem->cache.spare; b; b = next) {
+		next = b->next;
+		mem_put(mem, b);
+	}
+
+	mem->cache.spare = NULL;
+}
+
 void *ptab__mem_alloc_block(ptab_t *p, size_t size)
 {
 	assert(p != NULL);
@@ -285,7 +598,6 @@ void *ptab__mem_alloc_block(ptab_t *p, size_t size)
 	if (p->mem.disabled)
 		return NULL;
 
-	const struct ptab_allocator *funcs = &p->mem.funcs;
 	struct mem_block_cache *cache = &p->mem.cache;
 	struct mem_block *block;
 	size_t alloc_size;
@@ -296,62 +608,378 @@ void *ptab__mem_alloc_block(ptab_t *p, size_t size)
 	 */
 	alloc_size = size + sizeof(struct mem_block);
 
-	/* allocate the block */
-	block = funcs->alloc_func(alloc_size, funcs->opaque);
-	if (!block)
-		return NULL;
+	block = spare_find(cache, alloc_size);
+
+	if (block) {
+		/* a spare block is big enough, so reuse it */
+		spare_remove(cache, block);
+	} else {
+		/*
+		 * tables only tend to grow, so the spare blocks that
+		 * are too small now probably always will be
+		 */
+		spare_release(&p->mem);
+
+		/* allocate the block */
+		block = mem_get(&p->mem, alloc_size);
+		if (!block)
+			return NULL;
+
+		block->size = alloc_size;
+	}
 
 	/* initialize the block structure */
+	block->magic = MEM_MAGIC_OUTPUT;
+	block->owner = p;
 	block->buf = (unsigned char *)(block + 1);
+	block->base = 0;
 	block->used = size;
-	block->avail = 0;
+	block->avail = block->size - alloc_size;
 
 	/*
-	 * insert the new block into the list for consistency
-	 * with the other code path
+	 * insert the new block into the list so that it gets cleaned
+	 * up with the table; it is never indexed for allocations
 	 */
 	cache_insert(cache, block);
+	output_insert(cache, block);
 
-	return block + 1;
+	return block->buf;
 }
 
 void ptab__mem_free_block(ptab_t *p, void *b)
 {
 	assert(p != NULL);
 
-	const struct ptab_allocator *funcs = &p->mem.funcs;
 	struct mem_block_cache *cache = &p->mem.cache;
-	struct mem_block *block = b;
-
-	/* FIXME */
-	block = block - 1;
+	struct mem_block *block;
 
 	/*
-	 * make sure that the block actually exists
-	 * in the cache before trying to remove it
+	 * make sure that the block is a live output block from this
+	 * table before trying to remove it
 	 */
-	if (!cache_exists(cache, block))
+	block = output_block(cache, b);
+	if (!block)
 		return;
 
-	/* remove the block from the cache */
+	/* remove the block from the cache and keep it for reuse */
+	output_remove(cache, block);
 	cache_remove(cache, block);
+	spare_insert(cache, block);
+}
 
-	/* free the block */
-	funcs->free_func(block, funcs->opaque);
+#ifdef PTAB_HAVE_MMAP
+static size_t page_size(void)
+{
+	long size = sysconf(_SC_PAGESIZE);
+
+	return size > 0 ? (size_t)size : 4096;
 }
 
-ptab_t *ptab__mem_init(const ptab_allocator_t *funcs_)
+/*
+ * map a block of at least size bytes; memory is only committed by
+ * the kernel when it is first touched
+ */
+static struct mem_block *map_block(size_t size, unsigned int flags)
 {
+	size_t page = page_size();
+	size_t align = page;
+	size_t len, map_len, head;
+	unsigned char *addr;
+
 	/*
-	 * set up allocator functions on the stack since
-	 * our internal object hasn't been created yet
+	 * huge pages can only back the aligned parts of the mapping,
+	 * so map extra and trim it down to an aligned range
 	 */
-	ptab_allocator_t funcs;
+	if ((flags & PTAB_MAP_HUGEPAGE) && MEM_HUGE_PAGE > page)
+		align = MEM_HUGE_PAGE;
+
+	if (size > (size_t)-1 - sizeof(struct mem_block) - 2 * align)
+		return NULL;
+
+	len = (size + sizeof(struct mem_block) + align - 1) & ~(align - 1);
+	map_len = len + align - page;
+
+	addr = mmap(NULL,
+		    map_len,
+		    PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS,
+		    -1,
+		    0);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	head = (size_t)(-(uintptr_t)addr & (align - 1));
+
+	if (head > 0)
+		munmap(addr, head);
+
+	if (map_len - head > len)
+		munmap(addr + head + len, map_len - head - len);
+
+	addr += head;
+
+#ifdef MADV_HUGEPAGE
+	if (flags & PTAB_MAP_HUGEPAGE)
+		madvise(addr, len, MADV_HUGEPAGE);
+#endif
+
+	struct mem_block *b = (struct mem_block *)addr;
 
-	if (!funcs_ || !funcs_->alloc_func || !funcs_->free_func)
-		funcs = (ptab_allocator_t){ default_alloc, default_free, NULL };
+	b->magic = MEM_MAGIC_MAPPED;
+	b->buf = (unsigned char *)(b + 1);
+	b->size = len;
+	b->base = 0;
+	b->used = 0;
+	b->avail = len - sizeof(struct mem_block);
+
+	return b;
+}
+
+/* give the pages past the block's base back to the kernel */
+static void map_release(struct mem_block *b)
+{
+	size_t page = page_size();
+	uintptr_t start, end;
+
+	start = (uintptr_t)(b->buf + b->base);
+	start = (start + page - 1) & ~(uintptr_t)(page - 1);
+	end = (uintptr_t)(b->buf + b->used);
+
+	if (end > start)
+		madvise((void *)start, (size_t)(end - start), MADV_DONTNEED);
+}
+#else
+static void map_release(struct mem_block *b)
+{
+	(void)b;
+}
+#endif
+
+int ptab_mem_map(ptab_t *p, size_t size, unsigned int flags)
+{
+	if (!p)
+		return PTAB_ENULL;
+
+	if (size == 0)
+		return PTAB_ERANGE;
+
+	/* only one mapped arena per table */
+	if (p->mem.map)
+		return PTAB_EORDER;
+
+#ifdef PTAB_HAVE_MMAP
+	struct mem_block_cache *cache = &p->mem.cache;
+	struct mem_block *block;
+
+	/* check if memory allocations have been disabled */
+	if (p->mem.disabled)
+		return PTAB_EMEM;
+
+	block = map_block(size, flags);
+	if (!block)
+		return PTAB_EMEM;
+
+	block->owner = p;
+
+	mem_account(&p->mem, block->size);
+
+	p->mem.map = block;
+	p->mem.map_flags = flags;
+
+	/* everything from here on is allocated from the mapping */
+	cache_insert(cache, block);
+	bin_insert(cache, cache->current);
+	cache->current = block;
+
+	return PTAB_OK;
+#else
+	(void)flags;
+	return PTAB_ESUPPORT;
+#endif
+}
+
+/*
+ * record how much of each block is in use so that a later rewind
+ * keeps everything allocated up to this point (i.e. the columns)
+ */
+void ptab__mem_mark(ptab_t *p)
+{
+	assert(p != NULL);
+
+	struct mem_block *b;
+
+	for (b = p->mem.cache.head; b; b = b->next)
+		b->base = b->used;
+
+	p->mem.marked = true;
+}
+
+/*
+ * throw away everything allocated since the mark (or everything,
+ * if clear is set) while keeping the blocks for reuse; output
+ * blocks are released since the table they came from is gone,
+ * unless keep_output is set because the table is still live
+ */
+static void cache_rewind(struct mem_internal *mem,
+			 struct mem_block_cache *c,
+			 bool clear,
+			 bool keep_output)
+{
+	struct mem_block *b, *next;
+
+	for (b = c->head; b && !keep_output; b = next) {
+		next = b->next;
+
+		if (b->magic == MEM_MAGIC_OUTPUT) {
+			output_remove(c, b);
+			cache_remove(c, b);
+			spare_insert(c, b);
+		}
+	}
+
+	memset(c->bins, 0, sizeof(c->bins));
+	c->total_used = 0;
+	c->total_avail = 0;
+
+	for (b = c->head; b; b = b->next) {
+		if (b->magic != MEM_MAGIC_OUTPUT) {
+			if (clear)
+				b->base = 0;
+
+			if (b == mem->map && (mem->map_flags & PTAB_MAP_RELEASE))
+				map_release(b);
+
+			b->avail += b->used - b->base;
+			b->used = b->base;
+		}
+
+		c->total_used += b->used;
+		c->total_avail += b->avail;
+	}
+
+	/*
+	 * start over from the mapped block if there is one, otherwise
+	 * the root block; the bins hand out the smallest block that
+	 * fits, so the rest of the blocks get reused in roughly the
+	 * order that they were created
+	 */
+	if (c == &mem->cache && mem->map)
+		c->current = mem->map;
 	else
+		c->current = c->root;
+
+	for (b = c->head; b; b = b->next) {
+		if (b != c->current && b->magic != MEM_MAGIC_OUTPUT)
+			bin_insert(c, b);
+	}
+}
+
+/*
+ * drop the rows allocated since the mark, but leave any output the
+ * user is still holding alone
+ */
+void ptab__mem_rewind(ptab_t *p)
+{
+	assert(p != NULL);
+	assert(p->mem.marked);
+
+	cache_rewind(&p->mem, &p->mem.cache, false, true);
+	p->mem.marked = false;
+}
+
+/*
+ * a shard's arena only ever holds rows, with the shard itself in
+ * front of the root block, so it has no mark to go back to
+ */
+struct ptab_shard *ptab__mem_shard_create(ptab_t *p)
+{
+	struct ptab_shard *shard;
+	struct mem_block *block;
+	size_t size = MEM_BLOCK_SIZE;
+
+	assert(sizeof(struct ptab_shard) + sizeof(struct mem_block) < size);
+
+	if (p->mem.disabled)
+		return NULL;
+
+	shard = mem_get(&p->mem, size);
+	if (!shard)
+		return NULL;
+
+	memset(shard, 0, sizeof(struct ptab_shard));
+
+	block = (struct mem_block *)(shard + 1);
+	block->magic = MEM_MAGIC_ARENA;
+	block->owner = p;
+	block->buf = (unsigned char *)(block + 1);
+	block->size = size;
+	block->base = 0;
+	block->used = 0;
+	block->avail = size - sizeof(struct ptab_shard) - sizeof(struct mem_block);
+
+	cache_insert(&shard->cache, block);
+	shard->cache.root = block;
+	shard->cache.current = block;
+
+	return shard;
+}
+
+void ptab__mem_shard_rewind(ptab_t *p, struct ptab_shard *s)
+{
+	assert(p != NULL);
+	assert(s != NULL);
+
+	cache_rewind(&p->mem, &s->cache, true, true);
+}
+
+void ptab__mem_shard_free(ptab_t *p, struct ptab_shard *s)
+{
+	struct mem_block *b, *next;
+	size_t size;
+
+	assert(p != NULL);
+	assert(s != NULL);
+
+	for (b = s->cache.head; b; b = next) {
+		next = b->next;
+		if (b != s->cache.root)
+			mem_put(&p->mem, b);
+	}
+
+	/* the root block's allocation starts at the shard */
+	size = s->cache.root->size;
+	__atomic_sub_fetch(&p->mem.reserved, size, __ATOMIC_RELAXED);
+
+	p->mem.funcs.free_func(s, size, MEM_ALIGN, p->mem.funcs.opaque);
+}
+
+ptab_t *ptab__mem_init(const ptab_allocator2_t *funcs_,
+		       const ptab_allocator_t *legacy)
+{
+	/*
+	 * set up allocator functions on the stack since
+	 * our internal object hasn't been created yet
+	 */
+	ptab_allocator2_t funcs;
+
+	if (legacy)
+		funcs = (ptab_allocator2_t){
+			PTAB_ALLOCATOR_VERSION,
+			legacy_alloc,
+			legacy_free,
+			NULL,
+			(void *)legacy
+		};
+	else if (funcs_)
 		funcs = *funcs_;
+	else
+		funcs = (ptab_allocator2_t){
+			PTAB_ALLOCATOR_VERSION,
+			default_alloc,
+			default_free,
+			NULL,
+			NULL
+		};
 
 	/*
 	 * calculate initial allocation size and allocate
@@ -363,7 +991,7 @@ ptab_t *ptab__mem_init(const ptab_allocator_t *funcs_)
 	size = MEM_BLOCK_SIZE;
 	assert(sizeof(ptab_t) < size);
 
-	p = funcs.alloc_func(size, funcs.opaque);
+	p = funcs.alloc_func(size, MEM_ALIGN, funcs.opaque);
 	if (!p)
 		return NULL;
 
@@ -377,16 +1005,36 @@ ptab_t *ptab__mem_init(const ptab_allocator_t *funcs_)
 	 */
 	struct mem_block *block;
 	block = (struct mem_block *)(p + 1);
+	block->magic = MEM_MAGIC_ARENA;
+	block->owner = p;
 	block->buf = (unsigned char *)(block + 1);
+	block->size = size;
+	block->base = 0;
 	block->used = 0;
 	block->avail = size - sizeof(ptab_t) - sizeof(struct mem_block);
 
 	cache_insert(&p->mem.cache, block);
 	p->mem.cache.root = block;
+	p->mem.cache.current = block;
+
+	/* rows go in the table's own arena unless it is concurrent */
+	p->cursor.rows = &p->rows;
+	p->cursor.num_rows = &p->num_rows;
+	p->cursor.cache = &p->mem.cache;
 
-	/* set the allocators in the structure */
+	/*
+	 * set the allocators in the structure; a legacy allocator is
+	 * copied in so that the caller's structure can go away
+	 */
 	p->mem.funcs = funcs;
 
+	if (legacy) {
+		p->mem.legacy = *legacy;
+		p->mem.funcs.opaque = &p->mem.legacy;
+	}
+	p->mem.reserved = size;
+	p->mem.peak = size;
+
 	return p;
 }
 
@@ -405,13 +1053,16 @@ void ptab__mem_free(ptab_t *p)
 	while (b) {
 		next = b->next;
 		if (b != p->mem.cache.root)
-			p->mem.funcs.free_func(b, p->mem.funcs.opaque);
+			mem_put(&p->mem, b);
 
 		b = next;
 	}
 
+	spare_release(&p->mem);
+
 	/* finally, free the root node */
-	p->mem.funcs.free_func(p, p->mem.funcs.opaque);
+	p->mem.funcs.free_func(p, p->mem.cache.root->size, MEM_ALIGN,
+			       p->mem.funcs.opaque);
 }
 
 void ptab__mem_enable(ptab_t *p)
@@ -437,31 +1088,175 @@ ptab_t *ptab_init(const ptab_allocator_t *a)
 	if (a && (!a->alloc_func || !a->free_func))
 		return NULL;
 
-	p = ptab__mem_init(a);
+	p = ptab__mem_init(NULL, a);
 
 	return p;
 }
 
+ptab_t *ptab_init2(const ptab_allocator2_t *a)
+{
+	/*
+	 * only the one version exists so far; later ones will be
+	 * accepted here as the structure grows
+	 */
+	if (!a || a->version != PTAB_ALLOCATOR_VERSION)
+		return NULL;
+
+	if (!a->alloc_func || !a->free_func)
+		return NULL;
+
+	return ptab__mem_init(a, NULL);
+}
+
 int ptab_free(ptab_t *p)
 {
 	if (!p)
 		return PTAB_ENULL;
 
+	ptab__spill_close(p);
+	ptab__shard_free(p);
 	ptab__mem_free(p);
 
 	return PTAB_OK;
 }
 
+int ptab_reset(ptab_t *p)
+{
+	struct ptab_col *col;
+
+	if (!p)
+		return PTAB_ENULL;
+
+	/*
+	 * the mark is taken when the first row begins, so if it
+	 * hasn't been taken yet there are no rows to get rid of and
+	 * everything allocated so far belongs to the columns
+	 */
+	if (!p->mem.marked)
+		ptab__mem_mark(p);
+
+	cache_rewind(&p->mem, &p->mem.cache, false, false);
+	p->mem.marked = false;
+	ptab__spill_discard(p);
+	ptab__shard_reset(p);
+	ptab__load_reset(p);
+	ptab__dict_reset(p);
+
+	/* the columns stay, but their widths start over */
+	for (col = p->columns_head; col; col = col->next)
+		col->width = col->name_len;
+
+	/*
+	 * the chunks start small again, so that the rows are laid out
+	 * the same way every time and fit in the memory they had
+	 */
+	p->num_rows = 0;
+	p->rows.head = NULL;
+	p->rows.tail = NULL;
+	p->rows.capacity = 0;
+	p->rows.row_bytes = 0;
+	p->cursor.chunk = NULL;
+	p->cursor.column = NULL;
+
+	return PTAB_OK;
+}
+
+int ptab_clear(ptab_t *p)
+{
+	if (!p)
+		return PTAB_ENULL;
+
+	cache_rewind(&p->mem, &p->mem.cache, true, false);
+	p->mem.marked = false;
+	ptab__spill_discard(p);
+	ptab__shard_reset(p);
+	ptab__load_reset(p);
+
+	p->num_columns = 0;
+	p->num_values = 0;
+	p->num_rows = 0;
+	p->columns_head = NULL;
+	p->columns_tail = NULL;
+	p->rows.head = NULL;
+	p->rows.tail = NULL;
+	p->rows.capacity = 0;
+	p->rows.row_bytes = 0;
+	p->cursor.chunk = NULL;
+	p->cursor.column = NULL;
+
+	return PTAB_OK;
+}
+
+/* add up the blocks in one arena */
+static void cache_stats(const struct mem_block_cache *c, ptab_mem_stats_t *stats)
+{
+	const struct mem_block *b;
+
+	stats->used += c->total_used;
+	stats->blocks += c->num_blocks;
+
+	/*
+	 * space left in any block other than the current one is only
+	 * good for allocations that happen to fit in it, so count it
+	 * as waste
+	 */
+	for (b = c->head; b; b = b->next) {
+		if (b != c->current)
+			stats->wasted += b->avail;
+
+		if (b->size > stats->largest_block)
+			stats->largest_block = b->size;
+	}
+
+	for (b = c->spare; b; b = b->next) {
+		stats->blocks++;
+		stats->wasted += b->size - sizeof(struct mem_block);
+
+		if (b->size > stats->largest_block)
+			stats->largest_block = b->size;
+	}
+}
+
+int ptab_mem_stats(const ptab_t *p, ptab_mem_stats_t *stats)
+{
+	const struct ptab_shard *shard;
+
+	if (!p || !stats)
+		return PTAB_ENULL;
+
+	stats->used = 0;
+	stats->reserved = p->mem.reserved;
+	stats->wasted = 0;
+	stats->blocks = 0;
+	stats->largest_block = 0;
+	stats->peak = p->mem.peak;
+
+	cache_stats(&p->mem.cache, stats);
+
+	for (shard = p->shards.head; shard; shard = shard->next)
+		cache_stats(&shard->cache, stats);
+
+	return PTAB_OK;
+}
+
 int ptab_free_string(ptab_t *p, ptab_string_t *s)
 {
-	if (!p || !s || !s->str)
+	if (!p || !s)
 		return PTAB_ENULL;
 
+	/* a string that was already released has nothing left to free */
+	if (!s->str)
+		return PTAB_OK;
+
 	/* get a non-const pointer to the block */
 	void *block = (void *)s->str;
 
 	/* free the block */
 	ptab__mem_free_block(p, block);
 
+	/* so that releasing the same string again does nothing */
+	s->str = NULL;
+	s->len = 0;
+
 	return PTAB_OK;
 }
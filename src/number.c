@@ -0,0 +1,542 @@
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ptab.h>
+#include "internal.h"
+#include "pow5.h"
+
+/*
+ * numbers are turned into text here without printf. integers are
+ * written back to front, two digits at a time from a table, once their
+ * length is known from the number of bits they take, and decimals are
+ * integers with a point put in at their scale. doubles are
+ * written in the fewest digits that read back as the same double, as
+ * found by Ryu (Ulf Adams, "Ryu: Fast Float-to-String Conversion",
+ * PLDI 2018), or to a fixed number of places when the scaled value is
+ * small enough to be rounded exactly
+ */
+
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const uint64_t powers_of_10[] = {
+	UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+	UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+	UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+	UINT64_C(10000000000), UINT64_C(100000000000),
+	UINT64_C(1000000000000), UINT64_C(10000000000000),
+	UINT64_C(100000000000000), UINT64_C(1000000000000000),
+	UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+	UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+unsigned int ptab__num_len(uint64_t u)
+{
+	unsigned int bits, n;
+
+#if defined(__GNUC__)
+	bits = 64 - (unsigned int)__builtin_clzll(u | 1);
+#else
+	for (bits = 1; bits < 64 && (u >> bits); bits++)
+		;
+#endif
+
+	/*
+	 * 1233 / 4096 is just over log10(2), so n is one digit short or
+	 * right; u | 1 counts zero as a digit, and no power of ten past
+	 * one is odd
+	 */
+	n = (bits * 1233) >> 12;
+
+	return n + ((u | 1) >= powers_of_10[n]);
+}
+
+void ptab__num_put(char *end, uint64_t u)
+{
+	uint64_t d;
+
+	while (u >= 100) {
+		d = u % 100;
+		u /= 100;
+		end -= 2;
+		memcpy(end, digit_pairs + d * 2, 2);
+	}
+
+	if (u >= 10)
+		memcpy(end - 2, digit_pairs + u * 2, 2);
+	else
+		end[-1] = (char)('0' + u);
+}
+
+void ptab__num_put_grouped(char *end, uint64_t u)
+{
+	unsigned int n = 0;
+
+	do {
+		if (n++ == 3) {
+			*--end = ',';
+			n = 1;
+		}
+
+		*--end = (char)('0' + u % 10);
+		u /= 10;
+	} while (u);
+}
+
+unsigned int ptab__num_decimal_len(uint64_t u, unsigned int places)
+{
+	assert(places <= PTAB_DECIMAL_MAX_SCALE);
+
+	if (places == 0)
+		return ptab__num_len(u);
+
+	return ptab__num_len(u / powers_of_10[places]) + 1 + places;
+}
+
+/*
+ * write u / 10^places with exactly places digits after the point, and
+ * at least one before it
+ */
+void ptab__num_put_decimal(char *end, uint64_t u, unsigned int places)
+{
+	uint64_t frac;
+	unsigned int n;
+
+	assert(places <= PTAB_DECIMAL_MAX_SCALE);
+
+	if (places == 0) {
+		ptab__num_put(end, u);
+		return;
+	}
+
+	frac = u % powers_of_10[places];
+	u /= powers_of_10[places];
+
+	for (n = places; n >= 2; n -= 2) {
+		end -= 2;
+		memcpy(end, digit_pairs + frac % 100 * 2, 2);
+		frac /= 100;
+	}
+
+	if (n)
+		*--end = (char)('0' + frac);
+
+	*--end = '.';
+
+	ptab__num_put(end, u);
+}
+
+/* Ryu, for doubles */
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXPONENT_MAX 0x7ff
+#define DOUBLE_BIAS 1023
+#define POW5_INV_BITCOUNT 125
+#define POW5_BITCOUNT 125
+
+/* the number of bits in 5^e */
+static int32_t pow5_bits(int32_t e)
+{
+	return ((e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) and floor(log10(5^e)) */
+static uint32_t log10_pow2(int32_t e)
+{
+	return (uint32_t)((e * 78913) >> 18);
+}
+
+static uint32_t log10_pow5(int32_t e)
+{
+	return (uint32_t)((e * 732923) >> 20);
+}
+
+static bool multiple_of_pow5(uint64_t v, uint32_t p)
+{
+	uint32_t n = 0;
+
+	assert(v != 0);
+
+	while (v % 5 == 0) {
+		v /= 5;
+		n++;
+	}
+
+	return n >= p;
+}
+
+static bool multiple_of_pow2(uint64_t v, uint32_t p)
+{
+	return (v & ((UINT64_C(1) << p) - 1)) == 0;
+}
+
+/* a * b, with the high 64 bits returned through hi */
+static uint64_t mul_128(uint64_t a, uint64_t b, uint64_t *hi)
+{
+	uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+	uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+	uint64_t b00 = a_lo * b_lo;
+	uint64_t b01 = a_lo * b_hi;
+	uint64_t b10 = a_hi * b_lo;
+	uint64_t b11 = a_hi * b_hi;
+	uint64_t mid1 = b10 + (b00 >> 32);
+	uint64_t mid2 = b01 + (uint32_t)mid1;
+
+	*hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+
+	return (mid2 << 32) | (uint32_t)b00;
+}
+
+/* (m * mul) >> j, where mul is 128 bits and 64 < j < 128 */
+static uint64_t mul_shift(uint64_t m, const uint64_t *mul, int32_t j)
+{
+	uint64_t high0, high1, low1, sum;
+	unsigned int dist = (unsigned int)(j - 64);
+
+	assert(dist > 0 && dist < 64);
+
+	mul_128(m, mul[0], &high0);
+	low1 = mul_128(m, mul[1], &high1);
+
+	sum = high0 + low1;
+	if (sum < high0)
+		high1++;
+
+	return (high1 << (64 - dist)) | (sum >> dist);
+}
+
+/*
+ * scale the double and the halfway points to its neighbours, 4 * m2 and
+ * 4 * m2 +- 2 (less on the low side at a power of two), the same way
+ */
+static uint64_t mul_shift_all(uint64_t m2, const uint64_t *mul, int32_t j,
+			      uint64_t *vp, uint64_t *vm, uint32_t mm_shift)
+{
+	*vp = mul_shift(4 * m2 + 2, mul, j);
+	*vm = mul_shift(4 * m2 - 1 - mm_shift, mul, j);
+
+	return mul_shift(4 * m2, mul, j);
+}
+
+/*
+ * the shortest decimal that rounds to the (finite, non-zero) double
+ * with the given fields; it is the returned digits times 10^*exp10
+ */
+static uint64_t shortest(uint64_t mantissa, uint32_t exponent, int32_t *exp10)
+{
+	uint64_t m2, mv, vr, vp, vm, div_vp, div_vm, div_vr;
+	bool accept_bounds, vm_zeros = false, vr_zeros = false, round_up = false;
+	uint32_t mm_shift, q, last = 0;
+	int32_t e2, e10, i, j, k, removed = 0;
+
+	if (exponent == 0) {
+		e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = mantissa;
+	} else {
+		e2 = (int32_t)exponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = (UINT64_C(1) << DOUBLE_MANTISSA_BITS) | mantissa;
+	}
+
+	/* ties go to the even mantissa, so its bounds are in its interval */
+	accept_bounds = (m2 & 1) == 0;
+
+	mv = 4 * m2;
+	mm_shift = mantissa != 0 || exponent <= 1;
+
+	if (e2 >= 0) {
+		q = log10_pow2(e2) - (e2 > 3);
+		e10 = (int32_t)q;
+		k = POW5_INV_BITCOUNT + pow5_bits((int32_t)q) - 1;
+		i = -e2 + (int32_t)q + k;
+
+		vr = mul_shift_all(m2, pow5_inv_split[q], i, &vp, &vm, mm_shift);
+
+		/* only small powers of five can divide the bounds exactly */
+		if (q <= 21) {
+			if (mv % 5 == 0)
+				vr_zeros = multiple_of_pow5(mv, q);
+			else if (accept_bounds)
+				vm_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+			else
+				vp -= multiple_of_pow5(mv + 2, q);
+		}
+	} else {
+		q = log10_pow5(-e2) - (-e2 > 1);
+		e10 = (int32_t)q + e2;
+		i = -e2 - (int32_t)q;
+		k = pow5_bits(i) - POW5_BITCOUNT;
+		j = (int32_t)q - k;
+
+		vr = mul_shift_all(m2, pow5_split[i], j, &vp, &vm, mm_shift);
+
+		if (q <= 1) {
+			vr_zeros = true;
+
+			if (accept_bounds)
+				vm_zeros = mm_shift == 1;
+			else
+				vp--;
+		} else if (q < 63) {
+			vr_zeros = multiple_of_pow2(mv, q);
+		}
+	}
+
+	/* drop digits while the bounds still differ in what's left */
+	if (vm_zeros || vr_zeros) {
+		while ((div_vp = vp / 10) > (div_vm = vm / 10)) {
+			div_vr = vr / 10;
+			vm_zeros &= vm - div_vm * 10 == 0;
+			vr_zeros &= last == 0;
+			last = (uint32_t)(vr - div_vr * 10);
+			vr = div_vr;
+			vp = div_vp;
+			vm = div_vm;
+			removed++;
+		}
+
+		if (vm_zeros) {
+			while (vm % 10 == 0) {
+				div_vr = vr / 10;
+				vr_zeros &= last == 0;
+				last = (uint32_t)(vr - div_vr * 10);
+				vr = div_vr;
+				vp /= 10;
+				vm /= 10;
+				removed++;
+			}
+		}
+
+		/* exactly halfway rounds to even */
+		if (vr_zeros && last == 5 && vr % 2 == 0)
+			last = 4;
+
+		vr += (vr == vm && (!accept_bounds || !vm_zeros)) || last >= 5;
+	} else {
+		while ((div_vp = vp / 10) > (div_vm = vm / 10)) {
+			div_vr = vr / 10;
+			round_up = vr - div_vr * 10 >= 5;
+			vr = div_vr;
+			vp = div_vp;
+			vm = div_vm;
+			removed++;
+		}
+
+		vr += vr == vm || round_up;
+	}
+
+	*exp10 = e10 + removed;
+
+	return vr;
+}
+
+/* write e+XX or e-XX, with at least two digits */
+static char *put_exponent(char *s, int32_t x)
+{
+	uint32_t ax = x < 0 ? (uint32_t)-x : (uint32_t)x;
+	unsigned int n = ax < 10 ? 2 : ptab__num_len(ax);
+
+	*s++ = 'e';
+	*s++ = x < 0 ? '-' : '+';
+
+	s[0] = '0';
+	ptab__num_put(s + n, ax);
+
+	return s + n;
+}
+
+size_t ptab__num_shortest(double v, char *buf)
+{
+	uint64_t bits, mantissa, digits;
+	uint32_t exponent;
+	int32_t exp10, x;
+	unsigned int n;
+	char *s = buf;
+
+	memcpy(&bits, &v, sizeof(bits));
+	mantissa = bits & ((UINT64_C(1) << DOUBLE_MANTISSA_BITS) - 1);
+	exponent = (uint32_t)(bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_EXPONENT_MAX;
+
+	if (exponent == DOUBLE_EXPONENT_MAX && mantissa) {
+		memcpy(s, "nan", 3);
+		return 3;
+	}
+
+	if (bits >> 63)
+		*s++ = '-';
+
+	if (exponent == DOUBLE_EXPONENT_MAX) {
+		memcpy(s, "inf", 3);
+		return (size_t)(s - buf) + 3;
+	}
+
+	if (exponent == 0 && mantissa == 0) {
+		*s++ = '0';
+		return (size_t)(s - buf);
+	}
+
+	digits = shortest(mantissa, exponent, &exp10);
+	n = ptab__num_len(digits);
+
+	/* the power of ten of the first digit */
+	x = exp10 + (int32_t)n - 1;
+
+	if (x < -4 || x >= 16) {
+		/* d.ddde+XX, with the digits written one place over first */
+		ptab__num_put(s + 1 + n, digits);
+		s[0] = s[1];
+
+		if (n > 1) {
+			s[1] = '.';
+			s += n + 1;
+		} else {
+			s++;
+		}
+
+		s = put_exponent(s, x);
+	} else if (exp10 >= 0) {
+		ptab__num_put(s + n, digits);
+		memset(s + n, '0', (size_t)exp10);
+		s += n + (unsigned int)exp10;
+	} else if (x >= 0) {
+		ptab__num_put(s + 1 + n, digits);
+		memmove(s, s + 1, (size_t)x + 1);
+		s[x + 1] = '.';
+		s += n + 1;
+	} else {
+		s[0] = '0';
+		s[1] = '.';
+		memset(s + 2, '0', (size_t)(-x - 1));
+		s += 2 + (-x - 1);
+		ptab__num_put(s + n, digits);
+		s += n;
+	}
+
+	return (size_t)(s - buf);
+}
+
+/* fixed places */
+
+static const double scales[NUM_FIXED_MAX + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15
+};
+
+/*
+ * the rounding error of p = a * b, so that a * b = p + error exactly
+ * (Dekker's product, which needs each product rounded on its own)
+ */
+static double product_error(double a, double b, double p)
+{
+	const double split = 134217729.0; /* 2^27 + 1 */
+	double c, a_hi, a_lo, b_hi, b_lo;
+
+	c = split * a;
+	a_hi = c - (c - a);
+	a_lo = a - a_hi;
+
+	c = split * b;
+	b_hi = c - (c - b);
+	b_lo = b - b_hi;
+
+	return ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+}
+
+/* whether a double has its sign bit set, which a -0.0 does too */
+static bool sign_bit(double v)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &v, sizeof(bits));
+
+	return (bits >> 63) != 0;
+}
+
+/*
+ * the magnitude of a double rounded to places, as an integer in units of
+ * 10^-places; false if it is too big to round here
+ */
+static bool fixed_round(double v, unsigned int places, uint64_t *rounded)
+{
+	double a, scaled, error, whole, half;
+	uint64_t r;
+
+	assert(places <= NUM_FIXED_MAX);
+
+	a = sign_bit(v) ? -v : v;
+	scaled = a * scales[places];
+
+	/*
+	 * below 2^52 every integer and half is a double, so the scaled
+	 * value's distance from the half it might round at is exact, and
+	 * only the product's error can tip a tie. anything else (including
+	 * infinities and NaNs) is left to printf
+	 */
+	if (!(scaled < 4503599627370496.0))
+		return false;
+
+	error = product_error(a, scales[places], scaled);
+	r = (uint64_t)scaled;
+	whole = (double)r;
+	half = (scaled - whole) - 0.5;
+
+	/* exact ties round to even, the same as printf */
+	if (half > 0 || (half == 0 && (error > 0 || (error == 0 && (r & 1)))))
+		r++;
+
+	*rounded = r;
+
+	return true;
+}
+
+/* the length ptab__num_fixed gives, without writing it */
+size_t ptab__num_fixed_len(double v, unsigned int places)
+{
+	uint64_t r;
+
+	if (!fixed_round(v, places, &r))
+		return 0;
+
+	return (sign_bit(v) ? 1 : 0) + ptab__num_len(r / powers_of_10[places]) +
+	       (places > 0 ? places + 1 : 0);
+}
+
+size_t ptab__num_fixed(double v, unsigned int places, char *buf)
+{
+	uint64_t r, ipart, fpart;
+	unsigned int n;
+	char *s = buf;
+
+	if (!fixed_round(v, places, &r))
+		return 0;
+
+	if (sign_bit(v))
+		*s++ = '-';
+
+	ipart = r / powers_of_10[places];
+	fpart = r - ipart * powers_of_10[places];
+
+	n = ptab__num_len(ipart);
+	ptab__num_put(s + n, ipart);
+	s += n;
+
+	if (places > 0) {
+		*s++ = '.';
+		memset(s, '0', places);
+		ptab__num_put(s + places, fpart);
+		s += places;
+	}
+
+	return (size_t)(s - buf);
+}
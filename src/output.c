@@ -30,8 +30,13 @@ struct strbuf {
 	size_t size;
 	size_t used;
 	size_t avail;
+	size_t line;
+	FILE *f;
 };
 
+/* ptab_dumpf writes through a buffer of about this size */
+#define DUMP_BUF_SIZE (64 * 1024)
+
 /*
  * Format descriptors
  */
@@ -74,6 +79,26 @@ static void strbuf_init(struct strbuf *sb, char *buf, size_t size)
 	sb->size = size;
 	sb->used = 0;
 	sb->avail = size;
+	sb->line = 0;
+	sb->f = NULL;
+}
+
+/*
+ * a strbuf with a file behind it only holds part of the table, and
+ * is written out whenever the next line might not fit
+ */
+static void strbuf_flush(struct strbuf *sb)
+{
+	fwrite(sb->buf, 1, sb->used, sb->f);
+
+	sb->used = 0;
+	sb->avail = sb->size;
+}
+
+static void strbuf_newline(struct strbuf *sb)
+{
+	if (sb->f && sb->avail < sb->line)
+		strbuf_flush(sb);
 }
 
 static int strbuf_putc(struct strbuf *sb, char c)
@@ -98,6 +123,22 @@ static int strbuf_puts(struct strbuf *sb, const char *str, size_t len)
 	return 0;
 }
 
+/*
+ * format a lazy cell's value straight into the buffer; the rest of
+ * the line always follows the cell, so there is room for the NUL
+ */
+static int strbuf_putv(struct strbuf *sb, struct ptab_col *col,
+		       union ptab_cell_value v, size_t len)
+{
+	assert(len < sb->avail);
+
+	ptab__format_cell(col, v, sb->buf + sb->used, len + 1);
+	sb->used += len;
+	sb->avail -= len;
+
+	return 0;
+}
+
 static int strbuf_putu(struct strbuf *sb, const utf8_char_t *c)
 {
 	assert(c->len <= sb->avail);
@@ -224,22 +265,29 @@ static void write_row_divider(const ptab_t *p,
 
 static void write_row_data(const ptab_t *p,
 			   const struct format_desc *desc,
-			   const struct ptab_row *row,
+			   const struct ptab_chunk *chunk,
+			   unsigned int row,
 			   struct strbuf *sb)
 {
-	const struct ptab_col *col = p->columns_head;
+	struct ptab_col *col = p->columns_head;
+	const struct ptab_cell *cell;
 	size_t padding;
 
 	strbuf_putu(sb, &desc->vert_div);
 	strbuf_putc(sb, ' ');
 
 	while (col) {
-		padding = col->width - row->lengths[col->id];
+		cell = &chunk->cells[chunk_cell(chunk, col->id, row)];
+		padding = col->width - cell->len;
 
 		if (col->align == PTAB_RIGHT)
 			strbuf_repeatc(sb, ' ', padding);
 
-		strbuf_puts(sb, row->strings[col->id], row->lengths[col->id]);
+		if (cell_flags(chunk, cell) & CELL_LAZY)
+			strbuf_putv(sb, col, chunk->values[chunk_cell(chunk, col->value_id, row)],
+				    cell->len);
+		else
+			strbuf_puts(sb, cell_str(col, chunk, cell), cell->len);
 
 		if (col->align == PTAB_LEFT)
 			strbuf_repeatc(sb, ' ', padding);
@@ -284,21 +332,60 @@ static void write_row_bottom(const ptab_t *p,
 	strbuf_putc(sb, '\n');
 }
 
-static int
-write_table(const ptab_t *p, const struct format_desc *desc, struct strbuf *sb)
+static int write_spilled_rows(const ptab_t *p,
+			      const struct format_desc *desc,
+			      struct ptab_chunk *scratch,
+			      struct strbuf *sb)
 {
-	const struct ptab_row *row;
+	unsigned int i;
+	int err, end_err;
+
+	err = ptab__spill_read_begin(p);
 
+	for (i = 0; err == PTAB_OK && i < p->spill.num_rows; i++) {
+		err = ptab__spill_read_row(p, scratch);
+		if (err == PTAB_OK) {
+			strbuf_newline(sb);
+			write_row_data(p, desc, scratch, 0, sb);
+		}
+	}
+
+	end_err = ptab__spill_read_end(p);
+
+	return err != PTAB_OK ? err : end_err;
+}
+
+static int write_table(const ptab_t *p,
+		       const struct format_desc *desc,
+		       struct ptab_chunk *scratch,
+		       struct strbuf *sb)
+{
+	const struct ptab_chunk *chunk;
+	unsigned int row;
+	int err;
+
+	strbuf_newline(sb);
 	write_row_top(p, desc, sb);
+	strbuf_newline(sb);
 	write_row_heading(p, desc, sb);
+	strbuf_newline(sb);
 	write_row_divider(p, desc, sb);
 
-	row = p->rows_head;
-	while (row) {
-		write_row_data(p, desc, row, sb);
-		row = row->next;
+	/* rows that were spilled to disk come first */
+	if (scratch) {
+		err = write_spilled_rows(p, desc, scratch, sb);
+		if (err != PTAB_OK)
+			return err;
+	}
+
+	for (chunk = p->rows.head; chunk; chunk = chunk->next) {
+		for (row = 0; row < chunk->num_rows; row++) {
+			strbuf_newline(sb);
+			write_row_data(p, desc, chunk, row, sb);
+		}
 	}
 
+	strbuf_newline(sb);
 	write_row_bottom(p, desc, sb);
 
 	return PTAB_OK;
@@ -385,7 +472,8 @@ static size_t calculate_row(const struct format_desc *desc,
 }
 
 static size_t calculate_table_size(const ptab_t *p,
-				   const struct format_desc *desc)
+				   const struct format_desc *desc,
+				   size_t *line)
 {
 	unsigned int num_columns = p->num_columns;
 	unsigned int num_rows = p->num_rows;
@@ -400,9 +488,53 @@ static size_t calculate_table_size(const ptab_t *p,
 
 	total = top + div + (row * (num_rows + 1)) + bot;
 
+	/* the longest line, for writing the table a piece at a time */
+	*line = top;
+	if (div > *line)
+		*line = div;
+	if (bot > *line)
+		*line = bot;
+	if (row > *line)
+		*line = row;
+
 	return total;
 }
 
+/*
+ * spilled rows are read back into a scratch chunk with room for a
+ * single row, laid out like this:
+ * [ chunk ][ cells ][ flags ][ heap ]
+ */
+static struct ptab_chunk *alloc_scratch_chunk(ptab_t *p)
+{
+	struct ptab_chunk *chunk;
+	size_t size, heap;
+
+	heap = calculate_variable_widths(p);
+	if (heap > CELL_MAX)
+		return NULL;
+
+	size = sizeof(struct ptab_chunk) +
+	       p->num_columns * (sizeof(struct ptab_cell) + sizeof(uint8_t)) + heap;
+
+	chunk = ptab__mem_alloc_block(p, size);
+	if (!chunk)
+		return NULL;
+
+	chunk->capacity = 1;
+	chunk->stride = 1;
+	chunk->num_rows = 1;
+	chunk->values = NULL;
+	chunk->cells = (struct ptab_cell *)(chunk + 1);
+	chunk->flags = (uint8_t *)(chunk->cells + p->num_columns);
+	chunk->heap = (char *)(chunk->flags + p->num_columns);
+	chunk->heap_size = (uint32_t)heap;
+	chunk->heap_used = 0;
+	chunk->next = NULL;
+
+	return chunk;
+}
+
 static const struct format_desc *get_desc(enum ptab_format f)
 {
 	const struct format_desc *desc = NULL;
@@ -427,9 +559,11 @@ static const struct format_desc *get_desc(enum ptab_format f)
 int ptab_dumpf(ptab_t *p, FILE *f, enum ptab_format fmt)
 {
 	const struct format_desc *desc;
+	struct ptab_chunk *scratch = NULL;
 	struct strbuf sb;
-	size_t alloc_size;
+	size_t alloc_size, line;
 	char *buf;
+	int err;
 
 	if (!p || !f)
 		return PTAB_ENULL;
@@ -439,34 +573,62 @@ int ptab_dumpf(ptab_t *p, FILE *f, enum ptab_format fmt)
 	if (!desc)
 		return PTAB_EFORMAT;
 
-	/* allocate a buffer large enough to hold the entire table */
-	alloc_size = calculate_table_size(p, desc);
+	/* bring in the rows from any other threads */
+	ptab__shard_merge(p);
+
+	/* and any that were loaded a column at a time */
+	err = ptab__load_finish(p);
+	if (err)
+		return err;
+
+	/*
+	 * the table is written out a piece at a time, so the buffer
+	 * only needs to hold the longest line
+	 */
+	alloc_size = calculate_table_size(p, desc, &line);
+	if (alloc_size > DUMP_BUF_SIZE)
+		alloc_size = line > DUMP_BUF_SIZE ? line : DUMP_BUF_SIZE;
+
 	buf = ptab__mem_alloc_block(p, alloc_size);
 
 	if (!buf)
 		return PTAB_EMEM;
 
+	if (p->spill.num_rows > 0) {
+		scratch = alloc_scratch_chunk(p);
+		if (!scratch) {
+			ptab__mem_free_block(p, buf);
+			return PTAB_EMEM;
+		}
+	}
+
 	/* init strbuf with allocated buffer */
 	strbuf_init(&sb, buf, alloc_size);
+	sb.line = line;
+	sb.f = f;
 
-	/* write the table to the strbuf buffer */
-	write_table(p, desc, &sb);
+	/* write the table to the file through the strbuf buffer */
+	err = write_table(p, desc, scratch, &sb);
+	if (err == PTAB_OK)
+		strbuf_flush(&sb);
 
-	/* write the buffer to the file */
-	fwrite(sb.buf, 1, sb.used, f);
+	/* free the allocated buffers */
+	if (scratch)
+		ptab__mem_free_block(p, scratch);
 
-	/* free the allocated buffer */
 	ptab__mem_free_block(p, buf);
 
-	return PTAB_OK;
+	return err;
 }
 
 int ptab_dumps(ptab_t *p, ptab_string_t *s, enum ptab_format fmt)
 {
 	const struct format_desc *desc;
+	struct ptab_chunk *scratch = NULL;
 	struct strbuf sb;
-	size_t alloc_size;
+	size_t alloc_size, line;
 	char *buf;
+	int err;
 
 	if (!p || !s)
 		return PTAB_ENULL;
@@ -476,18 +638,42 @@ int ptab_dumps(ptab_t *p, ptab_string_t *s, enum ptab_format fmt)
 	if (!desc)
 		return PTAB_EFORMAT;
 
+	/* bring in the rows from any other threads */
+	ptab__shard_merge(p);
+
+	/* and any that were loaded a column at a time */
+	err = ptab__load_finish(p);
+	if (err)
+		return err;
+
 	/* allocate a buffer large enough to hold the entire table */
-	alloc_size = calculate_table_size(p, desc);
+	alloc_size = calculate_table_size(p, desc, &line);
 	buf = ptab__mem_alloc_block(p, alloc_size);
 
 	if (!buf)
 		return PTAB_EMEM;
 
+	if (p->spill.num_rows > 0) {
+		scratch = alloc_scratch_chunk(p);
+		if (!scratch) {
+			ptab__mem_free_block(p, buf);
+			return PTAB_EMEM;
+		}
+	}
+
 	/* init strbuf with allocated buffer */
 	strbuf_init(&sb, buf, alloc_size);
 
 	/* write the table to the strbuf buffer */
-	write_table(p, desc, &sb);
+	err = write_table(p, desc, scratch, &sb);
+
+	if (scratch)
+		ptab__mem_free_block(p, scratch);
+
+	if (err != PTAB_OK) {
+		ptab__mem_free_block(p, buf);
+		return err;
+	}
 
 	/* fill out the string structure */
 	s->str = sb.buf;
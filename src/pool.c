@@ -0,0 +1,325 @@
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "internal.h"
+
+/*
+ * the pool hands out blocks in power-of-two size classes that match
+ * the block sizes used by the table arenas (4 KiB up to 8 MiB);
+ * anything larger goes straight to the underlying allocator
+ */
+#define POOL_MIN_SIZE 4096
+#define POOL_NUM_CLASSES 12
+#define POOL_NO_CLASS POOL_NUM_CLASSES
+
+/* limits on how many free blocks are held per size class */
+#define POOL_THREAD_MAX 8
+#define POOL_SHARED_MAX 64
+
+/* every block handed out is preceded by its size class */
+union pool_header {
+	unsigned int cls;
+	double align_d;
+	void *align_p;
+};
+
+struct pool_free {
+	struct pool_free *next;
+};
+
+struct pool_bins {
+	struct pool_free *head[POOL_NUM_CLASSES];
+	unsigned int count[POOL_NUM_CLASSES];
+};
+
+/* free blocks cached by a single thread, no locking required */
+struct pool_thread {
+	struct ptab_pool *pool;
+	struct pool_bins bins;
+	struct pool_thread *prev;
+	struct pool_thread *next;
+};
+
+struct ptab_pool {
+	struct ptab_allocator funcs;
+	pthread_mutex_t lock;
+	pthread_key_t key;
+	struct pool_bins shared;
+	struct pool_thread *threads;
+};
+
+static void *default_alloc(size_t size, void *opaque)
+{
+	(void)opaque;
+	return malloc(size);
+}
+
+static void default_free(void *p, void *opaque)
+{
+	(void)opaque;
+	free(p);
+}
+
+static unsigned int size_class(size_t size)
+{
+	unsigned int cls = 0;
+
+	while (cls < POOL_NUM_CLASSES && ((size_t)POOL_MIN_SIZE << cls) < size)
+		cls++;
+
+	return cls;
+}
+
+static void bins_push(struct pool_bins *bins, unsigned int cls, void *block)
+{
+	struct pool_free *f = block;
+
+	f->next = bins->head[cls];
+	bins->head[cls] = f;
+	bins->count[cls]++;
+}
+
+static void *bins_pop(struct pool_bins *bins, unsigned int cls)
+{
+	struct pool_free *f = bins->head[cls];
+
+	if (f) {
+		bins->head[cls] = f->next;
+		bins->count[cls]--;
+	}
+
+	return f;
+}
+
+/* release every block in the bins back to the underlying allocator */
+static void bins_release(struct ptab_pool *pool, struct pool_bins *bins)
+{
+	union pool_header *h;
+	unsigned int cls;
+	void *block;
+
+	for (cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+		while ((block = bins_pop(bins, cls))) {
+			h = (union pool_header *)block - 1;
+			pool->funcs.free_func(h, pool->funcs.opaque);
+		}
+	}
+}
+
+/* hand the blocks of an exiting thread back to the shared bins */
+static void thread_exit(void *arg)
+{
+	struct pool_thread *t = arg;
+	struct ptab_pool *pool = t->pool;
+	union pool_header *h;
+	unsigned int cls;
+	void *block;
+
+	pthread_mutex_lock(&pool->lock);
+
+	for (cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+		while ((block = bins_pop(&t->bins, cls))) {
+			if (pool->shared.count[cls] < POOL_SHARED_MAX) {
+				bins_push(&pool->shared, cls, block);
+			} else {
+				h = (union pool_header *)block - 1;
+				pool->funcs.free_func(h, pool->funcs.opaque);
+			}
+		}
+	}
+
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		pool->threads = t->next;
+
+	if (t->next)
+		t->next->prev = t->prev;
+
+	pthread_mutex_unlock(&pool->lock);
+
+	pool->funcs.free_func(t, pool->funcs.opaque);
+}
+
+/* get the calling thread's cache, creating it on first use */
+static struct pool_thread *get_thread(struct ptab_pool *pool)
+{
+	struct pool_thread *t;
+
+	t = pthread_getspecific(pool->key);
+	if (t)
+		return t;
+
+	t = pool->funcs.alloc_func(sizeof(struct pool_thread),
+				   pool->funcs.opaque);
+	if (!t)
+		return NULL;
+
+	memset(t, 0, sizeof(struct pool_thread));
+	t->pool = pool;
+
+	if (pthread_setspecific(pool->key, t) != 0) {
+		pool->funcs.free_func(t, pool->funcs.opaque);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	t->next = pool->threads;
+	if (t->next)
+		t->next->prev = t;
+	pool->threads = t;
+	pthread_mutex_unlock(&pool->lock);
+
+	return t;
+}
+
+static void *pool_block_alloc(size_t size, void *opaque)
+{
+	struct ptab_pool *pool = opaque;
+	struct pool_thread *t;
+	union pool_header *h;
+	unsigned int cls;
+	void *block = NULL;
+
+	cls = size_class(size);
+
+	if (cls != POOL_NO_CLASS) {
+		/* try the thread cache first, then the shared bins */
+		t = get_thread(pool);
+		if (t)
+			block = bins_pop(&t->bins, cls);
+
+		if (!block) {
+			pthread_mutex_lock(&pool->lock);
+			block = bins_pop(&pool->shared, cls);
+			pthread_mutex_unlock(&pool->lock);
+		}
+
+		if (block)
+			return block;
+
+		/* nothing cached, allocate the whole size class */
+		size = (size_t)POOL_MIN_SIZE << cls;
+	}
+
+	h = pool->funcs.alloc_func(sizeof(union pool_header) + size,
+				   pool->funcs.opaque);
+	if (!h)
+		return NULL;
+
+	h->cls = cls;
+
+	return h + 1;
+}
+
+static void pool_block_free(void *p, void *opaque)
+{
+	struct ptab_pool *pool = opaque;
+	union pool_header *h = (union pool_header *)p - 1;
+	struct pool_thread *t;
+	unsigned int cls = h->cls;
+
+	if (cls != POOL_NO_CLASS) {
+		t = get_thread(pool);
+		if (t && t->bins.count[cls] < POOL_THREAD_MAX) {
+			bins_push(&t->bins, cls, p);
+			return;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+
+		if (pool->shared.count[cls] < POOL_SHARED_MAX) {
+			bins_push(&pool->shared, cls, p);
+			p = NULL;
+		}
+
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!p)
+			return;
+	}
+
+	pool->funcs.free_func(h, pool->funcs.opaque);
+}
+
+ptab_pool_t *ptab_pool_init(const ptab_allocator_t *a)
+{
+	ptab_allocator_t funcs;
+	ptab_pool_t *pool;
+
+	/*
+	 * if an allocator is provided, make sure
+	 * the alloc and free funcs are valid
+	 */
+	if (a && (!a->alloc_func || !a->free_func))
+		return NULL;
+
+	if (a)
+		funcs = *a;
+	else
+		funcs = (ptab_allocator_t){ default_alloc, default_free, NULL };
+
+	pool = funcs.alloc_func(sizeof(ptab_pool_t), funcs.opaque);
+	if (!pool)
+		return NULL;
+
+	memset(pool, 0, sizeof(ptab_pool_t));
+	pool->funcs = funcs;
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		funcs.free_func(pool, funcs.opaque);
+		return NULL;
+	}
+
+	if (pthread_key_create(&pool->key, thread_exit) != 0) {
+		pthread_mutex_destroy(&pool->lock);
+		funcs.free_func(pool, funcs.opaque);
+		return NULL;
+	}
+
+	return pool;
+}
+
+int ptab_pool_allocator(ptab_pool_t *pool, ptab_allocator_t *a)
+{
+	if (!pool || !a)
+		return PTAB_ENULL;
+
+	a->alloc_func = pool_block_alloc;
+	a->free_func = pool_block_free;
+	a->opaque = pool;
+
+	return PTAB_OK;
+}
+
+int ptab_pool_free(ptab_pool_t *pool)
+{
+	struct pool_thread *t, *next;
+
+	if (!pool)
+		return PTAB_ENULL;
+
+	/*
+	 * deleting the key keeps the destructor from running when
+	 * the other threads exit, so their caches are cleaned up here
+	 */
+	pthread_setspecific(pool->key, NULL);
+	pthread_key_delete(pool->key);
+
+	for (t = pool->threads; t; t = next) {
+		next = t->next;
+		bins_release(pool, &t->bins);
+		pool->funcs.free_func(t, pool->funcs.opaque);
+	}
+
+	bins_release(pool, &pool->shared);
+
+	pthread_mutex_destroy(&pool->lock);
+	pool->funcs.free_func(pool, pool->funcs.opaque);
+
+	return PTAB_OK;
+}
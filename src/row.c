@@ -4,72 +4,567 @@
 #include <ptab.h>
 #include "internal.h"
 
-static void add_to_row_list(ptab_t *p, struct ptab_row *r)
+/* a first guess at the text in each cell, before any rows are seen */
+#define CELL_GUESS_BYTES 8
+
+/*
+ * allocate a chunk along with its cells, raw values and string heap
+ * in one go. in memory it looks like this:
+ * [ chunk ][ values ][ cells ][ flags ][ heap ]
+ */
+static size_t chunk_alloc_size(const ptab_t *p, unsigned int capacity, size_t heap)
+{
+	return sizeof(struct ptab_chunk) +
+	       ((size_t)(capacity + CHUNK_PAD) *
+		(p->num_values * sizeof(union ptab_cell_value) +
+		 p->num_columns * (sizeof(struct ptab_cell) + sizeof(uint8_t)))) +
+	       heap;
+}
+
+/*
+ * add a chunk to the end of the cursor's rows, with a string heap of
+ * at least min_heap bytes; a nonzero min_heap means the last chunk's
+ * heap ran out, so the guess at how big a row is was too small
+ */
+struct ptab_chunk *
+ptab__row_add_chunk(ptab_t *p, struct ptab_cursor *cursor, size_t min_heap)
+{
+	struct chunk_list *rows = cursor->rows;
+	struct ptab_chunk *last = rows->tail;
+	struct ptab_chunk *chunk;
+	unsigned int capacity;
+	size_t row_bytes, heap, avg;
+
+	capacity = rows->capacity ? rows->capacity : CHUNK_MIN_ROWS;
+
+	row_bytes = rows->row_bytes;
+	if (row_bytes == 0)
+		row_bytes = (size_t)p->num_columns * CELL_GUESS_BYTES;
+
+	if (min_heap) {
+		if (row_bytes <= CELL_MAX / 2)
+			row_bytes *= 2;
+	} else if (last && last->num_rows == last->capacity) {
+		/* a full chunk shows how big the rows really are */
+		avg = last->heap_used / last->num_rows;
+		if (avg + avg / 4 + 1 < row_bytes)
+			row_bytes = avg + avg / 4 + 1;
+	}
+
+	rows->row_bytes = row_bytes;
+
+	heap = row_bytes <= CELL_MAX / capacity ? row_bytes * capacity : CELL_MAX;
+	if (heap < min_heap)
+		heap = min_heap;
+
+	/* keep a single chunk well within the memory limit */
+	while (p->spill.limit && capacity > CHUNK_MIN_ROWS &&
+	       chunk_alloc_size(p, capacity, heap) > p->spill.limit / 4) {
+		capacity /= 2;
+		rows->capacity = capacity;
+
+		if (heap / 2 >= min_heap)
+			heap /= 2;
+	}
+
+	chunk = ptab__mem_cache_alloc(p, cursor->cache, chunk_alloc_size(p, capacity, heap));
+	if (!chunk)
+		return NULL;
+
+	chunk->capacity = capacity;
+	chunk->stride = capacity + CHUNK_PAD;
+	chunk->num_rows = 0;
+	chunk->values = (union ptab_cell_value *)(chunk + 1);
+	chunk->cells = (struct ptab_cell *)(chunk->values + (size_t)chunk->stride * p->num_values);
+	chunk->flags = (uint8_t *)(chunk->cells + (size_t)chunk->stride * p->num_columns);
+	chunk->heap = (char *)(chunk->flags + (size_t)chunk->stride * p->num_columns);
+	chunk->heap_size = (uint32_t)heap;
+	chunk->heap_used = 0;
+	chunk->next = NULL;
+
+	if (rows->tail)
+		rows->tail->next = chunk;
+	else
+		rows->head = chunk;
+
+	rows->tail = chunk;
+
+	/* tables that keep growing get bigger chunks */
+	if (capacity < CHUNK_MAX_ROWS)
+		rows->capacity = capacity * 2 < CHUNK_MAX_ROWS ? capacity * 2 : CHUNK_MAX_ROWS;
+
+	return chunk;
+}
+
+/*
+ * the row being added needs more string heap than its chunk has left,
+ * so move what it has so far to a new chunk with room for need more
+ * bytes. the old chunk is no longer the last, so no more rows go in it
+ */
+static struct ptab_chunk *move_row(ptab_t *p, struct ptab_cursor *cursor, size_t need)
+{
+	struct ptab_chunk *old = cursor->chunk;
+	struct ptab_chunk *chunk;
+	const struct ptab_col *col;
+	const struct ptab_cell *from;
+	struct ptab_cell *to;
+	size_t partial = 0;
+	uint32_t size;
+
+	for (col = p->columns_head; col != cursor->column; col = col->next)
+		partial += cell_size(old, &old->cells[chunk_cell(old, col->id, cursor->row)]);
+
+	if (partial + need > CELL_MAX)
+		return NULL;
+
+	chunk = ptab__row_add_chunk(p, cursor, partial + need);
+	if (!chunk)
+		return NULL;
+
+	for (col = p->columns_head; col != cursor->column; col = col->next) {
+		from = &old->cells[chunk_cell(old, col->id, cursor->row)];
+		to = &chunk->cells[chunk_cell(chunk, col->id, 0)];
+
+		/*
+		 * a borrowed cell's pointer moves the same as text would,
+		 * and dictionary and inline cells have nothing in the heap
+		 */
+		size = cell_size(old, from);
+		cell_set(chunk, to, from->offset, from->len, cell_flags(old, from));
+		if (size > 0) {
+			memcpy(chunk->heap + chunk->heap_used, old->heap + from->offset, size);
+			to->offset = chunk->heap_used;
+			chunk->heap_used += size;
+		}
+
+		if (col->type != PTAB_STRING)
+			chunk->values[chunk_cell(chunk, col->value_id, 0)] =
+				old->values[chunk_cell(old, col->value_id, cursor->row)];
+	}
+
+	cursor->chunk = chunk;
+	cursor->row = 0;
+
+	return chunk;
+}
+
+/*
+ * make room for len bytes of a cell's text in the chunk's string heap,
+ * and point the cell at them; the row may move to a new chunk on the
+ * way, so it's only safe to use cursor->chunk afterwards
+ */
+static char *reserve_cell(ptab_t *p, struct ptab_cursor *cursor,
+			  struct ptab_col *column, size_t len, int *err)
+{
+	struct ptab_chunk *chunk = cursor->chunk;
+	struct ptab_cell *cell;
+	char *text;
+
+	if (len > CELL_MAX) {
+		*err = PTAB_ERANGE;
+		return NULL;
+	}
+
+	if (len > (size_t)(chunk->heap_size - chunk->heap_used)) {
+		chunk = move_row(p, cursor, len);
+		if (!chunk) {
+			*err = PTAB_EMEM;
+			return NULL;
+		}
+	}
+
+	cell = &chunk->cells[chunk_cell(chunk, column->id, cursor->row)];
+	cell_set(chunk, cell, chunk->heap_used, (uint32_t)len, 0);
+
+	text = chunk->heap + chunk->heap_used;
+	chunk->heap_used += (uint32_t)len;
+
+	return text;
+}
+
+/*
+ * copy a cell's text into the chunk's string heap (or the cell, if
+ * it is short enough), or look it up in a dictionary column's values;
+ * the row may move to a new chunk on the way, so it's only safe to use
+ * cursor->chunk afterwards. the column's width is left to the caller
+ */
+static int store_cell(ptab_t *p, struct ptab_cursor *cursor,
+		      struct ptab_col *column, const char *str, size_t len)
+{
+	struct ptab_chunk *chunk = cursor->chunk;
+	struct ptab_cell *cell;
+	char *text;
+	int err;
+
+	if (column->dict) {
+		cell = &chunk->cells[chunk_cell(chunk, column->id, cursor->row)];
+		return ptab__dict_cell(p, column, chunk, cell, str, len);
+	}
+
+	if (len <= CELL_INLINE_MAX) {
+		cell = &chunk->cells[chunk_cell(chunk, column->id, cursor->row)];
+		cell_set_inline(chunk, cell, str, len);
+		return PTAB_OK;
+	}
+
+	text = reserve_cell(p, cursor, column, len, &err);
+	if (!text)
+		return err;
+
+	memcpy(text, str, len);
+
+	return PTAB_OK;
+}
+
+/*
+ * store a cell that borrows the caller's text: the heap only gets a
+ * pointer to it, which is copied like any other text if the row moves.
+ * text short enough to go in the cell is cheaper to copy
+ */
+static int store_ref(ptab_t *p, struct ptab_cursor *cursor,
+		     struct ptab_col *column, const char *str, size_t len)
 {
-	if (p->rows_tail) {
-		p->rows_tail->next = r;
-		p->rows_tail = r;
-		r->next = NULL;
+	struct ptab_chunk *chunk;
+	struct ptab_cell *cell;
+	int err;
+
+	if (len <= CELL_INLINE_MAX)
+		return store_cell(p, cursor, column, str, len);
+
+	if (len > CELL_MAX)
+		return PTAB_ERANGE;
+
+	err = store_cell(p, cursor, column, (const char *)&str, sizeof(str));
+	if (err)
+		return err;
+
+	chunk = cursor->chunk;
+	cell = &chunk->cells[chunk_cell(chunk, column->id, cursor->row)];
+	cell_set(chunk, cell, cell->offset, (uint32_t)len, CELL_REF);
+
+	return PTAB_OK;
+}
+
+/* the length of the cell just stored for the column */
+static inline size_t cursor_len(const struct ptab_cursor *cursor, const struct ptab_col *column)
+{
+	const struct ptab_chunk *chunk = cursor->chunk;
+
+	return chunk->cells[chunk_cell(chunk, column->id, cursor->row)].len;
+}
+
+static int put_s(ptab_t *p, struct ptab_cursor *cursor,
+		 struct ptab_col *column, const char *s)
+{
+	return store_cell(p, cursor, column, s, strlen(s));
+}
+
+/*
+ * format a numeric cell into buf, which holds FORMAT_BUF_SIZE bytes;
+ * returns the length or a negative number
+ */
+static int format_i(char *buf, const struct ptab_col *column,
+		    const char *format, union ptab_cell_value v)
+{
+	const struct ptab_col_format *f = ptab__format_of(column, format);
+	int len;
+
+	if (f)
+		len = ptab__format_value(f, column->type, v, buf, FORMAT_BUF_SIZE);
+	else if (column->type == PTAB_INT64)
+		len = snprintf(buf, FORMAT_BUF_SIZE, format, v.l);
+	else if (column->type == PTAB_UINT64)
+		len = snprintf(buf, FORMAT_BUF_SIZE, format, v.u);
+	else
+		len = snprintf(buf, FORMAT_BUF_SIZE, format, v.i);
+
+	return len < FORMAT_BUF_SIZE ? len : FORMAT_BUF_SIZE - 1;
+}
+
+static int format_f(char *buf, const struct ptab_col *column,
+		    const char *format, double f)
+{
+	const struct ptab_col_format *fmt = ptab__format_of(column, format);
+	union ptab_cell_value v;
+	int len;
+
+	if (fmt) {
+		v.f = f;
+		len = ptab__format_value(fmt, column->type, v, buf, FORMAT_BUF_SIZE);
 	} else {
-		p->rows_head = r;
-		p->rows_tail = r;
-		r->next = NULL;
+		len = snprintf(buf, FORMAT_BUF_SIZE, format, f);
 	}
 
-	p->num_rows++;
+	return len < FORMAT_BUF_SIZE ? len : FORMAT_BUF_SIZE - 1;
 }
 
-int ptab_begin_row(ptab_t *p)
+/*
+ * a lazy cell only keeps the value, and the length it will have once
+ * it is formatted
+ */
+static int put_lazy(struct ptab_cursor *cursor, struct ptab_col *column,
+		    union ptab_cell_value v)
+{
+	struct ptab_chunk *chunk = cursor->chunk;
+	struct ptab_cell *cell;
+	int len;
+
+	len = ptab__format_len(column, v);
+	if (len < 0)
+		return PTAB_EFORMAT;
+
+	cell = &chunk->cells[chunk_cell(chunk, column->id, cursor->row)];
+	cell_set(chunk, cell, 0, (uint32_t)len, CELL_LAZY);
+
+	chunk->values[chunk_cell(chunk, column->value_id, cursor->row)] = v;
+
+	return PTAB_OK;
+}
+
+/* ints and 64-bit integers both, which are in v as the column's type */
+static int put_i(ptab_t *p, struct ptab_cursor *cursor,
+		 struct ptab_col *column, const char *format, union ptab_cell_value v)
 {
-	struct ptab_row *row;
-	size_t alloc_size;
+	const struct ptab_col_format *fmt;
+	struct ptab_chunk *chunk;
+	char buf[FORMAT_BUF_SIZE];
+	char *text;
+	size_t n;
+	int len;
+	int err;
+
+	if (column->lazy)
+		return put_lazy(cursor, column, v);
+
+	/*
+	 * a plain int's length is known before it is written, so it can
+	 * go straight into the heap when it is headed there
+	 */
+	fmt = ptab__format_of(column, format);
+	if (fmt && format_is_int(fmt) && !column->dict) {
+		n = ptab__format_int_len(fmt, column->type, v);
+
+		if (n > CELL_INLINE_MAX && n < FORMAT_BUF_SIZE) {
+			text = reserve_cell(p, cursor, column, n, &err);
+			if (!text)
+				return err;
+
+			ptab__format_int_put(fmt, column->type, v, text, n);
+			goto done;
+		}
+	}
+
+	len = format_i(buf, column, format, v);
+	if (len < 0)
+		return PTAB_EFORMAT;
+
+	err = store_cell(p, cursor, column, buf, (size_t)len);
+	if (err)
+		return err;
+
+done:
+	chunk = cursor->chunk;
+	chunk->values[chunk_cell(chunk, column->value_id, cursor->row)] = v;
+
+	return PTAB_OK;
+}
+
+/* floats and doubles both, since a float is passed to printf as a double */
+static int put_f(ptab_t *p, struct ptab_cursor *cursor,
+		 struct ptab_col *column, const char *format, double f)
+{
+	union ptab_cell_value v;
+	struct ptab_chunk *chunk;
+	char buf[FORMAT_BUF_SIZE];
+	int len;
+	int err;
+
+	if (column->lazy) {
+		v.f = f;
+		return put_lazy(cursor, column, v);
+	}
+
+	len = format_f(buf, column, format, f);
+	if (len < 0)
+		return PTAB_EFORMAT;
+
+	err = store_cell(p, cursor, column, buf, (size_t)len);
+	if (err)
+		return err;
+
+	chunk = cursor->chunk;
+	chunk->values[chunk_cell(chunk, column->value_id, cursor->row)].f = f;
+
+	return PTAB_OK;
+}
+
+/* rows per chunk when making room for the given number of rows */
+static unsigned int reserve_capacity(size_t rows)
+{
+	if (rows < CHUNK_MIN_ROWS)
+		return CHUNK_MIN_ROWS;
+
+	if (rows > CHUNK_MAX_ROWS)
+		return CHUNK_MAX_ROWS;
+
+	return (unsigned int)rows;
+}
+
+static int reserve_rows(ptab_t *p, struct ptab_cursor *cursor, size_t rows, size_t string_bytes)
+{
+	size_t chunk_size, chunks, row_bytes, size;
+	unsigned int capacity;
+
+	/*
+	 * size the chunks to fit the rows (within limits), since the
+	 * last one is only partly used, and their string heaps to fit
+	 * the average row; each chunk may need padding to be aligned
+	 */
+	capacity = reserve_capacity(rows);
+
+	if (rows == 0)
+		return ptab__mem_reserve(p, cursor->cache, string_bytes);
+
+	row_bytes = string_bytes / rows + (string_bytes % rows != 0);
+	if (row_bytes > CELL_MAX / capacity)
+		return PTAB_ERANGE;
+
+	chunk_size = chunk_alloc_size(p, capacity, row_bytes * capacity) + MEM_ALIGN - 1;
+	chunks = rows / capacity + (rows % capacity != 0);
+
+	if (chunk_size > (size_t)-1 / chunks)
+		return PTAB_ERANGE;
+
+	size = chunks * chunk_size;
+
+	cursor->rows->capacity = capacity;
+	cursor->rows->row_bytes = row_bytes;
+
+	return ptab__mem_reserve(p, cursor->cache, size);
+}
+
+int ptab_reserve(ptab_t *p, size_t rows, size_t string_bytes)
+{
+	struct ptab_cursor *cursor;
 
 	if (!p)
 		return PTAB_ENULL;
 
+	/* the size of a row isn't known until the columns are */
 	if (p->num_columns == 0)
 		return PTAB_EORDER;
 
-	if (p->current_row)
-		return PTAB_EORDER;
+	/* a concurrent table reserves in the calling thread's arena */
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
 
-	/*
-	 * allocate the row structure and all of the variable-data
-	 * arrays. in memory it looks like this:
-	 * [ row ][ data][ strings][ lengths ]
-	 */
-	alloc_size = sizeof(struct ptab_row) +
-		     (p->num_columns * (sizeof(union ptab_row_data) +
-					sizeof(char *) + sizeof(size_t)));
+	return reserve_rows(p, cursor, rows, string_bytes);
+}
 
-	row = ptab__mem_alloc(p, alloc_size);
-	if (!row)
-		return PTAB_EMEM;
+/*
+ * the schema is done once rows start coming in; remember where it
+ * ends so that ptab_reset can keep it (the rows of a concurrent table
+ * are never in the table's own arena)
+ */
+static inline void mark_rows(ptab_t *p, const struct ptab_cursor *cursor)
+{
+	if (!cursor->shard && !p->mem.marked)
+		ptab__mem_mark(p);
+}
 
-	/* initialize the row structure */
-	row->data = (union ptab_row_data *)(row + 1);
-	row->strings = (char **)(row->data + p->num_columns);
-	row->lengths = (size_t *)(row->strings + p->num_columns);
-	row->next = NULL;
+/* point the cursor at a new row in the last chunk */
+static int start_row(ptab_t *p, struct ptab_cursor *cursor)
+{
+	struct ptab_chunk *chunk;
 
-	p->current_row = row;
-	p->current_column = p->columns_head;
+	mark_rows(p, cursor);
+
+	/* everything the row uses is counted against the memory limit */
+	if (!cursor->shard)
+		p->spill.row_start = p->mem.cache.total_used;
+
+	/* the row goes in the next free slot of the last chunk */
+	chunk = cursor->rows->tail;
+	if (!chunk || chunk->num_rows == chunk->capacity) {
+		chunk = ptab__row_add_chunk(p, cursor, 0);
+		if (!chunk)
+			return PTAB_EMEM;
+	}
+
+	cursor->chunk = chunk;
+	cursor->row = chunk->num_rows;
+	cursor->column = p->columns_head;
 
 	return PTAB_OK;
 }
 
-int ptab_row_data_s(ptab_t *p, const char *s)
+/* the row is only part of the table once it is finished */
+static void finish_row(struct ptab_cursor *cursor)
 {
-	struct ptab_row *row;
-	struct ptab_col *column;
-	char *str;
-	size_t len;
+	cursor->chunk->num_rows++;
+	(*cursor->num_rows)++;
 
-	if (!p || !s)
+	cursor->chunk = NULL;
+	cursor->column = NULL;
+}
+
+/*
+ * once the rows in memory reach the limit, move them out to the spill
+ * file; the row is in the table either way
+ */
+int ptab__row_check_limit(ptab_t *p)
+{
+	if (p->mem.cache.total_used > p->spill.row_start)
+		p->spill.bytes += p->mem.cache.total_used - p->spill.row_start;
+
+	if (p->spill.bytes >= p->spill.limit)
+		return ptab__spill_rows(p);
+
+	return PTAB_OK;
+}
+
+int ptab_begin_row(ptab_t *p)
+{
+	struct ptab_cursor *cursor;
+	int err;
+
+	if (!p)
 		return PTAB_ENULL;
 
-	row = p->current_row;
-	column = p->current_column;
+	if (p->num_columns == 0)
+		return PTAB_EORDER;
+
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
+
+	if (cursor->chunk)
+		return PTAB_EORDER;
+
+	/* rows loaded a column at a time come first */
+	err = ptab__load_finish(p);
+	if (err)
+		return err;
+
+	return start_row(p, cursor);
+}
+
+/*
+ * add a string cell of len bytes, copying the text into the heap or,
+ * for a borrowed cell, keeping a pointer to it
+ */
+static int row_data_s(ptab_t *p, const char *s, size_t len, bool borrowed)
+{
+	struct ptab_cursor *cursor;
+	struct ptab_col *column;
+	int err;
+
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
+
+	column = cursor->column;
 
 	if (!column || column->id >= p->num_columns)
 		return PTAB_ECOLUMNS;
@@ -77,124 +572,554 @@ int ptab_row_data_s(ptab_t *p, const char *s)
 	if (column->type != PTAB_STRING)
 		return PTAB_ETYPE;
 
-	len = strlen(s);
-	str = ptab__mem_alloc(p, len + 1);
-	if (!str)
-		return PTAB_EMEM;
+	/* a dictionary column has its own copy of the value anyway */
+	if (borrowed && !column->dict)
+		err = store_ref(p, cursor, column, s, len);
+	else
+		err = store_cell(p, cursor, column, s, len);
+	if (err)
+		return err;
 
-	strcpy(str, s);
+	ptab__col_fit(p, column, len);
 
-	row->data[column->id].s = str;
-	row->strings[column->id] = str;
-	row->lengths[column->id] = len;
+	cursor->column = column->next;
 
-	if (len > column->width)
-		column->width = len;
+	return PTAB_OK;
+}
 
-	p->current_column = column->next;
+int ptab_row_data_s(ptab_t *p, const char *s)
+{
+	if (!p || !s)
+		return PTAB_ENULL;
 
-	return PTAB_OK;
+	return row_data_s(p, s, strlen(s), false);
 }
 
-int ptab_row_data_i(ptab_t *p, const char *format, int i)
+int ptab_row_data_sn(ptab_t *p, const char *s, size_t len)
+{
+	if (!p || !s)
+		return PTAB_ENULL;
+
+	return row_data_s(p, s, len, false);
+}
+
+int ptab_row_data_str(ptab_t *p, const ptab_string_t *s)
 {
-	struct ptab_row *row;
+	if (!p || !s || !s->str)
+		return PTAB_ENULL;
+
+	return row_data_s(p, s->str, s->len, false);
+}
+
+int ptab_row_data_s_ref(ptab_t *p, const char *s, size_t len)
+{
+	if (!p || !s)
+		return PTAB_ENULL;
+
+	return row_data_s(p, s, len, true);
+}
+
+/* add an integer cell, to a column of the given type */
+static int row_data_i(ptab_t *p, enum ptab_type type, const char *format,
+		      union ptab_cell_value v)
+{
+	struct ptab_cursor *cursor;
 	struct ptab_col *column;
-	static const int BUF_SIZE = 128;
-	char buf[BUF_SIZE];
-	char *str;
-	size_t len;
+	int err;
 
-	if (!p || !format)
+	if (!p)
 		return PTAB_ENULL;
 
-	row = p->current_row;
-	column = p->current_column;
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
+
+	column = cursor->column;
 
 	if (!column || column->id >= p->num_columns)
 		return PTAB_ECOLUMNS;
 
-	if (column->type != PTAB_INTEGER)
+	if (column->type != type)
 		return PTAB_ETYPE;
 
-	len = (size_t)snprintf(buf, BUF_SIZE, format, i);
-	str = ptab__mem_alloc(p, len + 1);
-	if (!str)
-		return PTAB_EMEM;
-
-	strcpy(str, buf);
+	/* a column format takes the place of the cell's */
+	if (!format && !column->format)
+		return PTAB_ENULL;
 
-	row->data[column->id].i = i;
-	row->strings[column->id] = str;
-	row->lengths[column->id] = len;
+	err = put_i(p, cursor, column, format, v);
+	if (err)
+		return err;
 
-	if (len > column->width)
-		column->width = len;
+	ptab__col_fit(p, column, cursor_len(cursor, column));
 
-	p->current_column = column->next;
+	cursor->column = column->next;
 
 	return PTAB_OK;
 }
 
-int ptab_row_data_f(ptab_t *p, const char *format, float f)
+int ptab_row_data_i(ptab_t *p, const char *format, int i)
+{
+	union ptab_cell_value v;
+
+	v.i = i;
+
+	return row_data_i(p, PTAB_INTEGER, format, v);
+}
+
+int ptab_row_data_i64(ptab_t *p, const char *format, int64_t i)
+{
+	union ptab_cell_value v;
+
+	v.l = i;
+
+	return row_data_i(p, PTAB_INT64, format, v);
+}
+
+int ptab_row_data_u64(ptab_t *p, const char *format, uint64_t u)
+{
+	union ptab_cell_value v;
+
+	v.u = u;
+
+	return row_data_i(p, PTAB_UINT64, format, v);
+}
+
+/* a decimal column always has a format, which is to its scale */
+int ptab_row_data_dec(ptab_t *p, int64_t val)
+{
+	union ptab_cell_value v;
+
+	v.l = val;
+
+	return row_data_i(p, PTAB_DECIMAL, NULL, v);
+}
+
+/* and so does a timestamp column, which has one from the start */
+int ptab_row_data_ts(ptab_t *p, int64_t ns)
+{
+	union ptab_cell_value v;
+
+	v.l = ns;
+
+	return row_data_i(p, PTAB_TIMESTAMP, NULL, v);
+}
+
+/* add a float or double cell, to a column of the given type */
+static int row_data_f(ptab_t *p, enum ptab_type type, const char *format, double f)
 {
-	struct ptab_row *row;
+	struct ptab_cursor *cursor;
 	struct ptab_col *column;
-	static const int BUF_SIZE = 128;
-	char buf[BUF_SIZE];
-	char *str;
-	size_t len;
+	int err;
 
-	if (!p || !format)
+	if (!p)
 		return PTAB_ENULL;
 
-	row = p->current_row;
-	column = p->current_column;
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
+
+	column = cursor->column;
 
 	if (!column || column->id >= p->num_columns)
 		return PTAB_ECOLUMNS;
 
-	if (column->type != PTAB_FLOAT)
+	if (column->type != type)
 		return PTAB_ETYPE;
 
-	len = (size_t)snprintf(buf, BUF_SIZE, format, f);
-	str = ptab__mem_alloc(p, len + 1);
-	if (!str)
-		return PTAB_EMEM;
-
-	strcpy(str, buf);
+	/*
+	 * a column format takes the place of the cell's, and a double
+	 * without either is written as briefly as it can be
+	 */
+	if (!format && !column->format && type != PTAB_DOUBLE)
+		return PTAB_ENULL;
 
-	row->data[column->id].f = f;
-	row->strings[column->id] = str;
-	row->lengths[column->id] = len;
+	err = put_f(p, cursor, column, format, f);
+	if (err)
+		return err;
 
-	if (len > column->width)
-		column->width = len;
+	ptab__col_fit(p, column, cursor_len(cursor, column));
 
-	p->current_column = column->next;
+	cursor->column = column->next;
 
 	return PTAB_OK;
 }
 
+int ptab_row_data_f(ptab_t *p, const char *format, float f)
+{
+	return row_data_f(p, PTAB_FLOAT, format, f);
+}
+
+int ptab_row_data_d(ptab_t *p, const char *format, double d)
+{
+	return row_data_f(p, PTAB_DOUBLE, format, d);
+}
+
 int ptab_end_row(ptab_t *p)
 {
+	struct ptab_cursor *cursor;
+
 	if (!p)
 		return PTAB_ENULL;
 
-	if (!p->current_row)
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
+
+	if (!cursor->chunk)
 		return PTAB_EORDER;
 
 	/*
-	 * current_column should be null after the last
-	 * row value is set (current_column = column->next)
+	 * the cursor's column should be null after the last
+	 * row value is set (column = column->next)
 	 */
-	if (p->current_column)
+	if (cursor->column)
 		return PTAB_ECOLUMNS;
 
-	add_to_row_list(p, p->current_row);
+	finish_row(cursor);
+
+	if (!cursor->shard && p->spill.limit)
+		return ptab__row_check_limit(p);
+
+	return PTAB_OK;
+}
+
+/* make sure every cell of the batch has something in it */
+static int check_batch(const ptab_t *p, const ptab_value_t *cells, size_t nrows)
+{
+	const struct ptab_col *col;
+	const ptab_value_t *v = cells;
+	size_t r;
 
-	p->current_row = NULL;
-	p->current_column = NULL;
+	for (r = 0; r < nrows; r++) {
+		for (col = p->columns_head; col; col = col->next, v++) {
+			if (col->type == PTAB_STRING ? !v->data.s :
+			    !v->format && !col->format && col->type != PTAB_DOUBLE)
+				return PTAB_ENULL;
+		}
+	}
 
 	return PTAB_OK;
 }
+
+/* an integer cell of the batch, as the column's type of value */
+static inline union ptab_cell_value batch_int(enum ptab_type type, const ptab_value_t *v)
+{
+	union ptab_cell_value value;
+
+	switch (type) {
+	case PTAB_INT64:
+	case PTAB_DECIMAL:
+	case PTAB_TIMESTAMP:
+		value.l = v->data.i64;
+		break;
+	case PTAB_UINT64:
+		value.u = v->data.u64;
+		break;
+	default:
+		value.i = v->data.i;
+		break;
+	}
+
+	return value;
+}
+
+/* fill out the row the cursor is on from one row of the batch */
+static int put_row(ptab_t *p, struct ptab_cursor *cursor, const ptab_value_t *v, bool fit)
+{
+	struct ptab_col *col;
+	int err;
+
+	for (col = p->columns_head; col; col = col->next, v++) {
+		switch (col->type) {
+		case PTAB_STRING:
+			err = put_s(p, cursor, col, v->data.s);
+			break;
+		case PTAB_INTEGER:
+		case PTAB_INT64:
+		case PTAB_UINT64:
+		case PTAB_DECIMAL:
+		case PTAB_TIMESTAMP:
+			err = put_i(p, cursor, col, v->format, batch_int(col->type, v));
+			break;
+		case PTAB_FLOAT:
+			err = put_f(p, cursor, col, v->format, v->data.f);
+			break;
+		case PTAB_DOUBLE:
+			err = put_f(p, cursor, col, v->format, v->data.d);
+			break;
+		default:
+			err = PTAB_ETYPE;
+			break;
+		}
+
+		if (err)
+			return err;
+
+		if (fit)
+			ptab__col_fit(p, col, cursor_len(cursor, col));
+
+		cursor->column = col->next;
+	}
+
+	return PTAB_OK;
+}
+
+/*
+ * add as many rows of the batch as fit in the chunk, keeping the
+ * chunk's state in locals rather than going through the cursor. stops
+ * early at a row whose text doesn't fit in the heap, which is left
+ * for the caller to add the slow way; returns the rows added
+ */
+static size_t fill_chunk(ptab_t *p, struct ptab_chunk *chunk,
+			 const ptab_value_t *v, size_t nrows, int *err)
+{
+	struct ptab_col *col;
+	struct ptab_cell *cell;
+	union ptab_cell_value *value;
+	char buf[FORMAT_BUF_SIZE];
+	unsigned int row = chunk->num_rows;
+	uint32_t used = chunk->heap_used;
+	uint32_t row_start;
+	const char *str;
+	size_t n, room, len;
+	int ret;
+
+	room = chunk->capacity - row;
+	if (nrows > room)
+		nrows = room;
+
+	for (n = 0; n < nrows; n++, row++) {
+		row_start = used;
+
+		for (col = p->columns_head; col; col = col->next, v++) {
+			str = buf;
+			ret = 0;
+
+			switch (col->type) {
+			case PTAB_STRING:
+				str = v->data.s;
+				break;
+			case PTAB_INTEGER:
+			case PTAB_INT64:
+			case PTAB_UINT64:
+			case PTAB_DECIMAL:
+			case PTAB_TIMESTAMP:
+				value = &chunk->values[chunk_cell(chunk, col->value_id, row)];
+				*value = batch_int(col->type, v);
+				ret = col->lazy ? ptab__format_len(col, *value) :
+						  format_i(buf, col, v->format, *value);
+				break;
+			case PTAB_FLOAT:
+			case PTAB_DOUBLE:
+				value = &chunk->values[chunk_cell(chunk, col->value_id, row)];
+				value->f = col->type == PTAB_FLOAT ? v->data.f : v->data.d;
+				ret = col->lazy ? ptab__format_len(col, *value) :
+						  format_f(buf, col, v->format, value->f);
+				break;
+			default:
+				*err = PTAB_ETYPE;
+				goto done;
+			}
+
+			if (ret < 0) {
+				*err = PTAB_EFORMAT;
+				goto done;
+			}
+
+			len = (str == buf) ? (size_t)ret : strlen(str);
+			cell = &chunk->cells[chunk_cell(chunk, col->id, row)];
+
+			if (col->lazy) {
+				cell_set(chunk, cell, 0, (uint32_t)len, CELL_LAZY);
+				continue;
+			}
+
+			if (col->dict) {
+				*err = ptab__dict_cell(p, col, chunk, cell, str, len);
+				if (*err)
+					goto done;
+
+				continue;
+			}
+
+			if (len <= CELL_INLINE_MAX) {
+				cell_set_inline(chunk, cell, str, len);
+				continue;
+			}
+
+			if (len > CELL_MAX || len > (size_t)(chunk->heap_size - used))
+				goto done;
+
+			cell_set(chunk, cell, used, (uint32_t)len, 0);
+
+			memcpy(chunk->heap + used, str, len);
+			used += (uint32_t)len;
+		}
+	}
+
+	chunk->heap_used = used;
+	chunk->num_rows = row;
+
+	return n;
+
+done:
+	/* drop the unfinished row */
+	chunk->heap_used = row_start;
+	chunk->num_rows = row;
+
+	return n;
+}
+
+/*
+ * grow the columns to fit the rows added since the given chunk and
+ * row; each column's cells are next to each other in a chunk, so
+ * this is one pass straight through memory per column
+ */
+static void fit_rows(ptab_t *p, const struct ptab_chunk *chunk, unsigned int row)
+{
+	const struct ptab_cell *cells;
+	struct ptab_col *col;
+	unsigned int i;
+	size_t width;
+
+	for (; chunk; chunk = chunk->next, row = 0) {
+		for (col = p->columns_head; col; col = col->next) {
+			cells = chunk->cells + chunk_cell(chunk, col->id, 0);
+			width = 0;
+
+			for (i = row; i < chunk->num_rows; i++) {
+				if (cells[i].len > width)
+					width = cells[i].len;
+			}
+
+			ptab__col_fit(p, col, width);
+		}
+	}
+}
+
+/*
+ * with a memory limit, rows can be spilled (and their chunks reused)
+ * after any row, so they're added one at a time and the widths are
+ * kept up as it goes
+ */
+static int append_limited(ptab_t *p, struct ptab_cursor *cursor,
+			  const ptab_value_t *cells, size_t nrows)
+{
+	size_t r;
+	int err;
+
+	for (r = 0; r < nrows; r++) {
+		err = start_row(p, cursor);
+		if (err)
+			return err;
+
+		err = put_row(p, cursor, cells + r * p->num_columns, true);
+		if (err) {
+			/* the rows before this one are kept */
+			cursor->chunk = NULL;
+			cursor->column = NULL;
+			return err;
+		}
+
+		finish_row(cursor);
+
+		err = ptab__row_check_limit(p);
+		if (err)
+			return err;
+	}
+
+	return PTAB_OK;
+}
+
+int ptab_append_rows(ptab_t *p, const ptab_value_t *cells, size_t nrows)
+{
+	struct ptab_cursor *cursor;
+	struct ptab_chunk *chunk;
+	const struct ptab_chunk *first;
+	unsigned int first_row;
+	size_t r, n;
+	int err;
+
+	if (!p || (!cells && nrows > 0))
+		return PTAB_ENULL;
+
+	if (p->num_columns == 0)
+		return PTAB_EORDER;
+
+	cursor = ptab__shard_cursor(p);
+	if (!cursor)
+		return PTAB_EMEM;
+
+	if (cursor->chunk)
+		return PTAB_EORDER;
+
+	if (nrows == 0)
+		return PTAB_OK;
+
+	if (nrows > (size_t)-1 / p->num_columns)
+		return PTAB_ERANGE;
+
+	err = ptab__load_finish(p);
+	if (err)
+		return err;
+
+	err = check_batch(p, cells, nrows);
+	if (err)
+		return err;
+
+	if (!cursor->shard && p->spill.limit)
+		return append_limited(p, cursor, cells, nrows);
+
+	mark_rows(p, cursor);
+
+	/*
+	 * make room for the whole batch at once, unless the chunks are
+	 * already at least as big as the batch would make them
+	 */
+	if (reserve_capacity(nrows) >= cursor->rows->capacity) {
+		err = reserve_rows(p, cursor, nrows,
+				   nrows * p->num_columns * CELL_GUESS_BYTES);
+		if (err)
+			return err;
+	}
+
+	first = cursor->rows->tail;
+	first_row = first ? first->num_rows : 0;
+
+	for (r = 0; r < nrows && err == PTAB_OK; r += n) {
+		chunk = cursor->rows->tail;
+		if (!chunk || chunk->num_rows == chunk->capacity) {
+			chunk = ptab__row_add_chunk(p, cursor, 0);
+			if (!chunk) {
+				err = PTAB_EMEM;
+				break;
+			}
+		}
+
+		if (!first)
+			first = chunk;
+
+		n = fill_chunk(p, chunk, cells + r * p->num_columns, nrows - r, &err);
+		*cursor->num_rows += (unsigned int)n;
+
+		if (err || r + n == nrows || chunk->num_rows == chunk->capacity)
+			continue;
+
+		/* the next row's text doesn't fit, so it moves to a new chunk */
+		err = start_row(p, cursor);
+		if (err == PTAB_OK)
+			err = put_row(p, cursor, cells + (r + n) * p->num_columns, false);
+
+		if (err == PTAB_OK) {
+			finish_row(cursor);
+			n++;
+		} else {
+			cursor->chunk = NULL;
+			cursor->column = NULL;
+		}
+	}
+
+	fit_rows(p, first, first_row);
+
+	return err;
+}
@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <pthread.h>
+
+#include <ptab.h>
+#include "internal.h"
+
+/*
+ * a thread's first row in a concurrent table gets it a shard: an
+ * arena and cursor of its own, found again through the table's key
+ */
+static struct ptab_shard *shard_create(ptab_t *p)
+{
+	struct shard_internal *shards = &p->shards;
+	struct ptab_shard *shard;
+
+	shard = ptab__mem_shard_create(p);
+	if (!shard)
+		return NULL;
+
+	shard->cursor.rows = &shard->rows;
+	shard->cursor.num_rows = &shard->num_rows;
+	shard->cursor.cache = &shard->cache;
+	shard->cursor.shard = shard;
+
+	if (pthread_setspecific(shards->key, shard) != 0) {
+		ptab__mem_shard_free(p, shard);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&shards->lock);
+
+	if (shards->tail)
+		shards->tail->next = shard;
+	else
+		shards->head = shard;
+
+	shards->tail = shard;
+
+	pthread_mutex_unlock(&shards->lock);
+
+	return shard;
+}
+
+struct ptab_cursor *ptab__shard_cursor(ptab_t *p)
+{
+	struct ptab_shard *shard;
+
+	assert(p != NULL);
+
+	if (!p->shards.enabled)
+		return &p->cursor;
+
+	shard = pthread_getspecific(p->shards.key);
+	if (!shard)
+		shard = shard_create(p);
+
+	return shard ? &shard->cursor : NULL;
+}
+
+/* true if any thread has rows in the table, or is adding one */
+bool ptab__shard_busy(const ptab_t *p)
+{
+	const struct ptab_shard *shard;
+
+	for (shard = p->shards.head; shard; shard = shard->next) {
+		if (shard->num_rows > 0 || shard->cursor.chunk)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * move the rows the threads have finished onto the end of the table,
+ * one thread's rows after another; this must not run while rows are
+ * being added
+ */
+void ptab__shard_merge(ptab_t *p)
+{
+	struct ptab_shard *shard;
+
+	assert(p != NULL);
+
+	for (shard = p->shards.head; shard; shard = shard->next) {
+		if (!shard->rows.head)
+			continue;
+
+		if (p->rows.tail)
+			p->rows.tail->next = shard->rows.head;
+		else
+			p->rows.head = shard->rows.head;
+
+		p->rows.tail = shard->rows.tail;
+		p->num_rows += shard->num_rows;
+
+		/*
+		 * the shard's last chunk now belongs to the table, so
+		 * its next row starts a new one
+		 */
+		shard->rows.head = NULL;
+		shard->rows.tail = NULL;
+		shard->num_rows = 0;
+	}
+}
+
+/* drop every thread's rows, keeping the shards for reuse */
+void ptab__shard_reset(ptab_t *p)
+{
+	struct ptab_shard *shard;
+
+	assert(p != NULL);
+
+	for (shard = p->shards.head; shard; shard = shard->next) {
+		ptab__mem_shard_rewind(p, shard);
+
+		shard->rows.head = NULL;
+		shard->rows.tail = NULL;
+		shard->rows.capacity = 0;
+		shard->rows.row_bytes = 0;
+		shard->num_rows = 0;
+		shard->cursor.chunk = NULL;
+		shard->cursor.column = NULL;
+	}
+}
+
+void ptab__shard_free(ptab_t *p)
+{
+	struct ptab_shard *shard, *next;
+
+	assert(p != NULL);
+
+	if (!p->shards.enabled)
+		return;
+
+	for (shard = p->shards.head; shard; shard = next) {
+		next = shard->next;
+		ptab__mem_shard_free(p, shard);
+	}
+
+	pthread_key_delete(p->shards.key);
+	pthread_mutex_destroy(&p->shards.lock);
+
+	p->shards.head = NULL;
+	p->shards.tail = NULL;
+	p->shards.enabled = false;
+}
+
+int ptab_concurrent(ptab_t *p)
+{
+	if (!p)
+		return PTAB_ENULL;
+
+	if (p->shards.enabled)
+		return PTAB_OK;
+
+	/* rows that are already in the table stay single threaded */
+	if (p->num_rows > 0 || p->cursor.chunk || p->load.active || p->spill.limit)
+		return PTAB_EORDER;
+
+	if (pthread_key_create(&p->shards.key, NULL) != 0)
+		return PTAB_EMEM;
+
+	if (pthread_mutex_init(&p->shards.lock, NULL) != 0) {
+		pthread_key_delete(p->shards.key);
+		return PTAB_EMEM;
+	}
+
+	p->shards.enabled = true;
+
+	return PTAB_OK;
+}
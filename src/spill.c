@@ -0,0 +1,289 @@
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#ifdef PTAB_HAVE_MKSTEMP
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <ptab.h>
+#include "internal.h"
+
+#define SPILL_PATH_MAX 4096
+
+#ifdef PTAB_HAVE_MKSTEMP
+/*
+ * create a temporary file that is removed from the directory right
+ * away, so that it goes away with the table (or the process)
+ */
+static FILE *spill_open(const char *tmpdir)
+{
+	char path[SPILL_PATH_MAX];
+	FILE *f;
+	int fd, len;
+
+	if (!tmpdir)
+		tmpdir = getenv("TMPDIR");
+
+	if (!tmpdir || !*tmpdir)
+		tmpdir = "/tmp";
+
+	len = snprintf(path, sizeof(path), "%s/ptab-XXXXXX", tmpdir);
+	if (len < 0 || (size_t)len >= sizeof(path))
+		return NULL;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return NULL;
+
+	unlink(path);
+
+	f = fdopen(fd, "w+b");
+	if (!f)
+		close(fd);
+
+	return f;
+}
+#endif
+
+/*
+ * each cell is written as its length followed by its characters;
+ * the rest of the row is only needed while the row is in memory
+ */
+static int spill_write_row(FILE *f,
+			   const ptab_t *p,
+			   const struct ptab_chunk *chunk,
+			   unsigned int row)
+{
+	struct ptab_col *col;
+	const struct ptab_cell *cell;
+	char buf[FORMAT_BUF_SIZE];
+	const char *str;
+	uint32_t len;
+
+	for (col = p->columns_head; col; col = col->next) {
+		cell = &chunk->cells[chunk_cell(chunk, col->id, row)];
+		len = cell->len;
+
+		/*
+		 * borrowed, dictionary and lazy cells are written out as
+		 * text, so they come back as normal cells
+		 */
+		if (cell_flags(chunk, cell) & CELL_LAZY) {
+			ptab__format_cell(col, chunk->values[chunk_cell(chunk, col->value_id, row)],
+					  buf, sizeof(buf));
+			str = buf;
+		} else {
+			str = cell_str(col, chunk, cell);
+		}
+
+		if (fwrite(&len, sizeof(len), 1, f) != 1)
+			return PTAB_EIO;
+
+		if (fwrite(str, 1, len, f) != len)
+			return PTAB_EIO;
+	}
+
+	return PTAB_OK;
+}
+
+/*
+ * move every row that is in memory to the end of the spill file and
+ * reuse the memory they were using
+ */
+int ptab__spill_rows(ptab_t *p)
+{
+	assert(p != NULL);
+
+#ifdef PTAB_HAVE_MKSTEMP
+	struct spill_internal *spill = &p->spill;
+	const struct ptab_chunk *chunk;
+	unsigned int row, num_rows = 0;
+	off_t start;
+
+	assert(spill->file != NULL);
+
+	start = ftello(spill->file);
+	if (start < 0)
+		goto fail;
+
+	for (chunk = p->rows.head; chunk; chunk = chunk->next) {
+		for (row = 0; row < chunk->num_rows; row++) {
+			if (spill_write_row(spill->file, p, chunk, row) != PTAB_OK)
+				goto fail;
+		}
+
+		num_rows += chunk->num_rows;
+	}
+
+	if (fflush(spill->file) != 0)
+		goto fail;
+
+	spill->num_rows += num_rows;
+	spill->bytes = 0;
+
+	p->rows.head = NULL;
+	p->rows.tail = NULL;
+
+	/* the dictionaries' values were in the memory that was reused */
+	ptab__mem_rewind(p);
+	ptab__dict_reset(p);
+
+	return PTAB_OK;
+
+fail:
+	/*
+	 * the rows are all still in memory, so cut off whatever made
+	 * it into the file and stop trying to spill
+	 */
+	clearerr(spill->file);
+
+	if (start >= 0 && ftruncate(fileno(spill->file), start) == 0)
+		fseeko(spill->file, start, SEEK_SET);
+
+	spill->limit = 0;
+
+	return PTAB_EIO;
+#else
+	return PTAB_ESUPPORT;
+#endif
+}
+
+/* throw away the spilled rows, keeping the file for more */
+void ptab__spill_discard(ptab_t *p)
+{
+	assert(p != NULL);
+
+	struct spill_internal *spill = &p->spill;
+
+#ifdef PTAB_HAVE_MKSTEMP
+	if (spill->file && spill->num_rows > 0) {
+		rewind(spill->file);
+
+		if (ftruncate(fileno(spill->file), 0) != 0)
+			spill->limit = 0;
+	}
+#endif
+
+	spill->bytes = 0;
+	spill->num_rows = 0;
+}
+
+void ptab__spill_close(ptab_t *p)
+{
+	assert(p != NULL);
+
+	if (p->spill.file)
+		fclose(p->spill.file);
+
+	p->spill.file = NULL;
+}
+
+int ptab__spill_read_begin(const ptab_t *p)
+{
+	assert(p != NULL);
+
+	if (p->spill.num_rows == 0)
+		return PTAB_OK;
+
+#ifdef PTAB_HAVE_MKSTEMP
+	if (fflush(p->spill.file) != 0 || fseeko(p->spill.file, 0, SEEK_SET) != 0)
+		return PTAB_EIO;
+#endif
+
+	return PTAB_OK;
+}
+
+/*
+ * read the next spilled row into the first row of chunk; no cell is
+ * longer than its column's width, so the chunk's heap must have room
+ * for the sum of the widths
+ */
+int ptab__spill_read_row(const ptab_t *p, struct ptab_chunk *chunk)
+{
+	assert(p != NULL);
+	assert(p->spill.file != NULL);
+
+	FILE *f = p->spill.file;
+	const struct ptab_col *col;
+	struct ptab_cell *cell;
+	uint32_t len;
+
+	chunk->heap_used = 0;
+
+	for (col = p->columns_head; col; col = col->next) {
+		if (fread(&len, sizeof(len), 1, f) != 1 || len > col->width ||
+		    len > chunk->heap_size - chunk->heap_used)
+			return PTAB_EIO;
+
+		if (fread(chunk->heap + chunk->heap_used, 1, len, f) != len)
+			return PTAB_EIO;
+
+		cell = &chunk->cells[chunk_cell(chunk, col->id, 0)];
+		cell_set(chunk, cell, chunk->heap_used, len, 0);
+		chunk->heap_used += len;
+	}
+
+	return PTAB_OK;
+}
+
+/* put the file position back at the end for more rows */
+int ptab__spill_read_end(const ptab_t *p)
+{
+	assert(p != NULL);
+
+	if (p->spill.num_rows == 0)
+		return PTAB_OK;
+
+#ifdef PTAB_HAVE_MKSTEMP
+	if (fseeko(p->spill.file, 0, SEEK_END) != 0)
+		return PTAB_EIO;
+#endif
+
+	return PTAB_OK;
+}
+
+int ptab_set_memory_limit(ptab_t *p, size_t bytes, const char *tmpdir)
+{
+	if (!p)
+		return PTAB_ENULL;
+
+	/* turning spilling off never needs a file */
+	if (bytes == 0) {
+		p->spill.limit = 0;
+		return PTAB_OK;
+	}
+
+	/* the rows of a concurrent table are spread across threads */
+	if (p->shards.enabled)
+		return PTAB_EORDER;
+
+#ifdef PTAB_HAVE_MKSTEMP
+	FILE *f;
+
+	/*
+	 * the file can be moved somewhere else as long as nothing
+	 * has been written to it yet
+	 */
+	if (!p->spill.file || (tmpdir && p->spill.num_rows == 0)) {
+		f = spill_open(tmpdir);
+		if (!f)
+			return PTAB_EIO;
+
+		ptab__spill_close(p);
+		p->spill.file = f;
+	}
+
+	p->spill.limit = bytes;
+
+	return PTAB_OK;
+#else
+	(void)tmpdir;
+	return PTAB_ESUPPORT;
+#endif
+}
@@ -0,0 +1,319 @@
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ptab.h>
+#include "internal.h"
+
+/*
+ * a timestamp is nanoseconds since the epoch, written in UTC with a
+ * strftime-like format whose fields all have a fixed width, so that
+ * the length of a cell is known before it is written. the format is
+ * parsed once into its text, with a gap left for each field. rows tend
+ * to come in time order, so the text of the last minute written is
+ * kept: a timestamp in the same minute only writes its seconds and
+ * their fraction over a copy of it, and the date is only worked out
+ * again when the minute changes
+ */
+
+#define NS_PER_SEC INT64_C(1000000000)
+#define NS_PER_MIN (60 * NS_PER_SEC)
+#define MIN_PER_DAY 1440
+
+/* a timestamp column's format is allocated with its template */
+struct time_format_alloc {
+	struct ptab_col_format format;
+	struct ptab_time_format time;
+};
+
+/* add a field of the given width to the template */
+static int add_field(struct ptab_time_format *t, enum time_field_kind kind,
+		     unsigned int width)
+{
+	struct time_field *field;
+
+	if (t->num_fields == TIME_FIELDS_MAX || t->len + width >= NUM_BUF_SIZE)
+		return PTAB_EFORMAT;
+
+	field = &t->fields[t->num_fields++];
+	field->kind = kind;
+	field->offset = t->len;
+	field->width = width;
+
+	memset(t->text + t->len, '0', width);
+	t->len += width;
+
+	return PTAB_OK;
+}
+
+static int add_char(struct ptab_time_format *t, char c)
+{
+	if (t->len + 1 >= NUM_BUF_SIZE)
+		return PTAB_EFORMAT;
+
+	t->text[t->len++] = c;
+
+	return PTAB_OK;
+}
+
+/* %F, %Y-%m-%d */
+static int add_date(struct ptab_time_format *t)
+{
+	int err;
+
+	err = add_field(t, TIME_YEAR, 4);
+	if (!err)
+		err = add_char(t, '-');
+	if (!err)
+		err = add_field(t, TIME_MONTH, 2);
+	if (!err)
+		err = add_char(t, '-');
+	if (!err)
+		err = add_field(t, TIME_DAY, 2);
+
+	return err;
+}
+
+/* %T, %H:%M:%S */
+static int add_time(struct ptab_time_format *t)
+{
+	int err;
+
+	err = add_field(t, TIME_HOUR, 2);
+	if (!err)
+		err = add_char(t, ':');
+	if (!err)
+		err = add_field(t, TIME_MINUTE, 2);
+	if (!err)
+		err = add_char(t, ':');
+	if (!err)
+		err = add_field(t, TIME_SECOND, 2);
+
+	return err;
+}
+
+/* parse a format into the template, which starts out empty */
+static int parse_time(struct ptab_time_format *t, const char *format)
+{
+	const char *c;
+	int err;
+
+	for (c = format; *c; c++) {
+		if (*c != '%') {
+			err = add_char(t, *c);
+		} else {
+			switch (*++c) {
+			case 'Y':
+				err = add_field(t, TIME_YEAR, 4);
+				break;
+			case 'm':
+				err = add_field(t, TIME_MONTH, 2);
+				break;
+			case 'd':
+				err = add_field(t, TIME_DAY, 2);
+				break;
+			case 'H':
+				err = add_field(t, TIME_HOUR, 2);
+				break;
+			case 'M':
+				err = add_field(t, TIME_MINUTE, 2);
+				break;
+			case 'S':
+				err = add_field(t, TIME_SECOND, 2);
+				break;
+			case 'F':
+				err = add_date(t);
+				break;
+			case 'T':
+				err = add_time(t);
+				break;
+			case 'N':
+				err = add_field(t, TIME_FRACTION, 9);
+				break;
+			case '%':
+				err = add_char(t, '%');
+				break;
+			default:
+				/* %3N and the like, to fewer places */
+				if (*c >= '1' && *c <= '9' && c[1] == 'N') {
+					err = add_field(t, TIME_FRACTION, (unsigned int)(*c - '0'));
+					c++;
+				} else {
+					/* which includes a % at the end */
+					err = PTAB_EFORMAT;
+				}
+				break;
+			}
+		}
+
+		if (err)
+			return err;
+	}
+
+	/* like a printf format, a timestamp's needs a conversion */
+	return t->num_fields > 0 ? PTAB_OK : PTAB_EFORMAT;
+}
+
+int ptab__time_set(ptab_t *p, struct ptab_col *col, const char *format)
+{
+	struct ptab_time_format parsed;
+	struct time_format_alloc *a;
+	int err;
+
+	assert(col->type == PTAB_TIMESTAMP);
+
+	parsed.num_fields = 0;
+	parsed.len = 0;
+
+	err = parse_time(&parsed, format);
+	if (err)
+		return err;
+
+	a = ptab__mem_alloc(p, sizeof(*a));
+	if (!a)
+		return PTAB_EMEM;
+
+	a->time = parsed;
+	a->time.shared = &p->shards.enabled;
+	a->time.cached = false;
+	a->time.minute = 0;
+
+	a->format.prefix = "";
+	a->format.prefix_len = 0;
+	a->format.suffix = "";
+	a->format.suffix_len = 0;
+	a->format.spec[0] = '\0';
+	a->format.kind = FORMAT_TIME;
+	a->format.grouped = false;
+	a->format.places = 0;
+	a->format.time = &a->time;
+
+	col->format = &a->format;
+
+	return PTAB_OK;
+}
+
+static void put_digits(char *buf, unsigned int width, uint32_t v)
+{
+	while (width--) {
+		buf[width] = (char)('0' + v % 10);
+		v /= 10;
+	}
+}
+
+/*
+ * the year, month and day of a day since the epoch, by H. Hinnant's
+ * days_from_civil in reverse; the eras are 400 years long, and start
+ * in March so that a leap day falls at the end of one
+ */
+static void civil_from_days(int64_t z, uint32_t *year, uint32_t *month, uint32_t *day)
+{
+	int64_t era, y;
+	uint32_t doe, yoe, doy, mp;
+
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = (uint32_t)(z - era * 146097);
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	y = (int64_t)yoe + era * 400;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = (uint32_t)(y + (*month <= 2));
+}
+
+/* write the fields down to the minute over a copy of the template */
+static void put_minute(const struct ptab_time_format *t, int64_t minute, char *buf)
+{
+	const struct time_field *field;
+	uint32_t year, month, day, v;
+	int64_t days, of_day;
+	unsigned int i;
+
+	days = minute / MIN_PER_DAY;
+	of_day = minute % MIN_PER_DAY;
+	if (of_day < 0) {
+		days--;
+		of_day += MIN_PER_DAY;
+	}
+
+	civil_from_days(days, &year, &month, &day);
+
+	for (i = 0; i < t->num_fields; i++) {
+		field = &t->fields[i];
+
+		switch (field->kind) {
+		case TIME_YEAR:
+			v = year;
+			break;
+		case TIME_MONTH:
+			v = month;
+			break;
+		case TIME_DAY:
+			v = day;
+			break;
+		case TIME_HOUR:
+			v = (uint32_t)(of_day / 60);
+			break;
+		case TIME_MINUTE:
+			v = (uint32_t)(of_day % 60);
+			break;
+		default:
+			continue;
+		}
+
+		put_digits(buf + field->offset, field->width, v);
+	}
+}
+
+/* write a timestamp's t->len bytes, and no NUL */
+void ptab__time_put(struct ptab_time_format *t, int64_t ns, char *buf)
+{
+	const struct time_field *field;
+	int64_t minute, rem;
+	uint32_t v;
+	unsigned int i, places;
+
+	/* the minute, rounded down, and the nanoseconds into it */
+	minute = ns / NS_PER_MIN;
+	rem = ns % NS_PER_MIN;
+	if (rem < 0) {
+		minute--;
+		rem += NS_PER_MIN;
+	}
+
+	/* the columns of a concurrent table are shared, and can't keep it */
+	if (*t->shared) {
+		memcpy(buf, t->text, t->len);
+		put_minute(t, minute, buf);
+	} else {
+		if (!t->cached || t->minute != minute) {
+			memcpy(t->last, t->text, t->len);
+			put_minute(t, minute, t->last);
+			t->minute = minute;
+			t->cached = true;
+		}
+
+		memcpy(buf, t->last, t->len);
+	}
+
+	for (i = 0; i < t->num_fields; i++) {
+		field = &t->fields[i];
+
+		if (field->kind == TIME_SECOND) {
+			v = (uint32_t)(rem / NS_PER_SEC);
+		} else if (field->kind == TIME_FRACTION) {
+			/* which is cut off, not rounded, as a clock would be */
+			v = (uint32_t)(rem % NS_PER_SEC);
+			for (places = 9; places > field->width; places--)
+				v /= 10;
+		} else {
+			continue;
+		}
+
+		put_digits(buf + field->offset, field->width, v);
+	}
+}
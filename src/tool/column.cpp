@@ -1,5 +1,5 @@
 
-#include <sstream>
+#include <cctype>
 
 #include "column.hpp"
 
@@ -16,16 +16,40 @@ Column::~Column()
 {
 }
 
-void Column::update_align(const std::string& val)
+// a value is numeric if it starts with a number, the same as reading
+// it into a double with a stream would accept
+static bool is_numeric(const char *val, size_t len)
 {
-	std::stringstream stream(val);
-	double temp;
-	bool is_numeric = false;
+	size_t i = 0;
+	bool digits = false;
 
-	if (!(stream >> temp).fail())
-		is_numeric = true;
+	while (i < len && std::isspace((unsigned char)val[i]))
+		i++;
 
-	if (!is_numeric && this->align == PTAB_RIGHT)
+	if (i < len && (val[i] == '+' || val[i] == '-'))
+		i++;
+
+	while (i < len && std::isdigit((unsigned char)val[i])) {
+		digits = true;
+		i++;
+	}
+
+	if (i < len && val[i] == '.') {
+		i++;
+
+		while (i < len && std::isdigit((unsigned char)val[i])) {
+			digits = true;
+			i++;
+		}
+	}
+
+	return digits;
+}
+
+void Column::update_align(const char *val, size_t len)
+{
+	// once a column has text in it, it stays left aligned
+	if (this->align == PTAB_RIGHT && !is_numeric(val, len))
 		this->align = PTAB_LEFT;
 }
 
@@ -1,6 +1,7 @@
 #ifndef PTABTOOL_COLUMN_HPP
 #define PTABTOOL_COLUMN_HPP
 
+#include <cstddef>
 #include <string>
 #include <ptab.h>
 
@@ -12,7 +13,7 @@ namespace ptabtool {
 		Column(const std::string& name);
 		virtual ~Column();
 
-		void update_align(const std::string& val);
+		void update_align(const char *val, size_t len);
 		enum ptab_align get_align() const;
 
 
@@ -144,35 +144,39 @@ void Tool::read_rows()
 	std::string line;
 
 	while (std::getline(*(this->in_stream), line)) {
-		std::stringstream line_stream(line);
-		std::string token;
-		std::vector<std::string> tokens;
-
-		while (std::getline(line_stream, token, this->delim)) {
-			if (!token.empty())
-				tokens.push_back(token);
-		}
-
-		if (tokens.size() != this->columns.size())
-			throw std::runtime_error("column count inconsistent");
-
-		// add row to table
-		std::vector<std::string>::const_iterator iter;
+		const char *data = line.data();
+		size_t start, end;
+		unsigned int i = 0;
 		int err;
-		int i;
 
 		err = ptab_begin_row(this->table);
 		if (err)
 			throw std::runtime_error("ptab_begin_row error");
 
-		for (iter = tokens.begin(), i = 0; iter != tokens.end(); iter++, i++) {
-			err = ptab_row_data_s(this->table, (*iter).c_str());
+		// add each token straight from the line, skipping empty
+		// ones the same as the header does
+		for (start = 0; start < line.length(); start = end + 1) {
+			end = line.find(this->delim, start);
+			if (end == std::string::npos)
+				end = line.length();
+
+			if (end == start)
+				continue;
+
+			if (i == this->columns.size())
+				throw std::runtime_error("column count inconsistent");
+
+			err = ptab_row_data_sn(this->table, data + start, end - start);
 			if (err)
-				throw std::runtime_error("ptab_row_data_s error");
+				throw std::runtime_error("ptab_row_data_sn error");
 
-			this->columns[i].update_align(*iter);
+			this->columns[i].update_align(data + start, end - start);
+			i++;
 		}
 
+		if (i != this->columns.size())
+			throw std::runtime_error("column count inconsistent");
+
 		err = ptab_end_row(this->table);
 		if (err)
 			throw std::runtime_error("ptab_end_row error");
@@ -0,0 +1,335 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#define NUM_THREADS 4
+#define THREAD_ROWS 5000
+
+static ptab_t *p;
+static int err;
+
+static void fixture_init(void)
+{
+	p = ptab_init(NULL);
+
+	ptab_column(p, "Thread", PTAB_STRING);
+	ptab_column(p, "Row", PTAB_INTEGER);
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+}
+
+/* each thread writes a name of a different length, and its row count */
+static int add_rows(ptab_t *t, int thread)
+{
+	static const char *names[NUM_THREADS] = {
+		"a", "bb", "ccccccc", "dddd"
+	};
+	int i, ret = PTAB_OK;
+
+	for (i = 0; i < THREAD_ROWS && ret == PTAB_OK; i++) {
+		ret = ptab_begin_row(t);
+		if (ret == PTAB_OK)
+			ret = ptab_row_data_s(t, names[thread]);
+		if (ret == PTAB_OK)
+			ret = ptab_row_data_i(t, "%d", i * (thread + 1));
+		if (ret == PTAB_OK)
+			ret = ptab_end_row(t);
+	}
+
+	return ret;
+}
+
+static int thread_ids[NUM_THREADS];
+
+static void *thread_func(void *arg)
+{
+	int thread = *(int *)arg;
+
+	if (add_rows(p, thread) != PTAB_OK)
+		return (void *)arg;
+
+	return NULL;
+}
+
+static void run_threads(void)
+{
+	pthread_t threads[NUM_THREADS];
+	void *retval;
+	int i;
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		thread_ids[i] = i;
+		pthread_create(&threads[i], NULL, thread_func, &thread_ids[i]);
+	}
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i], &retval);
+		ck_assert(retval == NULL);
+	}
+}
+
+/* check that one thread's rows appear in the order they were added */
+static void assert_thread_order(const ptab_string_t *s, int thread)
+{
+	const char *line = s->str;
+	const char *end = s->str + s->len;
+	char name[16];
+	int value, expected = 0;
+
+	while (line < end) {
+		if (sscanf(line, "| %15s | %d |", name, &value) == 2 &&
+		    name[0] == 'a' + thread) {
+			ck_assert_int_eq(value, expected * (thread + 1));
+			expected++;
+		}
+
+		line = memchr(line, '\n', (size_t)(end - line));
+		if (!line)
+			break;
+
+		line++;
+	}
+
+	ck_assert_int_eq(expected, THREAD_ROWS);
+}
+
+START_TEST (concurrent_threads)
+{
+	ptab_string_t s1, s2;
+	ptab_t *q;
+	int i;
+
+	err = ptab_concurrent(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	run_threads();
+
+	/* the same rows, added by one thread */
+	q = ptab_init(NULL);
+	ptab_column(q, "Thread", PTAB_STRING);
+	ptab_column(q, "Row", PTAB_INTEGER);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		ck_assert_int_eq(add_rows(q, i), PTAB_OK);
+
+	ptab_dumps(p, &s1, PTAB_ASCII);
+	ptab_dumps(q, &s2, PTAB_ASCII);
+
+	/* the widths and row counts came out the same */
+	ck_assert_int_eq(s1.len, s2.len);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		assert_thread_order(&s1, i);
+
+	ptab_free(q);
+}
+END_TEST
+
+START_TEST (concurrent_reset)
+{
+	ptab_string_t s1, s2;
+	ptab_t *q;
+
+	ck_assert_int_eq(ptab_concurrent(p), PTAB_OK);
+
+	run_threads();
+	ck_assert_int_eq(ptab_reset(p), PTAB_OK);
+
+	/* the threads' memory is reused for the next batch */
+	run_threads();
+	ptab_reset(p);
+
+	ck_assert_int_eq(add_rows(p, 2), PTAB_OK);
+
+	q = ptab_init(NULL);
+	ptab_column(q, "Thread", PTAB_STRING);
+	ptab_column(q, "Row", PTAB_INTEGER);
+	ck_assert_int_eq(add_rows(q, 2), PTAB_OK);
+
+	ptab_dumps(p, &s1, PTAB_UNICODE);
+	ptab_dumps(q, &s2, PTAB_UNICODE);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+
+	ptab_free(q);
+}
+END_TEST
+
+START_TEST (concurrent_dict)
+{
+	ptab_string_t s1, s2;
+	ptab_t *q;
+	int i;
+
+	/* the threads share the dictionary */
+	ck_assert_int_eq(ptab_column_dict(p, 0), PTAB_OK);
+	ck_assert_int_eq(ptab_concurrent(p), PTAB_OK);
+
+	run_threads();
+
+	q = ptab_init(NULL);
+	ptab_column(q, "Thread", PTAB_STRING);
+	ptab_column(q, "Row", PTAB_INTEGER);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		ck_assert_int_eq(add_rows(q, i), PTAB_OK);
+
+	ptab_dumps(p, &s1, PTAB_ASCII);
+	ptab_dumps(q, &s2, PTAB_ASCII);
+
+	ck_assert_int_eq(s1.len, s2.len);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		assert_thread_order(&s1, i);
+
+	ptab_reset(p);
+	run_threads();
+
+	ptab_free(q);
+}
+END_TEST
+
+/* the threads share the timestamp column's format, but not its last minute */
+static void *timestamp_func(void *arg)
+{
+	int thread = *(int *)arg;
+	int i, ret = PTAB_OK;
+
+	for (i = 0; i < THREAD_ROWS && ret == PTAB_OK; i++) {
+		ret = ptab_begin_row(p);
+		if (ret == PTAB_OK)
+			ret = ptab_row_data_s(p, "t");
+		if (ret == PTAB_OK)
+			ret = ptab_row_data_ts(p, (int64_t)(thread * THREAD_ROWS + i) * 1000000007);
+		if (ret == PTAB_OK)
+			ret = ptab_end_row(p);
+	}
+
+	return ret == PTAB_OK ? NULL : arg;
+}
+
+static size_t line_len;
+
+static int compare_lines(const void *a, const void *b)
+{
+	return memcmp(a, b, line_len);
+}
+
+START_TEST (concurrent_timestamp)
+{
+	pthread_t threads[NUM_THREADS];
+	ptab_string_t s1, s2;
+	void *retval;
+	size_t line;
+	char *a, *b;
+	ptab_t *q;
+	int i;
+
+	ptab_free(p);
+	p = ptab_init(NULL);
+	ptab_column(p, "Thread", PTAB_STRING);
+	ptab_column(p, "Time", PTAB_TIMESTAMP);
+	ptab_column_format(p, 1, "%F %T.%3N");
+	ck_assert_int_eq(ptab_concurrent(p), PTAB_OK);
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		thread_ids[i] = i;
+		pthread_create(&threads[i], NULL, timestamp_func, &thread_ids[i]);
+	}
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i], &retval);
+		ck_assert(retval == NULL);
+	}
+
+	q = ptab_init(NULL);
+	ptab_column(q, "Thread", PTAB_STRING);
+	ptab_column(q, "Time", PTAB_TIMESTAMP);
+	ptab_column_format(q, 1, "%F %T.%3N");
+
+	for (i = 0; i < NUM_THREADS * THREAD_ROWS; i++) {
+		ptab_begin_row(q);
+		ptab_row_data_s(q, "t");
+		ptab_row_data_ts(q, (int64_t)i * 1000000007);
+		ptab_end_row(q);
+	}
+
+	ptab_dumps(p, &s1, PTAB_ASCII);
+	ptab_dumps(q, &s2, PTAB_ASCII);
+
+	/* the same lines, in whatever order the threads' rows came out */
+	ck_assert_int_eq(s1.len, s2.len);
+	line = (size_t)((const char *)memchr(s1.str, '\n', s1.len) - s1.str) + 1;
+	ck_assert_uint_eq(s1.len % line, 0);
+
+	a = malloc(s1.len);
+	b = malloc(s2.len);
+	memcpy(a, s1.str, s1.len);
+	memcpy(b, s2.str, s2.len);
+	line_len = line;
+	qsort(a, s1.len / line, line, compare_lines);
+	qsort(b, s2.len / line, line, compare_lines);
+	ck_assert(memcmp(a, b, s1.len) == 0);
+
+	free(a);
+	free(b);
+	ptab_free(q);
+}
+END_TEST
+
+START_TEST (concurrent_order)
+{
+	err = ptab_concurrent(NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	/* too late once a row has been started */
+	ptab_begin_row(p);
+	err = ptab_concurrent(p);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	ptab_row_data_s(p, "a");
+	ptab_row_data_i(p, "%d", 1);
+	ptab_end_row(p);
+
+	err = ptab_concurrent(p);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	ptab_reset(p);
+	err = ptab_concurrent(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* no spilling once the rows are spread across threads */
+	err = ptab_set_memory_limit(p, 1 << 20, NULL);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	/* nor new columns once a thread has rows */
+	ck_assert_int_eq(add_rows(p, 0), PTAB_OK);
+	err = ptab_column(p, "Extra", PTAB_STRING);
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+TCase *concurrent_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Concurrent");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, concurrent_threads);
+	tcase_add_test(tc, concurrent_reset);
+	tcase_add_test(tc, concurrent_dict);
+	tcase_add_test(tc, concurrent_timestamp);
+	tcase_add_test(tc, concurrent_order);
+
+	return tc;
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#include "../src/internal.h"
+
+#define NUM_ROWS 5000
+
+static ptab_t *p;
+static ptab_t *q;
+static int err;
+
+static const char *states[] = {
+	"Alabama", "Arkansas", "Louisiana", "", "Mississippi", "Tennessee"
+};
+
+#define NUM_STATES (sizeof(states) / sizeof(states[0]))
+
+static void setup_table(ptab_t *t)
+{
+	ptab_column(t, "State", PTAB_STRING);
+	ptab_column(t, "Count", PTAB_INTEGER);
+	ptab_column(t, "Status", PTAB_STRING);
+}
+
+static void fill_rows(ptab_t *t, int first, int rows)
+{
+	int i;
+
+	for (i = first; i < first + rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, states[(size_t)i % NUM_STATES]);
+		ptab_row_data_i(t, "%d", i);
+		ptab_row_data_s(t, (i % 3) ? "ok" : "failed");
+		ptab_end_row(t);
+	}
+}
+
+/* p keeps its state and status columns as dictionaries, q doesn't */
+static void fixture_init(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	setup_table(p);
+	setup_table(q);
+
+	ptab_column_dict(p, 0);
+	ptab_column_dict(p, 2);
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+	ptab_free(q);
+}
+
+static void assert_same_output(void)
+{
+	ptab_string_t s1, s2;
+
+	ck_assert_int_eq(ptab_dumps(p, &s1, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(ptab_dumps(q, &s2, PTAB_ASCII), PTAB_OK);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+}
+
+START_TEST (dict_default)
+{
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+	unsigned int i;
+	uint32_t used;
+
+	fill_rows(p, 0, NUM_ROWS);
+	fill_rows(q, 0, NUM_ROWS);
+
+	/* each value is kept once, and the cells only have its code */
+	ck_assert_uint_eq(p->columns_head->dict->count, NUM_STATES);
+	ck_assert_uint_eq(p->columns_tail->dict->count, 2);
+
+	chunk = p->rows.head;
+	cell = &chunk->cells[chunk_cell(chunk, 0, 1)];
+	ck_assert(cell_flags(chunk, cell) & CELL_DICT);
+	ck_assert_uint_eq(cell->offset, 1);
+	ck_assert_uint_eq(cell->len, strlen(states[1]));
+	ck_assert(memcmp(cell_str(p->columns_head, chunk, cell), states[1],
+			 strlen(states[1])) == 0);
+
+	/* the dictionary columns take nothing from the string heap */
+	for (i = 0, used = 0; i < chunk->num_rows; i++)
+		used += cell_size(chunk, &chunk->cells[chunk_cell(chunk, 1, i)]);
+
+	ck_assert_uint_eq(chunk->heap_used, used);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (dict_data)
+{
+	static ptab_value_t cells[NUM_ROWS * 3];
+	static const char *names[NUM_ROWS];
+	static int counts[NUM_ROWS];
+	ptab_string_t str;
+	int i;
+
+	/* every way of adding a string goes through the dictionary */
+	for (i = 0; i < 10; i++) {
+		str.str = states[(size_t)i % NUM_STATES];
+		str.len = strlen(str.str);
+
+		ptab_begin_row(p);
+		ck_assert_int_eq(ptab_row_data_str(p, &str), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_i(p, "%d", i), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_s_ref(p, (i % 3) ? "ok" : "failed",
+						     (i % 3) ? 2 : 6), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	for (i = 10; i < 2000; i++) {
+		cells[i * 3].data.s = states[(size_t)i % NUM_STATES];
+		cells[i * 3 + 1].format = "%d";
+		cells[i * 3 + 1].data.i = i;
+		cells[i * 3 + 2].data.s = (i % 3) ? "ok" : "failed";
+	}
+
+	err = ptab_append_rows(p, cells + 30, 1990);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++) {
+		names[i] = states[(size_t)i % NUM_STATES];
+		counts[i] = i;
+	}
+
+	err = ptab_column_data_s(p, 0, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_i(p, 1, "%d", counts + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++)
+		names[i] = (i % 3) ? "ok" : "failed";
+
+	err = ptab_column_data_s(p, 2, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_rows(q, 0, NUM_ROWS);
+
+	ck_assert_uint_eq(p->columns_head->dict->count, NUM_STATES);
+	ck_assert_uint_eq(p->columns_tail->dict->count, 2);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (dict_many)
+{
+	char name[32];
+	int i;
+
+	/* enough distinct values to grow the hash table a few times */
+	for (i = 0; i < NUM_ROWS; i++) {
+		snprintf(name, sizeof(name), "value %d", i % 1000);
+
+		ptab_begin_row(p);
+		ptab_row_data_s(p, name);
+		ptab_row_data_i(p, "%d", i);
+		ptab_row_data_s(p, "ok");
+		ptab_end_row(p);
+
+		ptab_begin_row(q);
+		ptab_row_data_s(q, name);
+		ptab_row_data_i(q, "%d", i);
+		ptab_row_data_s(q, "ok");
+		ptab_end_row(q);
+	}
+
+	ck_assert_uint_eq(p->columns_head->dict->count, 1000);
+	ck_assert(p->columns_head->dict->num_slots * 3 >= 1000 * 4);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (dict_moved)
+{
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+
+	fill_rows(p, 0, 10);
+	fill_rows(q, 0, 10);
+
+	/* the row moves to a new chunk, and its code goes with it */
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "Tennessee");
+	p->cursor.chunk->heap_used = p->cursor.chunk->heap_size;
+	ck_assert_int_eq(ptab_row_data_i(p, "%d", 123456), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_s(p, "ok"), PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	chunk = p->rows.tail;
+	ck_assert(chunk != p->rows.head);
+
+	cell = &chunk->cells[chunk_cell(chunk, 0, 0)];
+	ck_assert(cell_flags(chunk, cell) & CELL_DICT);
+	ck_assert_uint_eq(cell->offset, 5);
+
+	ptab_begin_row(q);
+	ptab_row_data_s(q, "Tennessee");
+	ptab_row_data_i(q, "%d", 123456);
+	ptab_row_data_s(q, "ok");
+	ptab_end_row(q);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (dict_reset)
+{
+	int i;
+
+	/* the values go with the rows, and the memory is reused */
+	for (i = 0; i < 3; i++) {
+		fill_rows(p, 0, NUM_ROWS);
+		ck_assert_uint_eq(p->columns_head->dict->count, NUM_STATES);
+
+		ck_assert_int_eq(ptab_reset(p), PTAB_OK);
+		ck_assert_uint_eq(p->columns_head->dict->count, 0);
+	}
+
+	fill_rows(p, 100, 500);
+	fill_rows(q, 100, 500);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (dict_errors)
+{
+	err = ptab_column_dict(NULL, 0);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_dict(p, 3);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	err = ptab_column_dict(p, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+
+	/* setting it again does nothing */
+	err = ptab_column_dict(p, 0);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_rows(p, 0, 1);
+
+	err = ptab_column_dict(p, 0);
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+START_TEST (dict_nomem)
+{
+	ptab_begin_row(p);
+	ptab__mem_disable(p);
+
+	err = ptab_row_data_s(p, "Alabama");
+	ck_assert_int_eq(err, PTAB_EMEM);
+
+	ptab__mem_enable(p);
+}
+END_TEST
+
+TCase *dict_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Column Dict");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, dict_default);
+	tcase_add_test(tc, dict_data);
+	tcase_add_test(tc, dict_many);
+	tcase_add_test(tc, dict_moved);
+	tcase_add_test(tc, dict_reset);
+	tcase_add_test(tc, dict_errors);
+	tcase_add_test(tc, dict_nomem);
+
+	return tc;
+}
@@ -0,0 +1,631 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#include "../src/internal.h"
+
+#define NUM_ROWS 5000
+
+static ptab_t *p;
+static ptab_t *q;
+static int err;
+
+static void setup_table(ptab_t *t)
+{
+	ptab_column(t, "Name", PTAB_STRING);
+	ptab_column(t, "Distance", PTAB_INTEGER);
+	ptab_column(t, "Ratio", PTAB_FLOAT);
+}
+
+/* rows with the formats given each time, for the table to compare to */
+static void fill_rows(ptab_t *t, int first, int rows)
+{
+	int i;
+
+	for (i = first; i < first + rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 2) ? "somewhere" : "elsewhere");
+		ptab_row_data_i(t, "%d km", i * 37 - 1000);
+		ptab_row_data_f(t, "%.3f", (float)i / 7.0f);
+		ptab_end_row(t);
+	}
+}
+
+/* the same rows for the lazy table, which has formats of its own */
+static void fill_lazy(ptab_t *t, int first, int rows)
+{
+	int i;
+
+	for (i = first; i < first + rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 2) ? "somewhere" : "elsewhere");
+		ptab_row_data_i(t, NULL, i * 37 - 1000);
+		ptab_row_data_f(t, NULL, (float)i / 7.0f);
+		ptab_end_row(t);
+	}
+}
+
+/* add NUM_ROWS rows without formats, each of the ways rows can be added */
+static void fill_data(ptab_t *t)
+{
+	static ptab_value_t cells[NUM_ROWS * 3];
+	static int distances[NUM_ROWS];
+	static float ratios[NUM_ROWS];
+	static const char *names[NUM_ROWS];
+	int i;
+
+	fill_lazy(t, 0, 10);
+
+	for (i = 10; i < 2000; i++) {
+		cells[i * 3].data.s = (i % 2) ? "somewhere" : "elsewhere";
+		cells[i * 3 + 1].format = NULL;
+		cells[i * 3 + 1].data.i = i * 37 - 1000;
+		cells[i * 3 + 2].format = "ignored %d";
+		cells[i * 3 + 2].data.f = (float)i / 7.0f;
+	}
+
+	err = ptab_append_rows(t, cells + 30, 1990);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++) {
+		names[i] = (i % 2) ? "somewhere" : "elsewhere";
+		distances[i] = i * 37 - 1000;
+		ratios[i] = (float)i / 7.0f;
+	}
+
+	err = ptab_column_data_s(t, 0, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_i(t, 1, NULL, distances + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_f(t, 2, NULL, ratios + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+}
+
+/* p formats its numeric columns lazily, q doesn't */
+static void fixture_lazy(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	setup_table(p);
+	setup_table(q);
+
+	ptab_column_lazy(p, 1, "%d km");
+	ptab_column_lazy(p, 2, "%.3f");
+}
+
+/* p has column formats, q doesn't */
+static void fixture_format(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	setup_table(p);
+	setup_table(q);
+
+	ptab_column_format(p, 1, "%d km");
+	ptab_column_format(p, 2, "%.3f");
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+	ptab_free(q);
+}
+
+static void assert_same_output(void)
+{
+	ptab_string_t s1, s2;
+
+	ck_assert_int_eq(ptab_dumps(p, &s1, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(ptab_dumps(q, &s2, PTAB_ASCII), PTAB_OK);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+}
+
+START_TEST (lazy_default)
+{
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+
+	fill_lazy(p, 0, NUM_ROWS);
+	fill_rows(q, 0, NUM_ROWS);
+
+	/* only the values are kept, and the lengths they will have */
+	chunk = p->rows.head;
+	cell = &chunk->cells[chunk_cell(chunk, 1, 0)];
+	ck_assert(cell_flags(chunk, cell) & CELL_LAZY);
+	ck_assert_uint_eq(cell->len, strlen("-1000 km"));
+	ck_assert_int_eq(chunk->values[chunk_cell(chunk, 0, 0)].i, -1000);
+
+	cell = &chunk->cells[chunk_cell(chunk, 2, 3)];
+	ck_assert(cell_flags(chunk, cell) & CELL_LAZY);
+	ck_assert_uint_eq(cell->len, strlen("0.429"));
+
+	/* the names are the only text in the heap */
+	ck_assert_uint_eq(chunk->heap_used, chunk->num_rows * 9);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (lazy_data)
+{
+	/* every way of adding a number leaves the formatting for later */
+	fill_data(p);
+	fill_rows(q, 0, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (lazy_formats)
+{
+	char longer[200];
+	int i;
+
+	memset(longer, 'x', sizeof(longer));
+	memcpy(longer + 150, "%d", 3);
+
+	/* only a format that is written here can be lazy */
+	ptab_free(p);
+	ptab_free(q);
+
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	for (i = 0; i < 4; i++) {
+		ptab_column(p, "I", PTAB_INTEGER);
+		ptab_column(q, "I", PTAB_INTEGER);
+	}
+
+	ck_assert_int_eq(ptab_column_lazy(p, 0, "%5d%%"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_lazy(p, 1, "[%i] %%"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_lazy(p, 2, "%x"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_lazy(p, 3, longer), PTAB_OK);
+
+	/* which leaves the column as it was */
+	ck_assert(!p->columns_head->lazy);
+	ck_assert(p->columns_head->format == NULL);
+
+	ck_assert_int_eq(ptab_column_format(p, 0, "%5d%%"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_format(p, 2, "%x"), PTAB_OK);
+
+	ck_assert(p->columns_head->format->kind == FORMAT_PRINTF);
+	ck_assert(p->columns_head->next->format->kind == FORMAT_INT);
+
+	for (i = -500; i < 500; i += 7) {
+		ptab_begin_row(p);
+		ptab_row_data_i(p, NULL, i * 1001);
+		ptab_row_data_i(p, NULL, i * 1001);
+		ptab_row_data_i(p, NULL, i * 1001);
+		ptab_row_data_i(p, NULL, i * 1001);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+		ptab_begin_row(q);
+		ptab_row_data_i(q, "%5d%%", i * 1001);
+		ptab_row_data_i(q, "[%i] %%", i * 1001);
+		ptab_row_data_i(q, "%x", i * 1001);
+		ptab_row_data_i(q, longer, i * 1001);
+		ptab_end_row(q);
+	}
+
+	/* an INT_MIN has the most digits */
+	ptab_begin_row(p);
+	ptab_row_data_i(p, NULL, INT_MIN);
+	ptab_row_data_i(p, NULL, INT_MIN);
+	ptab_row_data_i(p, NULL, INT_MIN);
+	ptab_row_data_i(p, NULL, INT_MIN);
+	ptab_end_row(p);
+
+	ptab_begin_row(q);
+	ptab_row_data_i(q, "%5d%%", INT_MIN);
+	ptab_row_data_i(q, "[%i] %%", INT_MIN);
+	ptab_row_data_i(q, "%x", INT_MIN);
+	ptab_row_data_i(q, longer, INT_MIN);
+	ptab_end_row(q);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (lazy_moved)
+{
+	char s[2048];
+
+	memset(s, 'x', sizeof(s) - 1);
+	s[sizeof(s) - 1] = '\0';
+
+	fill_lazy(p, 0, 10);
+	fill_rows(q, 0, 10);
+
+	/* the values move with the row */
+	ptab_begin_row(p);
+	ptab_row_data_s(p, s);
+	ptab_row_data_i(p, NULL, 123456);
+	p->cursor.chunk->heap_used = p->cursor.chunk->heap_size;
+	ck_assert_int_eq(ptab_row_data_f(p, NULL, 2.5f), PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	ptab_begin_row(q);
+	ptab_row_data_s(q, s);
+	ptab_row_data_i(q, "%d km", 123456);
+	ptab_row_data_f(q, "%.3f", 2.5f);
+	ptab_end_row(q);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (lazy_reset)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		fill_lazy(p, 0, NUM_ROWS);
+		ck_assert_int_eq(ptab_reset(p), PTAB_OK);
+	}
+
+	fill_lazy(p, 100, 500);
+	fill_rows(q, 100, 500);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (lazy_errors)
+{
+	int distance[1] = { 1 };
+
+	err = ptab_column_lazy(NULL, 1, "%d");
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_lazy(p, 1, NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_lazy(p, 3, "%d");
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	err = ptab_column_lazy(p, 0, "%d");
+	ck_assert_int_eq(err, PTAB_ETYPE);
+
+	/* a column that isn't lazy still needs a format */
+	ptab_begin_row(q);
+	ptab_row_data_s(q, "here");
+	err = ptab_row_data_i(q, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_data_i(q, 1, NULL, distance, 1);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	fill_lazy(p, 0, 1);
+
+	err = ptab_column_lazy(p, 1, "%d");
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+START_TEST (lazy_nomem)
+{
+	ptab__mem_disable(q);
+
+	err = ptab_column_lazy(q, 1, "%d");
+	ck_assert_int_eq(err, PTAB_EMEM);
+	ck_assert(!q->columns_head->next->lazy);
+
+	ptab__mem_enable(q);
+}
+END_TEST
+
+TCase *lazy_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Column Lazy");
+	tcase_add_checked_fixture(tc, fixture_lazy, fixture_free);
+	tcase_add_test(tc, lazy_default);
+	tcase_add_test(tc, lazy_data);
+	tcase_add_test(tc, lazy_formats);
+	tcase_add_test(tc, lazy_moved);
+	tcase_add_test(tc, lazy_reset);
+	tcase_add_test(tc, lazy_errors);
+	tcase_add_test(tc, lazy_nomem);
+
+	return tc;
+}
+
+START_TEST (format_default)
+{
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+
+	fill_lazy(p, 0, NUM_ROWS);
+	fill_rows(q, 0, NUM_ROWS);
+
+	/* the cells are formatted as they are added, the same as q's */
+	chunk = p->rows.head;
+	cell = &chunk->cells[chunk_cell(chunk, 1, 0)];
+	ck_assert(!(cell_flags(chunk, cell) & CELL_LAZY));
+	ck_assert_uint_eq(cell->len, strlen("-1000 km"));
+	ck_assert(memcmp(chunk_str(chunk, cell), "-1000 km", 8) == 0);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (format_data)
+{
+	fill_data(p);
+	fill_rows(q, 0, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (format_parse)
+{
+	static const char *formats[] = {
+		"%5d%%", "[%i] %%", "%%%x%%", "%-8o|", "%+06d", "%#X"
+	};
+	const struct ptab_col_format *f;
+	unsigned int i, n = sizeof(formats) / sizeof(formats[0]);
+	char longer[200];
+	int v;
+
+	memset(longer, 'x', sizeof(longer));
+	memcpy(longer + 100, "%d", 3);
+
+	ptab_free(p);
+	ptab_free(q);
+
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	for (i = 0; i <= n; i++) {
+		ptab_column(p, "I", PTAB_INTEGER);
+		ptab_column(q, "I", PTAB_INTEGER);
+		ck_assert_int_eq(ptab_column_format(p, i, i < n ? formats[i] : longer),
+				 PTAB_OK);
+	}
+
+	ptab_column(p, "F", PTAB_FLOAT);
+	ptab_column(q, "F", PTAB_FLOAT);
+	ck_assert_int_eq(ptab_column_format(p, n + 1, "~%+10.2e%%"), PTAB_OK);
+
+	/* the text around the conversion is kept apart, with %% unescaped */
+	f = p->columns_head->next->format;
+	ck_assert_uint_eq(f->prefix_len, 1);
+	ck_assert(memcmp(f->prefix, "[", 1) == 0);
+	ck_assert_uint_eq(f->suffix_len, 3);
+	ck_assert(memcmp(f->suffix, "] %", 3) == 0);
+	ck_assert_str_eq(f->spec, "%i");
+	ck_assert(f->kind == FORMAT_INT);
+
+	ck_assert_str_eq(p->columns_head->format->spec, "%5d");
+	ck_assert(p->columns_head->format->kind == FORMAT_PRINTF);
+
+	for (v = -100000; v < 100000; v += 997) {
+		ptab_begin_row(p);
+		ptab_begin_row(q);
+
+		for (i = 0; i <= n; i++) {
+			ptab_row_data_i(p, NULL, v);
+			ptab_row_data_i(q, i < n ? formats[i] : longer, v);
+		}
+
+		ptab_row_data_f(p, NULL, (float)v / 3.0f);
+		ptab_row_data_f(q, "~%+10.2e%%", (float)v / 3.0f);
+
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(q), PTAB_OK);
+	}
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (format_cut)
+{
+	struct ptab_col *col = p->columns_head->next;
+	union ptab_cell_value v;
+	char buf[8];
+
+	/* text that doesn't fit is cut off the same way snprintf does it */
+	v.i = 123456;
+
+	ck_assert_int_eq(ptab__format_cell(col, v, buf, sizeof(buf)), 9);
+	ck_assert_str_eq(buf, "123456 ");
+
+	ck_assert_int_eq(ptab__format_cell(col, v, buf, 4), 9);
+	ck_assert_str_eq(buf, "123");
+
+	ck_assert_int_eq(ptab__format_cell(col, v, buf, 1), 9);
+	ck_assert_str_eq(buf, "");
+}
+END_TEST
+
+/* the plain int kernel, as a row's cell goes straight into the heap */
+static void assert_plain(int i)
+{
+	char buf[FORMAT_BUF_SIZE], want[FORMAT_BUF_SIZE];
+	union ptab_cell_value v;
+	size_t len;
+
+	v.i = i;
+	len = ptab__format_int_len(&ptab__format_plain, PTAB_INTEGER, v);
+	ck_assert_uint_eq(len, (size_t)snprintf(want, sizeof(want), "%d", i));
+
+	memset(buf, 'x', sizeof(buf));
+	ptab__format_int_put(&ptab__format_plain, PTAB_INTEGER, v, buf, len);
+	ck_assert(buf[len] == 'x');
+	buf[len] = '\0';
+	ck_assert_str_eq(buf, want);
+}
+
+START_TEST (format_int)
+{
+	static const int edges[] = {
+		0, 1, -1, 9, 10, 99, 100, 999999999, 1000000000, -1000000000,
+		INT_MAX, INT_MAX - 1, INT_MIN, INT_MIN + 1
+	};
+	char buf[FORMAT_BUF_SIZE];
+	union ptab_cell_value v;
+	unsigned int k;
+	long long n;
+	int i;
+
+	/* the plain kernel agrees with printf across every digit count */
+	for (k = 0; k < sizeof(edges) / sizeof(edges[0]); k++)
+		assert_plain(edges[k]);
+
+	for (n = 1; n <= INT_MAX; n *= 10) {
+		for (i = -1; i <= 1; i++) {
+			if (n + i > INT_MAX)
+				continue;
+
+			assert_plain((int)(n + i));
+			assert_plain((int)-(n + i));
+		}
+	}
+
+	for (i = -200000; i < 200000; i += 13)
+		assert_plain(i * 1009);
+
+	/* and it is cut off like printf too */
+	v.i = -123456;
+	ck_assert_int_eq(ptab__format_value(&ptab__format_plain, PTAB_INTEGER, v, buf, 4), 7);
+	ck_assert_str_eq(buf, "-12");
+}
+END_TEST
+
+START_TEST (format_grouped)
+{
+	static const struct {
+		int i;
+		const char *s;
+	} cases[] = {
+		{ 0, "<0>" },
+		{ 999, "<999>" },
+		{ -999, "<-999>" },
+		{ 1000, "<1,000>" },
+		{ -1000, "<-1,000>" },
+		{ 123456, "<123,456>" },
+		{ 1234567, "<1,234,567>" },
+		{ INT_MAX, "<2,147,483,647>" },
+		{ INT_MIN, "<-2,147,483,648>" }
+	};
+	static const char expected_output[] =
+		"+------+--------------+-------+\n"
+		"| Name | Distance     | Ratio |\n"
+		"+------+--------------+-------+\n"
+		"| here | <-1,234,567> | 1.000 |\n"
+		"+------+--------------+-------+\n";
+	struct ptab_col *col = p->columns_head->next;
+	union ptab_cell_value v;
+	char buf[FORMAT_BUF_SIZE];
+	ptab_string_t str;
+	unsigned int k;
+
+	err = ptab_column_format(p, 1, "<%'d>");
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert(col->format->kind == FORMAT_INT && col->format->grouped);
+
+	for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		v.i = cases[k].i;
+		ck_assert_int_eq(ptab__format_cell(col, v, buf, sizeof(buf)),
+				 (int)strlen(cases[k].s));
+		ck_assert_str_eq(buf, cases[k].s);
+		ck_assert_int_eq(ptab__format_len(col, v), (int)strlen(cases[k].s));
+	}
+
+	/* grouping anything but a bare %'d is left to printf and the locale */
+	ck_assert_int_eq(ptab_column_format(p, 1, "%'5d"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 2, "%'.2f"), PTAB_EFORMAT);
+
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "here");
+	ck_assert_int_eq(ptab_row_data_i(p, NULL, -1234567), PTAB_OK);
+	ptab_row_data_f(p, NULL, 1.0f);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	ck_assert_int_eq(ptab_dumps(p, &str, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(str.len, strlen(expected_output));
+	ck_assert(strncmp(str.str, expected_output, str.len) == 0);
+}
+END_TEST
+
+START_TEST (format_errors)
+{
+	static const char *bad[] = {
+		"", "none", "%", "%d%d", "%d %i", "%ld", "%hd", "%*d", "%.*d",
+		"%s", "%f", "%n", "%5", "%d%", "%0000000000000000000000d"
+	};
+	unsigned int i;
+
+	err = ptab_column_format(NULL, 1, "%d");
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_format(p, 1, NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_format(p, 3, "%d");
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	err = ptab_column_format(p, 0, "%d");
+	ck_assert_int_eq(err, PTAB_ETYPE);
+
+	/* a format needs one conversion, for the column's type */
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		err = ptab_column_format(p, 1, bad[i]);
+		ck_assert_msg(err == PTAB_EFORMAT, "format \"%s\"", bad[i]);
+	}
+
+	err = ptab_column_format(p, 2, "%d");
+	ck_assert_int_eq(err, PTAB_EFORMAT);
+
+	err = ptab_column_lazy(p, 2, "%.2f %%d");
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* the earlier format is still there */
+	ck_assert_str_eq(p->columns_head->next->format->spec, "%d");
+
+	fill_lazy(p, 0, 1);
+
+	err = ptab_column_format(p, 1, "%d");
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+START_TEST (format_nomem)
+{
+	ptab__mem_disable(q);
+
+	err = ptab_column_format(q, 1, "%d");
+	ck_assert_int_eq(err, PTAB_EMEM);
+	ck_assert(q->columns_head->next->format == NULL);
+
+	ptab__mem_enable(q);
+}
+END_TEST
+
+TCase *format_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Column Format");
+	tcase_add_checked_fixture(tc, fixture_format, fixture_free);
+	tcase_add_test(tc, format_default);
+	tcase_add_test(tc, format_data);
+	tcase_add_test(tc, format_parse);
+	tcase_add_test(tc, format_cut);
+	tcase_add_test(tc, format_int);
+	tcase_add_test(tc, format_grouped);
+	tcase_add_test(tc, format_errors);
+	tcase_add_test(tc, format_nomem);
+
+	return tc;
+}
@@ -1,4 +1,5 @@
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -39,6 +40,33 @@ static void free_func(void *ptr, void *opaque)
 	free(ptr);
 }
 
+static size_t outstanding;
+static unsigned int misaligned;
+
+static void *alloc2_func(size_t size, size_t align, void *opaque)
+{
+	void *ptr;
+
+	(void)opaque;
+
+	ptr = malloc(size);
+	if ((uintptr_t)ptr & (align - 1))
+		misaligned++;
+
+	outstanding += size;
+
+	return ptr;
+}
+
+static void free2_func(void *ptr, size_t size, size_t align, void *opaque)
+{
+	(void)align;
+	(void)opaque;
+
+	outstanding -= size;
+	free(ptr);
+}
+
 START_TEST (init_default)
 {
 	p = ptab_init(NULL);
@@ -91,6 +119,69 @@ START_TEST (init_null_allocator)
 }
 END_TEST
 
+START_TEST (init2_allocator)
+{
+	ptab_allocator2_t pa;
+	int i;
+
+	pa.version = PTAB_ALLOCATOR_VERSION;
+	pa.alloc_func = alloc2_func;
+	pa.free_func = free2_func;
+	pa.realloc_func = NULL;
+	pa.opaque = NULL;
+
+	outstanding = 0;
+	misaligned = 0;
+
+	p = ptab_init2(&pa);
+	ck_assert(p != NULL);
+
+	ptab_column(p, "Value", PTAB_INTEGER);
+
+	for (i = 0; i < 10000; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_i(p, "%d", i);
+		ptab_end_row(p);
+	}
+
+	/* every free must be given the size that was allocated */
+	ptab_free(p);
+	p = NULL;
+	ck_assert_int_eq(outstanding, 0);
+	ck_assert_int_eq(misaligned, 0);
+}
+END_TEST
+
+START_TEST (init2_invalid)
+{
+	ptab_allocator2_t pa;
+
+	p = ptab_init2(NULL);
+	ck_assert(p == NULL);
+
+	pa.version = 1;
+	pa.alloc_func = alloc2_func;
+	pa.free_func = free2_func;
+	pa.realloc_func = NULL;
+	pa.opaque = NULL;
+
+	p = ptab_init2(&pa);
+	ck_assert(p == NULL);
+
+	pa.version = PTAB_ALLOCATOR_VERSION;
+	pa.alloc_func = NULL;
+
+	p = ptab_init2(&pa);
+	ck_assert(p == NULL);
+
+	pa.alloc_func = alloc2_func;
+	pa.free_func = NULL;
+
+	p = ptab_init2(&pa);
+	ck_assert(p == NULL);
+}
+END_TEST
+
 TCase *init_test_case(void)
 {
 	TCase *tc;
@@ -101,6 +192,8 @@ TCase *init_test_case(void)
 	tcase_add_test(tc, init_default);
 	tcase_add_test(tc, init_nomem);
 	tcase_add_test(tc, init_null_allocator);
+	tcase_add_test(tc, init2_allocator);
+	tcase_add_test(tc, init2_invalid);
 
 	return tc;
 }
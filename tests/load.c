@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#include "../src/internal.h"
+
+#define NUM_ROWS 5000
+
+static ptab_t *p;
+static ptab_t *q;
+static int err;
+
+static const char *names[NUM_ROWS];
+static int counts[NUM_ROWS];
+static float ratios[NUM_ROWS];
+
+static void setup_table(ptab_t *t)
+{
+	ptab_column(t, "Name", PTAB_STRING);
+	ptab_column(t, "Count", PTAB_INTEGER);
+	ptab_column(t, "Ratio", PTAB_FLOAT);
+}
+
+/* the same data as the arrays, added a row at a time */
+static void fill_rows(ptab_t *t, int first, int rows)
+{
+	int i;
+
+	for (i = first; i < first + rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, names[i]);
+		ptab_row_data_i(t, "%d", counts[i]);
+		ptab_row_data_f(t, "%.3f", ratios[i]);
+		ptab_end_row(t);
+	}
+}
+
+static int load_rows(ptab_t *t, int first, int rows)
+{
+	int ret;
+
+	ret = ptab_column_data_s(t, 0, names + first, (size_t)rows);
+	if (ret == PTAB_OK)
+		ret = ptab_column_data_i(t, 1, "%d", counts + first, (size_t)rows);
+	if (ret == PTAB_OK)
+		ret = ptab_column_data_f(t, 2, "%.3f", ratios + first, (size_t)rows);
+
+	return ret;
+}
+
+static void fixture_init(void)
+{
+	static const char *words[] = {
+		"a", "somewhat longer name", "mid-sized", ""
+	};
+	int i;
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		names[i] = words[i % 4];
+		counts[i] = i * 37 - 1000;
+		ratios[i] = (float)i / 9.0f;
+	}
+
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	setup_table(p);
+	setup_table(q);
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+	ptab_free(q);
+}
+
+static void assert_same_output(void)
+{
+	ptab_string_t s1, s2;
+
+	ck_assert_int_eq(ptab_dumps(p, &s1, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(ptab_dumps(q, &s2, PTAB_ASCII), PTAB_OK);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+}
+
+START_TEST (load_default)
+{
+	err = load_rows(p, 0, NUM_ROWS);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_rows(q, 0, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (load_pieces)
+{
+	/* columns can be loaded in any order and any number of calls */
+	err = ptab_column_data_f(p, 2, "%.3f", ratios, NUM_ROWS);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_column_data_s(p, 0, names, 1000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_s(p, 0, names + 1000, NUM_ROWS - 1000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_column_data_i(p, 1, "%d", counts, 17);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_i(p, 1, "%d", counts + 17, NUM_ROWS - 17);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_rows(q, 0, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (load_with_rows)
+{
+	/* loaded rows go after the rows already in the table */
+	fill_rows(p, 0, 10);
+	load_rows(p, 10, 3000);
+	fill_rows(p, 3010, 10);
+	load_rows(p, 3020, NUM_ROWS - 3020);
+
+	err = ptab_column_data_i(p, 1, "%d", counts, 0);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_rows(q, 0, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (load_mismatch)
+{
+	ptab_string_t s;
+
+	ptab_column_data_s(p, 0, names, 10);
+	ptab_column_data_i(p, 1, "%d", counts, 10);
+	ptab_column_data_f(p, 2, "%.3f", ratios, 5);
+
+	err = ptab_dumps(p, &s, PTAB_ASCII);
+	ck_assert_int_eq(err, PTAB_ECOLUMNS);
+
+	err = ptab_begin_row(p);
+	ck_assert_int_eq(err, PTAB_ECOLUMNS);
+
+	/* evening out the columns finishes the load */
+	ptab_column_data_f(p, 2, "%.3f", ratios + 5, 5);
+	fill_rows(q, 0, 10);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (load_errors)
+{
+	err = ptab_column_data_s(NULL, 0, names, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_data_s(p, 0, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_data_i(p, 1, NULL, counts, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_column_data_s(p, 3, names, 1);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	err = ptab_column_data_s(p, 1, names, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+
+	err = ptab_column_data_f(p, 1, "%f", ratios, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+
+	/* not while a row is being added */
+	ptab_begin_row(p);
+
+	err = ptab_column_data_i(p, 1, "%d", counts, 1);
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+START_TEST (load_columns)
+{
+	ptab_column_data_s(p, 0, names, 1);
+
+	/* the schema is done once rows are loaded */
+	err = ptab_column(p, "Late", PTAB_STRING);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	err = ptab_concurrent(p);
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+START_TEST (load_reset)
+{
+	ptab_column_data_s(p, 0, names, 100);
+
+	/* a load that was never finished is dropped */
+	err = ptab_reset(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = load_rows(p, 0, 100);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_rows(q, 0, 100);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (load_nomem)
+{
+	ptab_t *t;
+
+	t = ptab_init(NULL);
+	setup_table(t);
+
+	ptab__mem_disable(t);
+
+	err = ptab_column_data_s(t, 0, names, NUM_ROWS);
+	ck_assert_int_eq(err, PTAB_EMEM);
+
+	ptab__mem_enable(t);
+	ptab_free(t);
+}
+END_TEST
+
+TCase *load_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Column Data");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, load_default);
+	tcase_add_test(tc, load_pieces);
+	tcase_add_test(tc, load_with_rows);
+	tcase_add_test(tc, load_mismatch);
+	tcase_add_test(tc, load_errors);
+	tcase_add_test(tc, load_columns);
+	tcase_add_test(tc, load_reset);
+	tcase_add_test(tc, load_nomem);
+
+	return tc;
+}
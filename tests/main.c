@@ -11,13 +11,29 @@ test_case_generator test_cases[] = {
 	error_test_case,
 	init_test_case,
 	free_test_case,
+	mem_test_case,
+	pool_test_case,
 	column_test_case,
 	begin_row_test_case,
 	row_data_s_test_case,
+	row_data_s_ref_test_case,
 	row_data_i_test_case,
 	row_data_f_test_case,
 	end_row_test_case,
+	reserve_test_case,
+	append_rows_test_case,
+	load_test_case,
+	dict_test_case,
+	lazy_test_case,
+	format_test_case,
+	number_test_case,
+	int64_test_case,
+	decimal_test_case,
+	timestamp_test_case,
 	output_test_case,
+	reset_test_case,
+	spill_test_case,
+	concurrent_test_case,
 	NULL
 };
 
@@ -0,0 +1,364 @@
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#include "../src/internal.h"
+
+static ptab_t *p;
+
+static void fixture_init(void)
+{
+	p = ptab_init(NULL);
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+}
+
+START_TEST (mem_alloc_aligned)
+{
+	void *ptr;
+	int i;
+
+	for (i = 1; i < 32; i++) {
+		ptab__mem_alloc_str(p, (size_t)i);
+
+		ptr = ptab__mem_alloc(p, (size_t)i);
+		ck_assert(ptr != NULL);
+		ck_assert(((uintptr_t)ptr % sizeof(void *)) == 0);
+		ck_assert(((uintptr_t)ptr % sizeof(double)) == 0);
+	}
+}
+END_TEST
+
+START_TEST (mem_alloc_large)
+{
+	const size_t size = 1 << 20;
+	unsigned char *ptr;
+
+	ptr = ptab__mem_alloc(p, size);
+	ck_assert(ptr != NULL);
+
+	/* make sure the entire allocation is usable */
+	memset(ptr, 0xab, size);
+	ck_assert(ptr[size - 1] == 0xab);
+	ck_assert(p->mem.cache.total_used >= size);
+}
+END_TEST
+
+START_TEST (mem_alloc_reuse)
+{
+	unsigned int num_blocks;
+	int i;
+
+	/*
+	 * a large allocation gets a block of its own, so the space
+	 * left in the root block should still be used afterwards
+	 */
+	ptab__mem_alloc(p, 100000);
+	num_blocks = p->mem.cache.num_blocks;
+
+	for (i = 0; i < 16; i++)
+		ck_assert(ptab__mem_alloc_str(p, 64) != NULL);
+
+	ck_assert_int_eq(p->mem.cache.num_blocks, num_blocks);
+}
+END_TEST
+
+START_TEST (mem_alloc_many)
+{
+	size_t total = 0;
+	char *str;
+	int i;
+
+	for (i = 0; i < 200000; i++) {
+		str = ptab__mem_alloc_str(p, (size_t)(i % 40) + 1);
+		ck_assert(str != NULL);
+
+		str[i % 40] = '\0';
+		total += (size_t)(i % 40) + 1;
+	}
+
+	ck_assert(p->mem.cache.total_used >= total);
+
+	/* blocks grow geometrically, so there shouldn't be many */
+	ck_assert(p->mem.cache.num_blocks < 16);
+}
+END_TEST
+
+START_TEST (mem_stats_default)
+{
+	ptab_mem_stats_t stats;
+	int err;
+
+	err = ptab_mem_stats(p, &stats);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* a new table is just the root block */
+	ck_assert_int_eq(stats.used, 0);
+	ck_assert_int_eq(stats.blocks, 1);
+	ck_assert(stats.reserved > 0);
+	ck_assert_int_eq(stats.reserved, stats.largest_block);
+	ck_assert_int_eq(stats.peak, stats.reserved);
+}
+END_TEST
+
+START_TEST (mem_stats_null)
+{
+	ptab_mem_stats_t stats;
+	int err;
+
+	err = ptab_mem_stats(NULL, &stats);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_mem_stats(p, NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (mem_stats_usage)
+{
+	ptab_mem_stats_t before, after;
+	ptab_string_t s;
+	int i;
+
+	ptab_column(p, "Name", PTAB_STRING);
+
+	for (i = 0; i < 10000; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, "0123456789");
+		ptab_end_row(p);
+	}
+
+	ptab_mem_stats(p, &before);
+
+	/* the strings alone take 11 bytes each */
+	ck_assert(before.used >= 10000 * 11);
+	ck_assert(before.used <= before.reserved);
+	ck_assert(before.wasted <= before.reserved - before.used);
+	ck_assert(before.blocks > 1);
+	ck_assert(before.largest_block <= before.reserved);
+
+	/* output blocks are counted while they are held */
+	ptab_dumps(p, &s, PTAB_ASCII);
+	ptab_mem_stats(p, &after);
+	ck_assert_int_eq(after.used, before.used + s.len);
+	ck_assert_int_eq(after.blocks, before.blocks + 1);
+	ck_assert(after.reserved > before.reserved);
+
+	ptab_free_string(p, &s);
+	ptab_mem_stats(p, &after);
+	ck_assert_int_eq(after.used, before.used);
+
+	/* a reset gives back the row memory but not the peak */
+	ptab_reset(p);
+	ptab_mem_stats(p, &after);
+	ck_assert(after.used < 1024);
+	ck_assert(after.peak >= before.reserved);
+	ck_assert(after.reserved <= after.peak);
+}
+END_TEST
+
+static void fill_table(ptab_t *p, int rows)
+{
+	int i;
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 3) ? "mapped" : "memory");
+		ptab_row_data_i(p, "%d", i);
+		ptab_end_row(p);
+	}
+}
+
+START_TEST (mem_map_default)
+{
+	ptab_string_t s1, s2;
+	ptab_t *q;
+	int err;
+
+	err = ptab_mem_map(p, 64 << 20, 0);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* the same table built without the mapping */
+	q = ptab_init(NULL);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Value", PTAB_INTEGER);
+	ptab_column(q, "Name", PTAB_STRING);
+	ptab_column(q, "Value", PTAB_INTEGER);
+
+	fill_table(p, 50000);
+	fill_table(q, 50000);
+
+	/* everything should fit in the mapping */
+	ck_assert(p->mem.cache.current == p->mem.map);
+
+	ptab_dumps(p, &s1, PTAB_ASCII);
+	ptab_dumps(q, &s2, PTAB_ASCII);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+
+	ptab_free(q);
+}
+END_TEST
+
+START_TEST (mem_map_release)
+{
+	ptab_mem_stats_t stats;
+	int err;
+
+	err = ptab_mem_map(p, 16 << 20, PTAB_MAP_HUGEPAGE | PTAB_MAP_RELEASE);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Value", PTAB_INTEGER);
+
+	fill_table(p, 20000);
+	ptab_reset(p);
+
+	/* the released pages come back zeroed and usable */
+	fill_table(p, 20000);
+	ck_assert_int_eq(p->num_rows, 20000);
+
+	ptab_clear(p);
+	ptab_mem_stats(p, &stats);
+	ck_assert_int_eq(stats.used, 0);
+	ck_assert(stats.reserved >= 16 << 20);
+}
+END_TEST
+
+START_TEST (mem_map_errors)
+{
+	int err;
+
+	err = ptab_mem_map(NULL, 1 << 20, 0);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_mem_map(p, 0, 0);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	ptab__mem_disable(p);
+	err = ptab_mem_map(p, 1 << 20, 0);
+	ck_assert_int_eq(err, PTAB_EMEM);
+	ptab__mem_enable(p);
+
+	err = ptab_mem_map(p, 1 << 20, 0);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* only one mapping per table */
+	err = ptab_mem_map(p, 1 << 20, 0);
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+/*
+ * an allocator that hands out fixed size regions, so that any block
+ * can be grown in place up to the size of its region
+ */
+#define REGION_SIZE (16 << 20)
+
+static unsigned int region_allocs;
+static unsigned int region_grows;
+
+static void *region_alloc(size_t size, size_t align, void *opaque)
+{
+	(void)align;
+	(void)opaque;
+
+	if (size > REGION_SIZE)
+		return NULL;
+
+	region_allocs++;
+	return malloc(REGION_SIZE);
+}
+
+static void region_free(void *ptr, size_t size, size_t align, void *opaque)
+{
+	(void)size;
+	(void)align;
+	(void)opaque;
+
+	free(ptr);
+}
+
+static void *
+region_realloc(void *ptr, size_t old_size, size_t new_size, size_t align, void *opaque)
+{
+	(void)old_size;
+	(void)align;
+	(void)opaque;
+
+	if (new_size > REGION_SIZE)
+		return NULL;
+
+	region_grows++;
+	return ptr;
+}
+
+START_TEST (mem_grow_in_place)
+{
+	ptab_allocator2_t pa;
+	ptab_string_t s1, s2;
+	ptab_t *q;
+
+	pa.version = PTAB_ALLOCATOR_VERSION;
+	pa.alloc_func = region_alloc;
+	pa.free_func = region_free;
+	pa.realloc_func = region_realloc;
+	pa.opaque = NULL;
+
+	region_allocs = 0;
+	region_grows = 0;
+
+	q = ptab_init2(&pa);
+	ck_assert(q != NULL);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Value", PTAB_INTEGER);
+	ptab_column(q, "Name", PTAB_STRING);
+	ptab_column(q, "Value", PTAB_INTEGER);
+
+	fill_table(p, 50000);
+	fill_table(q, 50000);
+
+	/* the second block keeps growing instead of new ones being made */
+	ck_assert(region_grows > 0);
+	ck_assert_int_eq(q->mem.cache.num_blocks, 2);
+
+	ptab_dumps(p, &s1, PTAB_ASCII);
+	ptab_dumps(q, &s2, PTAB_ASCII);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+
+	ptab_free(q);
+}
+END_TEST
+
+TCase *mem_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Memory");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, mem_alloc_aligned);
+	tcase_add_test(tc, mem_alloc_large);
+	tcase_add_test(tc, mem_alloc_reuse);
+	tcase_add_test(tc, mem_alloc_many);
+	tcase_add_test(tc, mem_stats_default);
+	tcase_add_test(tc, mem_stats_null);
+	tcase_add_test(tc, mem_stats_usage);
+	tcase_add_test(tc, mem_map_default);
+	tcase_add_test(tc, mem_map_release);
+	tcase_add_test(tc, mem_map_errors);
+	tcase_add_test(tc, mem_grow_in_place);
+
+	return tc;
+}
@@ -0,0 +1,1274 @@
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#include "../src/internal.h"
+
+#define NUM_ROWS 5000
+
+static ptab_t *p;
+static ptab_t *q;
+static int err;
+
+static uint64_t seed = 88172645463325252u;
+
+/* a random double, from any bit pattern that isn't a nan or infinity */
+static double random_double(void)
+{
+	uint64_t bits;
+	double d;
+
+	do {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		bits = seed;
+		memcpy(&d, &bits, sizeof(d));
+	} while (isnan(d) || isinf(d));
+
+	return d;
+}
+
+/* the significant digits of a number's text, without leading or trailing zeros */
+static void digits_of(const char *s, char *digits)
+{
+	size_t n = 0;
+
+	for (; *s && *s != 'e'; s++) {
+		if (*s >= '0' && *s <= '9' && (n > 0 || *s != '0'))
+			digits[n++] = *s;
+	}
+
+	while (n > 0 && digits[n - 1] == '0')
+		n--;
+
+	digits[n] = '\0';
+}
+
+/*
+ * check that the shortest text reads back as the same double, and has
+ * the same digits as the fewest that printf needs to do that
+ */
+static void assert_shortest(double d)
+{
+	char buf[NUM_BUF_SIZE], want[NUM_BUF_SIZE];
+	char got_digits[NUM_BUF_SIZE], want_digits[NUM_BUF_SIZE];
+	double back;
+	size_t len;
+	int places;
+
+	len = ptab__num_shortest(d, buf);
+	ck_assert(len < NUM_BUF_SIZE);
+	buf[len] = '\0';
+
+	back = strtod(buf, NULL);
+	ck_assert_msg(memcmp(&back, &d, sizeof(d)) == 0, "%s is not %.17g", buf, d);
+
+	for (places = 0; places < 17; places++) {
+		snprintf(want, sizeof(want), "%.*e", places, d);
+		if (strtod(want, NULL) == d)
+			break;
+	}
+
+	digits_of(buf, got_digits);
+	digits_of(want, want_digits);
+	ck_assert_msg(strcmp(got_digits, want_digits) == 0, "%s is not %s", buf, want);
+}
+
+static void assert_fixed(double d, unsigned int places)
+{
+	char buf[NUM_BUF_SIZE], want[NUM_BUF_SIZE];
+	size_t len;
+
+	len = ptab__num_fixed(d, places, buf);
+	ck_assert_uint_eq(ptab__num_fixed_len(d, places), len);
+
+	/* which is left to printf when it can't be done here */
+	if (len == 0)
+		return;
+
+	buf[len] = '\0';
+	snprintf(want, sizeof(want), "%.*f", (int)places, d);
+	ck_assert_msg(strcmp(buf, want) == 0, "%s is not %s", buf, want);
+}
+
+/* the double next to d, in the direction of up */
+static double next_double(double d, int up)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &d, sizeof(d));
+	bits = (up == (d > 0)) ? bits + 1 : bits - 1;
+	memcpy(&d, &bits, sizeof(d));
+
+	return d;
+}
+
+/* d with the exponent changed to e, which is a lot closer to 1 */
+static double with_exponent(double d, int e)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &d, sizeof(d));
+	bits = (bits & ~(UINT64_C(0x7ff) << 52)) | ((uint64_t)(e + 1023) << 52);
+	memcpy(&d, &bits, sizeof(d));
+
+	return d;
+}
+
+static void setup_table(ptab_t *t)
+{
+	ptab_column(t, "Name", PTAB_STRING);
+	ptab_column(t, "Mean", PTAB_DOUBLE);
+	ptab_column(t, "Rate", PTAB_DOUBLE);
+}
+
+static double mean_of(int i)
+{
+	return (double)i / 7.0 - 100.0;
+}
+
+static double rate_of(int i)
+{
+	return (double)i / 8.0;
+}
+
+/* rows with printf's idea of each format, for the table to compare to */
+static void fill_printf(ptab_t *t, int rows)
+{
+	char buf[NUM_BUF_SIZE];
+	int i;
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 2) ? "somewhere" : "elsewhere");
+		snprintf(buf, sizeof(buf), "%.3f", mean_of(i));
+		ptab_row_data_s(t, buf);
+		/* the shortest text of these has a few digits at most */
+		snprintf(buf, sizeof(buf), "%g", rate_of(i));
+		ptab_row_data_s(t, buf);
+		ptab_end_row(t);
+	}
+}
+
+static void fixture_init(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	setup_table(p);
+
+	ptab_column(q, "Name", PTAB_STRING);
+	ptab_column(q, "Mean", PTAB_STRING);
+	ptab_column(q, "Rate", PTAB_STRING);
+	ptab_column_align(q, 1, PTAB_RIGHT);
+	ptab_column_align(q, 2, PTAB_RIGHT);
+}
+
+/* a table of 64-bit counters, and the strings printf makes of them */
+static void fixture_int64(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Offset", PTAB_INT64);
+	ptab_column(p, "Bytes", PTAB_UINT64);
+
+	ptab_column(q, "Name", PTAB_STRING);
+	ptab_column(q, "Offset", PTAB_STRING);
+	ptab_column(q, "Bytes", PTAB_STRING);
+	ptab_column_align(q, 1, PTAB_RIGHT);
+	ptab_column_align(q, 2, PTAB_RIGHT);
+}
+
+static int64_t offset_of(int i)
+{
+	return (i % 2 ? -1 : 1) * (INT64_MAX >> (i % 63));
+}
+
+static uint64_t bytes_of(int i)
+{
+	return UINT64_MAX / ((uint64_t)i * 7919u + 1);
+}
+
+static void fill_int64_printf(ptab_t *t, int rows, const char *suffix)
+{
+	char buf[NUM_BUF_SIZE];
+	int i;
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 2) ? "somewhere" : "elsewhere");
+		snprintf(buf, sizeof(buf), "%" PRId64, offset_of(i));
+		ptab_row_data_s(t, buf);
+		snprintf(buf, sizeof(buf), "%" PRIu64 "%s", bytes_of(i), suffix);
+		ptab_row_data_s(t, buf);
+		ptab_end_row(t);
+	}
+}
+
+/* prices to the cent and rates to the hundredth of a percent */
+static void fixture_decimal(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column_decimal(p, "Price", 2);
+	ptab_column_decimal(p, "Rate", 4);
+
+	ptab_column(q, "Name", PTAB_STRING);
+	ptab_column(q, "Price", PTAB_STRING);
+	ptab_column(q, "Rate", PTAB_STRING);
+	ptab_column_align(q, 1, PTAB_RIGHT);
+	ptab_column_align(q, 2, PTAB_RIGHT);
+}
+
+/* how a decimal should look, from its integer and fraction parts */
+static void decimal_text(char *buf, size_t size, int64_t v, unsigned int scale)
+{
+	uint64_t u = v < 0 ? 0u - (uint64_t)v : (uint64_t)v;
+	uint64_t pow10 = 1;
+	unsigned int i;
+	int len;
+
+	for (i = 0; i < scale; i++)
+		pow10 *= 10;
+
+	if (scale == 0)
+		len = snprintf(buf, size, "%s%" PRIu64, v < 0 ? "-" : "", u);
+	else
+		len = snprintf(buf, size, "%s%" PRIu64 ".%0*" PRIu64, v < 0 ? "-" : "",
+			       u / pow10, (int)scale, u % pow10);
+
+	ck_assert(len > 0 && (size_t)len < size);
+}
+
+static int64_t price_of(int i)
+{
+	return (int64_t)(i % 3 - 1) * i * i * 101;
+}
+
+static int64_t rate_of_dec(int i)
+{
+	return (int64_t)i * 37 - 5000;
+}
+
+static void fill_decimal_printf(ptab_t *t, int rows, const char *price_format)
+{
+	/* with room for the text of the format around the price */
+	char buf[2 * NUM_BUF_SIZE], text[NUM_BUF_SIZE];
+	int i;
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 2) ? "somewhere" : "elsewhere");
+		decimal_text(text, sizeof(text), price_of(i), 2);
+		snprintf(buf, sizeof(buf), price_format, text);
+		ptab_row_data_s(t, buf);
+		decimal_text(buf, sizeof(buf), rate_of_dec(i), 4);
+		ptab_row_data_s(t, buf);
+		ptab_end_row(t);
+	}
+}
+
+/* a table of timestamps, to the second and to the microsecond */
+static void fixture_timestamp(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Time", PTAB_TIMESTAMP);
+	ptab_column(p, "Stamp", PTAB_TIMESTAMP);
+	ptab_column_format(p, 2, "%Y%m%dT%H%M%S.%6NZ");
+
+	ptab_column(q, "Name", PTAB_STRING);
+	ptab_column(q, "Time", PTAB_STRING);
+	ptab_column(q, "Stamp", PTAB_STRING);
+	ptab_column_align(q, 1, PTAB_RIGHT);
+	ptab_column_align(q, 2, PTAB_RIGHT);
+}
+
+/*
+ * how a timestamp should look, from gmtime and strftime, with places
+ * digits of its fraction after a point if there are any
+ */
+static void timestamp_text(char *buf, int64_t ns, const char *format, unsigned int places)
+{
+	int64_t secs = ns / 1000000000, frac = ns % 1000000000;
+	unsigned int i;
+	size_t len;
+	time_t t;
+
+	if (frac < 0) {
+		secs--;
+		frac += 1000000000;
+	}
+
+	t = (time_t)secs;
+	len = strftime(buf, NUM_BUF_SIZE, format, gmtime(&t));
+
+	if (places > 0) {
+		for (i = places; i < 9; i++)
+			frac /= 10;
+
+		snprintf(buf + len, NUM_BUF_SIZE - len, ".%0*" PRId64, (int)places, frac);
+	}
+}
+
+/* rows in time order, a few of them to a minute, and some before 1970 */
+static int64_t time_of(int i)
+{
+	return INT64_C(1700000000000000000) + (int64_t)i * INT64_C(17123456789);
+}
+
+static int64_t stamp_of(int i)
+{
+	return INT64_C(-315619200000000000) + (int64_t)i * INT64_C(123456789);
+}
+
+static void fill_timestamp_printf(ptab_t *t, int rows, const char *time_format)
+{
+	char buf[NUM_BUF_SIZE];
+	int i;
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 2) ? "somewhere" : "elsewhere");
+		timestamp_text(buf, time_of(i), time_format, 0);
+		ptab_row_data_s(t, buf);
+		timestamp_text(buf, stamp_of(i), "%Y%m%dT%H%M%S", 6);
+		strcat(buf, "Z");
+		ptab_row_data_s(t, buf);
+		ptab_end_row(t);
+	}
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+	ptab_free(q);
+}
+
+static void assert_same_output(void)
+{
+	ptab_string_t s1, s2;
+
+	ck_assert_int_eq(ptab_dumps(p, &s1, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(ptab_dumps(q, &s2, PTAB_ASCII), PTAB_OK);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+}
+
+START_TEST (number_shortest)
+{
+	static const double edges[] = {
+		1.0, 0.1, 0.2, 0.3, 1.0 / 3.0, 2.0 / 3.0, 123456.789, 1e-4, 9.999e-5,
+		1e15, 1e16, 9007199254740993.0, 1e21, 1e22, 1e23, 5e-324, 1e-323,
+		2.2250738585072009e-308, DBL_MIN, DBL_MAX, DBL_EPSILON, 299792458.0,
+		1.7976931348623157e308, 4.9406564584124654e-324, 0.30000000000000004
+	};
+	char buf[NUM_BUF_SIZE];
+	unsigned int k;
+	double d;
+	int i;
+
+	for (k = 0; k < sizeof(edges) / sizeof(edges[0]); k++) {
+		assert_shortest(edges[k]);
+		assert_shortest(-edges[k]);
+	}
+
+	for (i = -323; i <= 308; i++) {
+		snprintf(buf, sizeof(buf), "1e%d", i);
+		d = strtod(buf, NULL);
+
+		assert_shortest(d);
+		assert_shortest(next_double(d, 0));
+		assert_shortest(next_double(d, 1));
+	}
+
+	for (i = 0; i < 200000; i++)
+		assert_shortest(random_double());
+
+	/* and the values that aren't numbers are spelled out */
+	buf[ptab__num_shortest(0.0, buf)] = '\0';
+	ck_assert_str_eq(buf, "0");
+	buf[ptab__num_shortest(-0.0, buf)] = '\0';
+	ck_assert_str_eq(buf, "-0");
+	buf[ptab__num_shortest(HUGE_VAL, buf)] = '\0';
+	ck_assert_str_eq(buf, "inf");
+	buf[ptab__num_shortest(-HUGE_VAL, buf)] = '\0';
+	ck_assert_str_eq(buf, "-inf");
+	buf[ptab__num_shortest(NAN, buf)] = '\0';
+	ck_assert_str_eq(buf, "nan");
+
+	/* with no more than it takes */
+	buf[ptab__num_shortest(100.0, buf)] = '\0';
+	ck_assert_str_eq(buf, "100");
+	buf[ptab__num_shortest(0.5, buf)] = '\0';
+	ck_assert_str_eq(buf, "0.5");
+	buf[ptab__num_shortest(1e-5, buf)] = '\0';
+	ck_assert_str_eq(buf, "1e-05");
+	buf[ptab__num_shortest(1.5e300, buf)] = '\0';
+	ck_assert_str_eq(buf, "1.5e+300");
+}
+END_TEST
+
+START_TEST (number_fixed)
+{
+	static const double ties[] = {
+		0.125, 0.375, 2.5, 3.5, -2.5, 0.5, 1.5, 1e-7, 0.0, -0.0, 0.05, 1.005,
+		4503599627370495.5, 9007199254740992.0, 1e300, -1e-300
+	};
+	char buf[NUM_BUF_SIZE];
+	unsigned int k, places;
+	double d;
+	int i;
+
+	for (places = 0; places <= NUM_FIXED_MAX; places++) {
+		for (k = 0; k < sizeof(ties) / sizeof(ties[0]); k++)
+			assert_fixed(ties[k], places);
+
+		for (i = 0; i < 20000; i++) {
+			d = random_double();
+			assert_fixed(d, places);
+
+			/* most values of interest are a lot closer to 1 */
+			d = with_exponent(d, (int)(seed % 64) - 20);
+			assert_fixed(d, places);
+			assert_fixed((double)(int32_t)seed / 1000.0, places);
+		}
+	}
+
+	/* and values too big to round here are left to printf */
+	ck_assert_uint_eq(ptab__num_fixed(1e300, 2, buf), 0);
+	ck_assert_uint_eq(ptab__num_fixed(1e10, 9, buf), 0);
+	ck_assert_uint_eq(ptab__num_fixed(NAN, 2, buf), 0);
+	ck_assert_uint_eq(ptab__num_fixed(HUGE_VAL, 2, buf), 0);
+}
+END_TEST
+
+START_TEST (number_default)
+{
+	int i;
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		ptab_begin_row(p);
+		ck_assert_int_eq(ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere"),
+				 PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_d(p, "%.3f", mean_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_d(p, NULL, rate_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	fill_printf(q, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (number_data)
+{
+	static ptab_value_t cells[NUM_ROWS * 3];
+	static double means[NUM_ROWS], rates[NUM_ROWS];
+	static const char *names[NUM_ROWS];
+	int i;
+
+	/* every way of adding a double goes the same way */
+	for (i = 0; i < 2000; i++) {
+		cells[i * 3].data.s = (i % 2) ? "somewhere" : "elsewhere";
+		cells[i * 3 + 1].format = "%.3f";
+		cells[i * 3 + 1].data.d = mean_of(i);
+		cells[i * 3 + 2].format = NULL;
+		cells[i * 3 + 2].data.d = rate_of(i);
+	}
+
+	err = ptab_append_rows(p, cells, 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++) {
+		names[i] = (i % 2) ? "somewhere" : "elsewhere";
+		means[i] = mean_of(i);
+		rates[i] = rate_of(i);
+	}
+
+	err = ptab_column_data_s(p, 0, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_d(p, 1, "%.3f", means + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_d(p, 2, NULL, rates + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_printf(q, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (number_format)
+{
+	int i;
+
+	/* a column format or a lazy column works the same as one given each time */
+	ck_assert_int_eq(ptab_column_lazy(p, 1, "%.3f"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_format(p, 2, "%g"), PTAB_OK);
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_d(p, "ignored", mean_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_d(p, NULL, rate_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	fill_printf(q, NUM_ROWS);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (number_lazy)
+{
+	struct ptab_col *mean;
+	ptab_string_t s;
+	int i;
+
+	/* a lazy column is measured when it's added, and only formatted when written */
+	ck_assert_int_eq(ptab_column_lazy(p, 1, "%.3f"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_format(p, 2, "%g"), PTAB_OK);
+	mean = p->columns_head->next;
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_d(p, NULL, mean_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_d(p, NULL, rate_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	ck_assert_uint_eq(mean->formatted, 0);
+
+	ck_assert_int_eq(ptab_dumps(p, &s, PTAB_ASCII), PTAB_OK);
+	ck_assert_uint_eq(mean->formatted, NUM_ROWS);
+	ck_assert_int_eq(ptab_free_string(p, &s), PTAB_OK);
+
+	fill_printf(q, NUM_ROWS);
+
+	assert_same_output();
+	ck_assert_uint_eq(mean->formatted, 2 * NUM_ROWS);
+}
+END_TEST
+
+START_TEST (number_printf)
+{
+	char buf[NUM_BUF_SIZE];
+
+	/* a format that isn't common, or a value too big to round, is left to printf */
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "x");
+	ck_assert_int_eq(ptab_row_data_d(p, "%10.2e", 1e-300), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_d(p, "%.2f", 1e20), PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	ptab_begin_row(q);
+	ptab_row_data_s(q, "x");
+	snprintf(buf, sizeof(buf), "%10.2e", 1e-300);
+	ptab_row_data_s(q, buf);
+	snprintf(buf, sizeof(buf), "%.2f", 1e20);
+	ptab_row_data_s(q, buf);
+	ptab_end_row(q);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (number_errors)
+{
+	const struct ptab_chunk *chunk;
+
+	ptab_begin_row(p);
+
+	/* a double is only for a double column, and a float isn't one */
+	err = ptab_row_data_d(p, NULL, 1.0);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_row_data_s(p, "x");
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_row_data_f(p, "%f", 1.0f);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+
+	err = ptab_row_data_d(NULL, NULL, 1.0);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_row_data_d(p, NULL, 0.1);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_row_data_d(p, "%.2f", 1.0 / 3.0);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	/* the values are kept in full */
+	chunk = p->rows.head;
+	ck_assert(chunk->values[chunk_cell(chunk, 0, 0)].f == 0.1);
+	ck_assert(chunk->values[chunk_cell(chunk, 1, 0)].f == 1.0 / 3.0);
+
+	err = ptab_column_data_d(p, 0, NULL, (const double[]){ 1.0 }, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_column_data_d(NULL, 1, NULL, (const double[]){ 1.0 }, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+	err = ptab_column_data_d(p, 1, NULL, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (int64_format)
+{
+	static const int64_t edges[] = {
+		0, 1, -1, 9, -10, INT64_MAX, INT64_MAX - 1, INT64_MIN, INT64_MIN + 1,
+		INT32_MAX, (int64_t)INT32_MAX + 1, INT32_MIN, (int64_t)INT32_MIN - 1
+	};
+	const struct ptab_col_format *f;
+	union ptab_cell_value v;
+	char buf[NUM_BUF_SIZE], want[NUM_BUF_SIZE];
+	unsigned int k;
+	uint64_t u;
+	int i, len;
+
+	/* the plain kernel agrees with printf across every digit count */
+	f = ptab__format_of(p->columns_head->next, "%" PRId64);
+	ck_assert(f && f->kind == FORMAT_INT);
+
+	for (k = 0; k < sizeof(edges) / sizeof(edges[0]); k++) {
+		v.l = edges[k];
+		len = ptab__format_value(f, PTAB_INT64, v, buf, sizeof(buf));
+		ck_assert_int_eq(len, snprintf(want, sizeof(want), "%" PRId64, edges[k]));
+		ck_assert_str_eq(buf, want);
+	}
+
+	f = ptab__format_of(p->columns_tail, "%" PRIu64);
+	ck_assert(f && f->kind == FORMAT_INT);
+
+	for (k = 0, u = 1; k < 20; k++, u *= 10) {
+		for (i = -1; i <= 1; i++) {
+			v.u = u + (uint64_t)i;
+			len = ptab__format_value(f, PTAB_UINT64, v, buf, sizeof(buf));
+			ck_assert_int_eq(len, snprintf(want, sizeof(want), "%" PRIu64, v.u));
+			ck_assert_str_eq(buf, want);
+
+			v.u = UINT64_MAX - u - (uint64_t)i;
+			len = ptab__format_value(f, PTAB_UINT64, v, buf, sizeof(buf));
+			ck_assert_int_eq(len, snprintf(want, sizeof(want), "%" PRIu64, v.u));
+			ck_assert_str_eq(buf, want);
+		}
+	}
+
+	/* and grouped, as long as they get */
+	ck_assert_int_eq(ptab_column_format(p, 1, "%'" PRId64), PTAB_OK);
+	ck_assert_int_eq(ptab_column_format(p, 2, "%'" PRIu64 " B"), PTAB_OK);
+
+	v.l = INT64_MIN;
+	ptab__format_cell(p->columns_head->next, v, buf, sizeof(buf));
+	ck_assert_str_eq(buf, "-9,223,372,036,854,775,808");
+
+	v.u = UINT64_MAX;
+	ptab__format_cell(p->columns_tail, v, buf, sizeof(buf));
+	ck_assert_str_eq(buf, "18,446,744,073,709,551,615 B");
+}
+END_TEST
+
+START_TEST (int64_data)
+{
+	static ptab_value_t cells[NUM_ROWS * 3];
+	static int64_t offsets[NUM_ROWS];
+	static uint64_t bytes[NUM_ROWS];
+	static const char *names[NUM_ROWS];
+	int i;
+
+	/* every way of adding a 64-bit integer goes the same way */
+	for (i = 0; i < 10; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_i64(p, "%" PRId64, offset_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_u64(p, "%" PRIu64 " B", bytes_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	for (i = 10; i < 2000; i++) {
+		cells[i * 3].data.s = (i % 2) ? "somewhere" : "elsewhere";
+		cells[i * 3 + 1].format = "%" PRId64;
+		cells[i * 3 + 1].data.i64 = offset_of(i);
+		cells[i * 3 + 2].format = "%" PRIu64 " B";
+		cells[i * 3 + 2].data.u64 = bytes_of(i);
+	}
+
+	err = ptab_append_rows(p, cells + 30, 1990);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++) {
+		names[i] = (i % 2) ? "somewhere" : "elsewhere";
+		offsets[i] = offset_of(i);
+		bytes[i] = bytes_of(i);
+	}
+
+	err = ptab_column_data_s(p, 0, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_i64(p, 1, "%" PRId64, offsets + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_u64(p, 2, "%" PRIu64 " B", bytes + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_int64_printf(q, NUM_ROWS, " B");
+
+	assert_same_output();
+
+	/* the values are kept in full */
+	ck_assert(p->rows.head->values[chunk_cell(p->rows.head, 0, 1)].l == offset_of(1));
+	ck_assert(p->rows.head->values[chunk_cell(p->rows.head, 1, 1)].u == bytes_of(1));
+}
+END_TEST
+
+START_TEST (int64_lazy)
+{
+	int i;
+
+	/* a lazy column or a column format works the same as one given each time */
+	ck_assert_int_eq(ptab_column_lazy(p, 1, "%" PRId64), PTAB_OK);
+	ck_assert_int_eq(ptab_column_format(p, 2, "%" PRIu64 " B"), PTAB_OK);
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_i64(p, NULL, offset_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_u64(p, NULL, bytes_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	fill_int64_printf(q, NUM_ROWS, " B");
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (int64_printf)
+{
+	char buf[NUM_BUF_SIZE];
+
+	/* a format that isn't plain is left to printf */
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "x");
+	ck_assert_int_eq(ptab_row_data_i64(p, "%#" PRIx64, INT64_MAX), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_u64(p, "%020" PRIu64, UINT64_MAX / 3), PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	ptab_begin_row(q);
+	ptab_row_data_s(q, "x");
+	snprintf(buf, sizeof(buf), "%#" PRIx64, INT64_MAX);
+	ptab_row_data_s(q, buf);
+	snprintf(buf, sizeof(buf), "%020" PRIu64, UINT64_MAX / 3);
+	ptab_row_data_s(q, buf);
+	ptab_end_row(q);
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (int64_errors)
+{
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "x");
+
+	/* a 64-bit integer is only for a column of its own type */
+	err = ptab_row_data_i(p, "%d", 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_row_data_u64(p, "%" PRIu64, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_row_data_i64(p, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+	err = ptab_row_data_i64(NULL, "%" PRId64, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+	err = ptab_row_data_i64(p, "%" PRId64, 1);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_row_data_i64(p, "%" PRId64, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_row_data_u64(p, "%" PRIu64, 1);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	err = ptab_column_data_u64(p, 1, "%" PRIu64, (const uint64_t[]){ 1 }, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_column_data_i64(p, 1, NULL, (const int64_t[]){ 1 }, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+	err = ptab_column_data_i64(p, 1, "%" PRId64, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	/* a column format needs the length of a 64-bit conversion */
+	ptab_free(p);
+	p = ptab_init(NULL);
+	ptab_column(p, "Offset", PTAB_INT64);
+	ptab_column(p, "Bytes", PTAB_UINT64);
+
+	ck_assert_int_eq(ptab_column_format(p, 0, "%d"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 0, "%hd"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 0, "%" PRId64 "%c"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 0, "%'5" PRId64), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%'" PRIx64), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%.3f"), PTAB_EFORMAT);
+
+	ck_assert_int_eq(ptab_column_format(p, 1, "%" PRId64), PTAB_OK);
+	ck_assert(p->columns_tail->format->kind == FORMAT_PRINTF);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%5" PRIx64), PTAB_OK);
+	ck_assert(p->columns_tail->format->kind == FORMAT_PRINTF);
+	ck_assert_int_eq(ptab_column_format(p, 0, "%" PRIi64 " ns"), PTAB_OK);
+	ck_assert(p->columns_head->format->kind == FORMAT_INT);
+}
+END_TEST
+
+START_TEST (decimal_format)
+{
+	static const int64_t edges[] = {
+		0, 1, -1, 5, -5, 9, 10, 99, -100, 12345, -12345, 999999999,
+		INT64_MAX, INT64_MAX - 1, INT64_MIN, INT64_MIN + 1
+	};
+	const struct ptab_col_format *f;
+	union ptab_cell_value v;
+	char buf[NUM_BUF_SIZE], want[NUM_BUF_SIZE];
+	unsigned int k, scale;
+	int64_t d;
+	int len;
+
+	/* the kernel puts the point in the right place for every scale */
+	for (scale = 0; scale <= PTAB_DECIMAL_MAX_SCALE; scale++) {
+		f = ptab__format_decimal(scale);
+		ck_assert(f->kind == FORMAT_DECIMAL && f->places == scale);
+
+		for (k = 0; k < sizeof(edges) / sizeof(edges[0]); k++) {
+			v.l = edges[k];
+			len = ptab__format_value(f, PTAB_DECIMAL, v, buf, sizeof(buf));
+			decimal_text(want, sizeof(want), edges[k], scale);
+			ck_assert_int_eq(len, (int)strlen(want));
+			ck_assert_str_eq(buf, want);
+		}
+
+		for (d = 1; d <= INT64_MAX / 10; d *= 10) {
+			v.l = -(d - 1);
+			ptab__format_value(f, PTAB_DECIMAL, v, buf, sizeof(buf));
+			decimal_text(want, sizeof(want), v.l, scale);
+			ck_assert_str_eq(buf, want);
+
+			v.l = d + 1;
+			ptab__format_value(f, PTAB_DECIMAL, v, buf, sizeof(buf));
+			decimal_text(want, sizeof(want), v.l, scale);
+			ck_assert_str_eq(buf, want);
+		}
+	}
+
+	/* and it is cut off like printf */
+	v.l = -123456;
+	ck_assert_int_eq(ptab__format_value(ptab__format_decimal(3), PTAB_DECIMAL, v, buf, 4), 8);
+	ck_assert_str_eq(buf, "-12");
+}
+END_TEST
+
+START_TEST (decimal_data)
+{
+	static ptab_value_t cells[NUM_ROWS * 3];
+	static int64_t prices[NUM_ROWS], rates[NUM_ROWS];
+	static const char *names[NUM_ROWS];
+	int i;
+
+	/* every way of adding a decimal goes the same way */
+	for (i = 0; i < 10; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_dec(p, price_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_dec(p, rate_of_dec(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	for (i = 10; i < 2000; i++) {
+		cells[i * 3].data.s = (i % 2) ? "somewhere" : "elsewhere";
+		cells[i * 3 + 1].format = NULL;
+		cells[i * 3 + 1].data.i64 = price_of(i);
+		cells[i * 3 + 2].format = "ignored";
+		cells[i * 3 + 2].data.i64 = rate_of_dec(i);
+	}
+
+	err = ptab_append_rows(p, cells + 30, 1990);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++) {
+		names[i] = (i % 2) ? "somewhere" : "elsewhere";
+		prices[i] = price_of(i);
+		rates[i] = rate_of_dec(i);
+	}
+
+	err = ptab_column_data_s(p, 0, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_dec(p, 1, prices + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_dec(p, 2, rates + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_decimal_printf(q, NUM_ROWS, "%s");
+
+	assert_same_output();
+
+	/* the values are kept as they were given */
+	ck_assert(p->rows.head->values[chunk_cell(p->rows.head, 0, 5)].l == price_of(5));
+}
+END_TEST
+
+START_TEST (decimal_lazy)
+{
+	int i;
+
+	/* a decimal's format only adds text, and the column keeps its scale */
+	ck_assert_int_eq(ptab_column_format(p, 1, "$%f"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_lazy(p, 2, "%f"), PTAB_OK);
+	ck_assert_uint_eq(p->columns_head->next->format->places, 2);
+	ck_assert_uint_eq(p->columns_tail->format->places, 4);
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_dec(p, price_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_dec(p, rate_of_dec(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	fill_decimal_printf(q, NUM_ROWS, "$%s");
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (decimal_errors)
+{
+	static const char expected_output[] =
+		"+------+--------+--------+-------+\n"
+		"| Name | Price  | Rate   | Count |\n"
+		"+------+--------+--------+-------+\n"
+		"| x    | -0.05% | 0.0005 |   -42 |\n"
+		"+------+--------+--------+-------+\n";
+	ptab_string_t str;
+
+	err = ptab_column_decimal(p, "Too fine", PTAB_DECIMAL_MAX_SCALE + 1);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+	err = ptab_column_decimal(NULL, "Price", 2);
+	ck_assert_int_eq(err, PTAB_ENULL);
+	err = ptab_column_decimal(p, NULL, 2);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	/* a decimal's format has a bare %f, and nothing for printf */
+	ck_assert_int_eq(ptab_column_format(p, 1, "%.2f"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%5f"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%d"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%" PRId64), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%f%%"), PTAB_OK);
+
+	/* and one made by ptab_column has a scale of 0 */
+	ck_assert_int_eq(ptab_column(p, "Count", PTAB_DECIMAL), PTAB_OK);
+
+	ptab_begin_row(p);
+	ck_assert_int_eq(ptab_row_data_dec(p, 1), PTAB_ETYPE);
+	ptab_row_data_s(p, "x");
+	ck_assert_int_eq(ptab_row_data_i64(p, "%" PRId64, 1), PTAB_ETYPE);
+	ck_assert_int_eq(ptab_row_data_dec(NULL, 1), PTAB_ENULL);
+	ck_assert_int_eq(ptab_row_data_dec(p, -5), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_dec(p, 5), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_dec(p, -42), PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	ck_assert_int_eq(ptab_dumps(p, &str, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(str.len, strlen(expected_output));
+	ck_assert(strncmp(str.str, expected_output, str.len) == 0);
+
+	err = ptab_column_data_dec(p, 0, (const int64_t[]){ 1 }, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_column_data_dec(p, 1, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+/* the timestamp's text through the column's format, which has no more than %F %T.%N */
+static void assert_timestamp(const struct ptab_col_format *f, int64_t ns, unsigned int places)
+{
+	char buf[NUM_BUF_SIZE], want[NUM_BUF_SIZE];
+	union ptab_cell_value v;
+	int len;
+
+	v.l = ns;
+	len = ptab__format_value(f, PTAB_TIMESTAMP, v, buf, sizeof(buf));
+	timestamp_text(want, ns, "%Y-%m-%d %H:%M:%S", places);
+	ck_assert_int_eq(len, (int)strlen(want));
+	ck_assert_str_eq(buf, want);
+	ck_assert_uint_eq(ptab__format_int_len(f, PTAB_TIMESTAMP, v), strlen(want));
+}
+
+START_TEST (timestamp_format)
+{
+	static const int64_t edges[] = {
+		0, 1, -1, 999999999, 1000000000, -1000000000, 59999999999,
+		60000000000, -60000000000, -60000000001, 86399999999999,
+		INT64_C(951782400000000000),   /* 2000-02-29 */
+		INT64_C(-2203891200000000000), /* 1900-03-01 */
+		INT64_C(4107456000000000000),  /* 2100-02-28 */
+		INT64_C(4107542400000000000),  /* 2100-03-01 */
+		INT64_C(1709251199999999999),  /* 2024-02-29 23:59:59 */
+		INT64_MAX, INT64_MIN, INT64_MAX - 59999999999, INT64_MIN + 59999999999
+	};
+	const struct ptab_col_format *f;
+	const bool *shared;
+	bool yes = true;
+	union ptab_cell_value v;
+	char buf[NUM_BUF_SIZE];
+	unsigned int k, places;
+	int64_t ns, minute;
+	int i;
+
+	f = p->columns_head->next->format;
+	ck_assert(f->kind == FORMAT_TIME && format_is_int(f));
+
+	for (places = 0; places <= 9; places++) {
+		if (places == 0) {
+			ck_assert_int_eq(ptab_column_format(p, 1, "%F %T"), PTAB_OK);
+		} else if (places == 9) {
+			ck_assert_int_eq(ptab_column_format(p, 1, "%Y-%m-%d %H:%M:%S.%N"), PTAB_OK);
+		} else {
+			snprintf(buf, sizeof(buf), "%%F %%T.%%%uN", places);
+			ck_assert_int_eq(ptab_column_format(p, 1, buf), PTAB_OK);
+		}
+
+		f = p->columns_head->next->format;
+
+		for (k = 0; k < sizeof(edges) / sizeof(edges[0]); k++)
+			assert_timestamp(f, edges[k], places);
+
+		/* in any order, so that the minute kept is rarely the one wanted */
+		for (i = 0; i < 2000; i++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			assert_timestamp(f, (int64_t)seed, places);
+		}
+
+		/* and in order, when it mostly is, crossing minutes, days and years */
+		for (ns = INT64_C(-1000000000000000); ns < INT64_C(1000000000000000);
+		     ns += INT64_C(777777777777))
+			assert_timestamp(f, ns, places);
+
+		for (ns = INT64_C(1704067140000000000) - 7; ns < INT64_C(1704067260000000000);
+		     ns += INT64_C(999999999))
+			assert_timestamp(f, ns, places);
+	}
+
+	/* a concurrent table's columns don't keep the minute */
+	shared = f->time->shared;
+	minute = f->time->minute;
+	f->time->shared = &yes;
+
+	for (ns = -INT64_C(100000000000); ns < INT64_C(100000000000); ns += INT64_C(3333333333))
+		assert_timestamp(f, ns, 9);
+
+	ck_assert(f->time->minute == minute);
+	f->time->shared = shared;
+
+	/* and it is cut off like printf */
+	v.l = 0;
+	ck_assert_int_eq(ptab__format_value(f, PTAB_TIMESTAMP, v, buf, 5), 29);
+	ck_assert_str_eq(buf, "1970");
+}
+END_TEST
+
+START_TEST (timestamp_data)
+{
+	static ptab_value_t cells[NUM_ROWS * 3];
+	static int64_t times[NUM_ROWS], stamps[NUM_ROWS];
+	static const char *names[NUM_ROWS];
+	int i;
+
+	/* every way of adding a timestamp goes the same way */
+	for (i = 0; i < 10; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_ts(p, time_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_ts(p, stamp_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	for (i = 10; i < 2000; i++) {
+		cells[i * 3].data.s = (i % 2) ? "somewhere" : "elsewhere";
+		cells[i * 3 + 1].format = NULL;
+		cells[i * 3 + 1].data.i64 = time_of(i);
+		cells[i * 3 + 2].format = "ignored";
+		cells[i * 3 + 2].data.i64 = stamp_of(i);
+	}
+
+	err = ptab_append_rows(p, cells + 30, 1990);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 2000; i < NUM_ROWS; i++) {
+		names[i] = (i % 2) ? "somewhere" : "elsewhere";
+		times[i] = time_of(i);
+		stamps[i] = stamp_of(i);
+	}
+
+	err = ptab_column_data_s(p, 0, names + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_ts(p, 1, times + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+	err = ptab_column_data_ts(p, 2, stamps + 2000, NUM_ROWS - 2000);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_timestamp_printf(q, NUM_ROWS, "%Y-%m-%d %H:%M:%S");
+
+	assert_same_output();
+
+	/* the values are kept as they were given */
+	ck_assert(p->rows.head->values[chunk_cell(p->rows.head, 0, 5)].l == time_of(5));
+}
+END_TEST
+
+START_TEST (timestamp_lazy)
+{
+	int i;
+
+	ck_assert_int_eq(ptab_column_lazy(p, 1, "%d/%m/%Y %H:%M"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_lazy(p, 2, "%Y%m%dT%H%M%S.%6NZ"), PTAB_OK);
+
+	for (i = 0; i < NUM_ROWS; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "somewhere" : "elsewhere");
+		ck_assert_int_eq(ptab_row_data_ts(p, time_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_row_data_ts(p, stamp_of(i)), PTAB_OK);
+		ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+	}
+
+	fill_timestamp_printf(q, NUM_ROWS, "%d/%m/%Y %H:%M");
+
+	assert_same_output();
+}
+END_TEST
+
+START_TEST (timestamp_errors)
+{
+	static const char expected_output[] =
+		"+------+-----------------------------------+-------------------------+---------------------+\n"
+		"| Name | Time                              | Stamp                   | When                |\n"
+		"+------+-----------------------------------+-------------------------+---------------------+\n"
+		"| x    | [1969-12-31 23:59:59.999999999] % | 19700101T000001.500000Z | 1970-01-02 00:00:00 |\n"
+		"+------+-----------------------------------+-------------------------+---------------------+\n";
+	ptab_string_t str;
+
+	/* only the fields of a fixed width, and at least one of them */
+	ck_assert_int_eq(ptab_column_format(p, 1, "%s"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%b %d"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%F %"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%0N"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%12N"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%d"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%" PRId64), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "no time"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "100%%"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "%S%S%S%S%S%S%S%S%S%S%S%S%S%S%S%S%S"),
+			 PTAB_EFORMAT);
+
+	/* and no longer than the text of a number */
+	ck_assert_int_eq(ptab_column_format(p, 1, "%F %T.%N %F"), PTAB_EFORMAT);
+	ck_assert_int_eq(ptab_column_format(p, 1, "[%F %T.%N] %%"), PTAB_OK);
+	ck_assert_uint_eq(p->columns_head->next->format->time->len, 33);
+
+	ck_assert_int_eq(ptab_column(p, "When", PTAB_TIMESTAMP), PTAB_OK);
+
+	ptab_begin_row(p);
+	ck_assert_int_eq(ptab_row_data_ts(p, 1), PTAB_ETYPE);
+	ptab_row_data_s(p, "x");
+	ck_assert_int_eq(ptab_row_data_i64(p, "%" PRId64, 1), PTAB_ETYPE);
+	ck_assert_int_eq(ptab_row_data_dec(p, 1), PTAB_ETYPE);
+	ck_assert_int_eq(ptab_row_data_ts(NULL, 1), PTAB_ENULL);
+	ck_assert_int_eq(ptab_row_data_ts(p, -1), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_ts(p, 1500000000), PTAB_OK);
+	ck_assert_int_eq(ptab_row_data_ts(p, INT64_C(86400000000000)), PTAB_OK);
+	ck_assert_int_eq(ptab_end_row(p), PTAB_OK);
+
+	ck_assert_int_eq(ptab_dumps(p, &str, PTAB_ASCII), PTAB_OK);
+	ck_assert_int_eq(str.len, strlen(expected_output));
+	ck_assert(strncmp(str.str, expected_output, str.len) == 0);
+
+	err = ptab_column_data_ts(p, 0, (const int64_t[]){ 1 }, 1);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+	err = ptab_column_data_ts(p, 1, NULL, 1);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+TCase *number_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Number");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, number_shortest);
+	tcase_add_test(tc, number_fixed);
+	tcase_add_test(tc, number_default);
+	tcase_add_test(tc, number_data);
+	tcase_add_test(tc, number_format);
+	tcase_add_test(tc, number_lazy);
+	tcase_add_test(tc, number_printf);
+	tcase_add_test(tc, number_errors);
+
+	return tc;
+}
+
+TCase *int64_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Number Int64");
+	tcase_add_checked_fixture(tc, fixture_int64, fixture_free);
+	tcase_add_test(tc, int64_format);
+	tcase_add_test(tc, int64_data);
+	tcase_add_test(tc, int64_lazy);
+	tcase_add_test(tc, int64_printf);
+	tcase_add_test(tc, int64_errors);
+
+	return tc;
+}
+
+TCase *decimal_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Number Decimal");
+	tcase_add_checked_fixture(tc, fixture_decimal, fixture_free);
+	tcase_add_test(tc, decimal_format);
+	tcase_add_test(tc, decimal_data);
+	tcase_add_test(tc, decimal_lazy);
+	tcase_add_test(tc, decimal_errors);
+
+	return tc;
+}
+
+TCase *timestamp_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Number Timestamp");
+	tcase_add_checked_fixture(tc, fixture_timestamp, fixture_free);
+	tcase_add_test(tc, timestamp_format);
+	tcase_add_test(tc, timestamp_data);
+	tcase_add_test(tc, timestamp_lazy);
+	tcase_add_test(tc, timestamp_errors);
+
+	return tc;
+}
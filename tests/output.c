@@ -1,4 +1,6 @@
 
+#include <stdlib.h>
+
 #include <check.h>
 #include <ptab.h>
 
@@ -196,6 +198,7 @@ START_TEST (output_string_free)
 
 	err = ptab_free_string(p, &string);
 	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert(string.str == NULL);
 
 	/* make sure that it can handle freeing it twice */
 	err = ptab_free_string(p, &string);
@@ -216,9 +219,10 @@ START_TEST (output_string_free_null)
 	err = ptab_free_string(p, NULL);
 	ck_assert_int_eq(err, PTAB_ENULL);
 
+	/* a string with no text has nothing to release */
 	string2.str = NULL;
 	err = ptab_free_string(p, &string2);
-	ck_assert_int_eq(err, PTAB_ENULL);
+	ck_assert_int_eq(err, PTAB_OK);
 
 	err = ptab_free_string(p, &string);
 	ck_assert_int_eq(err, PTAB_OK);
@@ -241,6 +245,96 @@ START_TEST (output_string_free_multi)
 }
 END_TEST
 
+START_TEST (output_string_free_reuse)
+{
+	ptab_string_t str1;
+	ptab_string_t str2;
+	ptab_mem_stats_t before, after;
+	const char *released;
+
+	ptab_dumps(p, &str1, PTAB_ASCII);
+	released = str1.str;
+
+	err = ptab_free_string(p, &str1);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	ptab_mem_stats(p, &before);
+
+	/* the released memory should be used for the next string */
+	err = ptab_dumps(p, &str2, PTAB_ASCII);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert(str2.str == released);
+
+	ptab_mem_stats(p, &after);
+	ck_assert_int_eq(after.reserved, before.reserved);
+}
+END_TEST
+
+START_TEST (output_string_free_other)
+{
+	ptab_string_t str1;
+	ptab_string_t str2;
+	ptab_mem_stats_t before, after;
+	ptab_t *q;
+
+	q = ptab_init(NULL);
+	ptab_column(q, "Other", PTAB_STRING);
+	ptab_dumps(q, &str1, PTAB_ASCII);
+
+	ptab_mem_stats(q, &before);
+
+	/* strings from another table are not released */
+	err = ptab_free_string(p, &str1);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	ptab_mem_stats(q, &after);
+	ck_assert_int_eq(after.used, before.used);
+
+	ptab_dumps(p, &str2, PTAB_ASCII);
+	ck_assert(str2.str != str1.str);
+
+	ptab_free(q);
+}
+END_TEST
+
+START_TEST (output_string_free_foreign)
+{
+	ptab_string_t str, copy;
+	char *buf;
+	int i;
+
+	/* memory that isn't an output string is never looked at */
+	buf = malloc(4);
+	ck_assert(buf != NULL);
+	str.str = buf;
+	str.len = 4;
+
+	err = ptab_free_string(p, &str);
+	ck_assert_int_eq(err, PTAB_OK);
+	free(buf);
+
+	/* nor is one that was released, even once the table let it go */
+	ptab_dumps(p, &str, PTAB_ASCII);
+	copy = str;
+	ck_assert_int_eq(ptab_free_string(p, &str), PTAB_OK);
+
+	/* a longer table needs a new block, and the spare one is freed */
+	for (i = 0; i < 200; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, "Longer");
+		ptab_row_data_i(p, "%d", i);
+		ptab_row_data_f(p, "%0.3f", 0.5f);
+		ptab_row_data_i(p, "%d", i);
+		ptab_end_row(p);
+	}
+
+	ck_assert_int_eq(ptab_dumps(p, &str, PTAB_ASCII), PTAB_OK);
+
+	ck_assert_int_eq(ptab_free_string(p, &copy), PTAB_OK);
+	ck_assert_int_eq(ptab_free_string(p, &str), PTAB_OK);
+}
+END_TEST
+
 TCase *output_test_case(void)
 {
 	TCase *tc;
@@ -259,6 +353,9 @@ TCase *output_test_case(void)
 	tcase_add_test(tc, output_string_free);
 	tcase_add_test(tc, output_string_free_null);
 	tcase_add_test(tc, output_string_free_multi);
+	tcase_add_test(tc, output_string_free_reuse);
+	tcase_add_test(tc, output_string_free_other);
+	tcase_add_test(tc, output_string_free_foreign);
 
 	return tc;
 }
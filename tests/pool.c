@@ -0,0 +1,201 @@
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <check.h>
+#include <ptab.h>
+
+static ptab_pool_t *pool;
+static int err;
+static int num_allocs;
+static int num_frees;
+
+static void *counting_alloc(size_t size, void *opaque)
+{
+	(void)opaque;
+
+	__sync_fetch_and_add(&num_allocs, 1);
+	return malloc(size);
+}
+
+static void counting_free(void *ptr, void *opaque)
+{
+	(void)opaque;
+
+	__sync_fetch_and_add(&num_frees, 1);
+	free(ptr);
+}
+
+static void *null_alloc_func(size_t size, void *opaque)
+{
+	(void)size;
+	(void)opaque;
+
+	return NULL;
+}
+
+static void fixture_init(void)
+{
+	ptab_allocator_t pa;
+
+	pa.alloc_func = counting_alloc;
+	pa.free_func = counting_free;
+	pa.opaque = NULL;
+
+	num_allocs = 0;
+	num_frees = 0;
+	pool = ptab_pool_init(&pa);
+}
+
+static void fixture_free(void)
+{
+	ptab_pool_free(pool);
+}
+
+/* build, render and free a small table using the pool */
+static int build_table(ptab_pool_t *pool, int rows)
+{
+	ptab_allocator_t pa;
+	ptab_string_t s;
+	ptab_t *p;
+	int i, ret;
+
+	ptab_pool_allocator(pool, &pa);
+
+	p = ptab_init(&pa);
+	if (!p)
+		return PTAB_EMEM;
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Value", PTAB_INTEGER);
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, "Some string data");
+		ptab_row_data_i(p, "%d", i);
+		ptab_end_row(p);
+	}
+
+	ret = ptab_dumps(p, &s, PTAB_ASCII);
+	ptab_free(p);
+
+	return ret;
+}
+
+static void *thread_func(void *arg)
+{
+	ptab_pool_t *pool = arg;
+	int i;
+
+	for (i = 0; i < 200; i++) {
+		if (build_table(pool, 10 + (i % 50)) != PTAB_OK)
+			return (void *)1;
+	}
+
+	return NULL;
+}
+
+START_TEST (pool_default)
+{
+	ptab_pool_t *pool;
+
+	pool = ptab_pool_init(NULL);
+	ck_assert(pool != NULL);
+
+	err = build_table(pool, 100);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_pool_free(pool);
+	ck_assert_int_eq(err, PTAB_OK);
+}
+END_TEST
+
+START_TEST (pool_null)
+{
+	ptab_allocator_t pa;
+
+	err = ptab_pool_allocator(NULL, &pa);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_pool_allocator(pool, NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_pool_free(NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (pool_nomem)
+{
+	ptab_allocator_t pa;
+
+	pa.alloc_func = null_alloc_func;
+	pa.free_func = counting_free;
+	pa.opaque = NULL;
+
+	ck_assert(ptab_pool_init(&pa) == NULL);
+
+	pa.alloc_func = NULL;
+	ck_assert(ptab_pool_init(&pa) == NULL);
+}
+END_TEST
+
+START_TEST (pool_reuse)
+{
+	int allocs;
+	int i;
+
+	err = build_table(pool, 500);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* tables of the same shape should be built from cached blocks */
+	allocs = num_allocs;
+
+	for (i = 0; i < 10; i++) {
+		err = build_table(pool, 500);
+		ck_assert_int_eq(err, PTAB_OK);
+	}
+
+	ck_assert_int_eq(num_allocs, allocs);
+}
+END_TEST
+
+START_TEST (pool_threads)
+{
+	pthread_t threads[4];
+	void *retval;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, thread_func, pool);
+
+	for (i = 0; i < 4; i++) {
+		pthread_join(threads[i], &retval);
+		ck_assert(retval == NULL);
+	}
+
+	/* the main thread can use blocks returned by the others */
+	err = build_table(pool, 100);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* everything is given back when the pool is freed */
+	ptab_pool_free(pool);
+	pool = NULL;
+	ck_assert_int_eq(num_allocs, num_frees);
+}
+END_TEST
+
+TCase *pool_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Pool");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, pool_default);
+	tcase_add_test(tc, pool_null);
+	tcase_add_test(tc, pool_nomem);
+	tcase_add_test(tc, pool_reuse);
+	tcase_add_test(tc, pool_threads);
+
+	return tc;
+}
@@ -0,0 +1,201 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include <ptab.h>
+
+static ptab_t *p;
+static int err;
+static int num_allocs;
+
+static void *counting_alloc(size_t size, void *opaque)
+{
+	(void)opaque;
+
+	num_allocs++;
+	return malloc(size);
+}
+
+static void counting_free(void *ptr, void *opaque)
+{
+	(void)opaque;
+
+	free(ptr);
+}
+
+static void fill_table(ptab_t *p, int rows)
+{
+	int i;
+
+	for (i = 0; i < rows; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 2) ? "Longer string" : "Short");
+		ptab_row_data_i(p, "%d", i);
+		ptab_end_row(p);
+	}
+}
+
+static void fixture_init(void)
+{
+	ptab_allocator_t pa;
+
+	pa.alloc_func = counting_alloc;
+	pa.free_func = counting_free;
+	pa.opaque = NULL;
+
+	num_allocs = 0;
+	p = ptab_init(&pa);
+
+	ptab_column(p, "Name", PTAB_STRING);
+	ptab_column(p, "Value", PTAB_INTEGER);
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+}
+
+START_TEST (reset_default)
+{
+	static const char expected_output[] =
+		"+------+-------+\n"
+		"| Name | Value |\n"
+		"+------+-------+\n"
+		"| A    |     1 |\n"
+		"+------+-------+\n";
+	ptab_string_t string;
+
+	fill_table(p, 10);
+
+	err = ptab_reset(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* column widths should start over as well */
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "A");
+	ptab_row_data_i(p, "%d", 1);
+	ptab_end_row(p);
+
+	err = ptab_dumps(p, &string, PTAB_ASCII);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_int_eq(string.len, strlen(expected_output));
+	ck_assert(strncmp(string.str, expected_output, string.len) == 0);
+}
+END_TEST
+
+START_TEST (reset_null)
+{
+	err = ptab_reset(NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (reset_norows)
+{
+	err = ptab_reset(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* the columns must survive a reset before any rows */
+	fill_table(p, 1);
+
+	err = ptab_reset(p);
+	ck_assert_int_eq(err, PTAB_OK);
+}
+END_TEST
+
+START_TEST (reset_unfinished)
+{
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "Dropped");
+
+	err = ptab_reset(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_begin_row(p);
+	ck_assert_int_eq(err, PTAB_OK);
+}
+END_TEST
+
+START_TEST (reset_noalloc)
+{
+	FILE *f;
+	int allocs;
+	int i;
+
+	f = fopen("/dev/null", "w");
+
+	/* the first cycle is allowed to allocate */
+	fill_table(p, 5000);
+	ptab_dumpf(p, f, PTAB_ASCII);
+	ptab_reset(p);
+
+	allocs = num_allocs;
+
+	for (i = 0; i < 5; i++) {
+		fill_table(p, 5000);
+		ptab_dumpf(p, f, PTAB_ASCII);
+
+		err = ptab_reset(p);
+		ck_assert_int_eq(err, PTAB_OK);
+	}
+
+	ck_assert_int_eq(num_allocs, allocs);
+
+	fclose(f);
+}
+END_TEST
+
+START_TEST (clear_default)
+{
+	static const char expected_output[] =
+		"+-------+\n"
+		"| Other |\n"
+		"+-------+\n"
+		"| x     |\n"
+		"+-------+\n";
+	ptab_string_t string;
+
+	fill_table(p, 10);
+
+	err = ptab_clear(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* columns can be defined again after a clear */
+	err = ptab_column(p, "Other", PTAB_STRING);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "x");
+	ptab_end_row(p);
+
+	err = ptab_dumps(p, &string, PTAB_ASCII);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_int_eq(string.len, strlen(expected_output));
+	ck_assert(strncmp(string.str, expected_output, string.len) == 0);
+}
+END_TEST
+
+START_TEST (clear_null)
+{
+	err = ptab_clear(NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+TCase *reset_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Reset");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, reset_default);
+	tcase_add_test(tc, reset_null);
+	tcase_add_test(tc, reset_norows);
+	tcase_add_test(tc, reset_unfinished);
+	tcase_add_test(tc, reset_noalloc);
+	tcase_add_test(tc, clear_default);
+	tcase_add_test(tc, clear_null);
+
+	return tc;
+}
@@ -1,4 +1,7 @@
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <check.h>
 #include <ptab.h>
 
@@ -129,6 +132,8 @@ END_TEST
 
 START_TEST (row_data_s_nomem)
 {
+	/* the row has to move to a new chunk once its heap is full */
+	p->cursor.chunk->heap_used = p->cursor.chunk->heap_size;
 	ptab__mem_disable(p);
 
 	err = ptab_row_data_s(p, "Row data");
@@ -164,6 +169,186 @@ START_TEST (row_data_s_numcolumns)
 }
 END_TEST
 
+START_TEST (row_data_s_inline)
+{
+	struct ptab_chunk *chunk = p->cursor.chunk;
+	const struct ptab_cell *cell;
+	uint32_t used = chunk->heap_used;
+
+	/* short text goes in the cell, and not in the heap */
+	err = ptab_row_data_s(p, "ABCD");
+	ck_assert_int_eq(err, PTAB_OK);
+
+	cell = &chunk->cells[chunk_cell(chunk, 0, p->cursor.row)];
+	ck_assert(cell_flags(chunk, cell) & CELL_INLINE);
+	ck_assert_uint_eq(cell->len, 4);
+	ck_assert(memcmp(chunk_str(chunk, cell), "ABCD", 4) == 0);
+	ck_assert_uint_eq(chunk->heap_used, used);
+
+	err = ptab_row_data_i(p, "%d", 12345);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	cell = &chunk->cells[chunk_cell(chunk, 1, p->cursor.row)];
+	ck_assert(!(cell_flags(chunk, cell) & CELL_INLINE));
+	ck_assert(memcmp(chunk_str(chunk, cell), "12345", 5) == 0);
+	ck_assert_uint_eq(chunk->heap_used, used + 5);
+}
+END_TEST
+
+START_TEST (row_data_sn_default)
+{
+	const char text[] = "Row data, and more";
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+
+	/* only the first 8 bytes, which aren't NUL-terminated */
+	err = ptab_row_data_sn(p, text, 8);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	chunk = p->cursor.chunk;
+	cell = &chunk->cells[chunk_cell(chunk, 0, p->cursor.row)];
+	ck_assert_uint_eq(cell->len, 8);
+	ck_assert(chunk_str(chunk, cell) != text);
+	ck_assert(memcmp(chunk_str(chunk, cell), "Row data", 8) == 0);
+	ck_assert_uint_eq(p->columns_head->width, 8);
+}
+END_TEST
+
+START_TEST (row_data_sn_null)
+{
+	err = ptab_row_data_sn(NULL, "Row data", 8);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_row_data_sn(p, NULL, 0);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (row_data_str_default)
+{
+	ptab_string_t str = { "Row data, and more", 8 };
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+
+	err = ptab_row_data_str(p, &str);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	chunk = p->cursor.chunk;
+	cell = &chunk->cells[chunk_cell(chunk, 0, p->cursor.row)];
+	ck_assert_uint_eq(cell->len, 8);
+	ck_assert(memcmp(chunk_str(chunk, cell), "Row data", 8) == 0);
+}
+END_TEST
+
+START_TEST (row_data_str_null)
+{
+	ptab_string_t str = { NULL, 0 };
+
+	err = ptab_row_data_str(NULL, &str);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_row_data_str(p, NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_row_data_str(p, &str);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (row_data_s_ref_default)
+{
+	const char text[] = "Row data, and more";
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+
+	/* only the first 8 bytes, which aren't NUL-terminated */
+	err = ptab_row_data_s_ref(p, text, 8);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	chunk = p->cursor.chunk;
+	cell = &chunk->cells[chunk_cell(chunk, 0, p->cursor.row)];
+	ck_assert_uint_eq(cell->len, 8);
+	ck_assert(chunk_str(chunk, cell) == text);
+	ck_assert_uint_eq(p->columns_head->width, 8);
+}
+END_TEST
+
+START_TEST (row_data_s_ref_null)
+{
+	err = ptab_row_data_s_ref(NULL, "Row data", 8);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_row_data_s_ref(p, NULL, 0);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (row_data_s_ref_range)
+{
+	err = ptab_row_data_s_ref(p, "Row data", (size_t)CELL_MAX + 1);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	/* a cell's flags are kept apart, so all of its len is the length */
+	err = ptab_row_data_s_ref(p, "Row data", CELL_MAX);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_uint_eq(p->cursor.chunk->cells[0].len, CELL_MAX);
+	ck_assert(cell_flags(p->cursor.chunk, &p->cursor.chunk->cells[0]) & CELL_REF);
+}
+END_TEST
+
+START_TEST (row_data_s_ref_type)
+{
+	err = ptab_row_data_s_ref(p, "Row data", 8);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_row_data_s_ref(p, "Row data", 8);
+	ck_assert_int_eq(err, PTAB_ETYPE);
+}
+END_TEST
+
+START_TEST (row_data_s_ref_moved)
+{
+	static const char expected_output[] =
+		"+----------+--------+-----+\n"
+		"| S        | I      | F   |\n"
+		"+----------+--------+-----+\n"
+		"| Row data | 123456 | 2.5 |\n"
+		"+----------+--------+-----+\n";
+	const char text[] = "Row data";
+	const struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+	ptab_string_t s;
+
+	err = ptab_row_data_s_ref(p, text, 8);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* the row moves to a new chunk, and takes the pointer with it */
+	p->cursor.chunk->heap_used = p->cursor.chunk->heap_size;
+
+	err = ptab_row_data_i(p, "%d", 123456);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_row_data_f(p, "%.1f", 2.5);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_end_row(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	chunk = p->rows.tail;
+	ck_assert(chunk != p->rows.head);
+
+	cell = &chunk->cells[chunk_cell(chunk, 0, 0)];
+	ck_assert_uint_eq(cell->len, 8);
+	ck_assert(chunk_str(chunk, cell) == text);
+
+	err = ptab_dumps(p, &s, PTAB_ASCII);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_int_eq(s.len, strlen(expected_output));
+	ck_assert(strncmp(s.str, expected_output, s.len) == 0);
+	ptab_free_string(p, &s);
+}
+END_TEST
+
 START_TEST (row_data_i_default)
 {
 	err = ptab_row_data_i(p, "%d", 5);
@@ -183,15 +368,56 @@ END_TEST
 
 START_TEST (row_data_i_nomem)
 {
+	/* the row has to move to a new chunk once its heap is full */
+	p->cursor.chunk->heap_used = p->cursor.chunk->heap_size;
 	ptab__mem_disable(p);
 
-	err = ptab_row_data_i(p, "%d", 5);
+	/* too long to go in the cell */
+	err = ptab_row_data_i(p, "%d", 123456);
 	ck_assert_int_eq(err, PTAB_EMEM);
 
 	ptab__mem_enable(p);
 }
 END_TEST
 
+START_TEST (row_data_i_heap_full)
+{
+	struct ptab_chunk *chunk;
+	const struct ptab_cell *cell;
+	char s[2048];
+
+	memset(s, 'x', sizeof(s) - 1);
+	s[sizeof(s) - 1] = '\0';
+
+	err = ptab_row_data_i(p, "%d", 5);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* too long for the chunk's heap, so the row moves to a new one */
+	err = ptab_row_data_s(p, s);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_row_data_f(p, "%.1f", 2.5);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_end_row(p);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	chunk = p->rows.tail;
+	ck_assert(chunk != p->rows.head);
+	ck_assert_uint_eq(chunk->num_rows, 1);
+	ck_assert_uint_eq(p->rows.head->num_rows, 0);
+
+	cell = &chunk->cells[chunk_cell(chunk, 0, 0)];
+	ck_assert_uint_eq(cell->len, 1);
+	ck_assert(memcmp(chunk_str(chunk, cell), "5", 1) == 0);
+	ck_assert_int_eq(chunk->values[chunk_cell(chunk, 0, 0)].i, 5);
+
+	cell = &chunk->cells[chunk_cell(chunk, 1, 0)];
+	ck_assert_uint_eq(cell->len, sizeof(s) - 1);
+	ck_assert(memcmp(chunk_str(chunk, cell), s, sizeof(s) - 1) == 0);
+}
+END_TEST
+
 START_TEST (row_data_i_type)
 {
 	err = ptab_row_data_i(p, "%d", 5);
@@ -237,6 +463,8 @@ END_TEST
 
 START_TEST (row_data_f_nomem)
 {
+	/* the row has to move to a new chunk once its heap is full */
+	p->cursor.chunk->heap_used = p->cursor.chunk->heap_size;
 	ptab__mem_disable(p);
 
 	err = ptab_row_data_f(p, "%f", 5.0);
@@ -315,6 +543,271 @@ START_TEST (end_row_notbegun)
 }
 END_TEST
 
+static int num_allocs;
+
+static void *counting_alloc(size_t size, void *opaque)
+{
+	(void)opaque;
+
+	num_allocs++;
+	return malloc(size);
+}
+
+static void counting_free(void *ptr, void *opaque)
+{
+	(void)opaque;
+
+	free(ptr);
+}
+
+static void fixture_reserve(void)
+{
+	ptab_allocator_t pa;
+
+	pa.alloc_func = counting_alloc;
+	pa.free_func = counting_free;
+	pa.opaque = NULL;
+
+	num_allocs = 0;
+	p = ptab_init(&pa);
+
+	ptab_column(p, "S", PTAB_STRING);
+	ptab_column(p, "I", PTAB_INTEGER);
+}
+
+START_TEST (reserve_default)
+{
+	int allocs;
+	int i;
+
+	/* 8 characters in each string, 4 in each integer */
+	err = ptab_reserve(p, 10000, 10000 * (8 + 4));
+	ck_assert_int_eq(err, PTAB_OK);
+
+	allocs = num_allocs;
+
+	for (i = 0; i < 10000; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, "abcdefgh");
+		ptab_row_data_i(p, "%04d", i);
+
+		err = ptab_end_row(p);
+		ck_assert_int_eq(err, PTAB_OK);
+	}
+
+	ck_assert_int_eq(num_allocs, allocs);
+}
+END_TEST
+
+START_TEST (reserve_null)
+{
+	err = ptab_reserve(NULL, 10, 10);
+	ck_assert_int_eq(err, PTAB_ENULL);
+}
+END_TEST
+
+START_TEST (reserve_nocolumns)
+{
+	ptab_t *p;
+
+	p = ptab_init(NULL);
+
+	err = ptab_reserve(p, 10, 10);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	ptab_free(p);
+}
+END_TEST
+
+START_TEST (reserve_nomem)
+{
+	ptab__mem_disable(p);
+
+	err = ptab_reserve(p, 10000, 10000);
+	ck_assert_int_eq(err, PTAB_EMEM);
+
+	ptab__mem_enable(p);
+}
+END_TEST
+
+START_TEST (reserve_range)
+{
+	err = ptab_reserve(p, (size_t)-1 / 2, 0);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+
+	err = ptab_reserve(p, 10, (size_t)-1);
+	ck_assert_int_eq(err, PTAB_ERANGE);
+}
+END_TEST
+
+START_TEST (reserve_reuse)
+{
+	int allocs;
+	int i;
+
+	ptab_reserve(p, 1000, 1000 * 12);
+
+	for (i = 0; i < 1000; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, "abcdefgh");
+		ptab_row_data_i(p, "%04d", i);
+		ptab_end_row(p);
+	}
+
+	/* after a reset, the reserved block is found again */
+	ptab_reset(p);
+	allocs = num_allocs;
+
+	err = ptab_reserve(p, 1000, 1000 * 12);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_int_eq(num_allocs, allocs);
+}
+END_TEST
+
+static void set_row(ptab_value_t *v, const char *s, int i, float f)
+{
+	v[0].format = NULL;
+	v[0].data.s = s;
+	v[1].format = "%d";
+	v[1].data.i = i;
+	v[2].format = "%.2f";
+	v[2].data.f = f;
+}
+
+START_TEST (append_rows_default)
+{
+	static const char *names[] = { "a", "longer name", "" };
+	ptab_value_t cells[3 * 3];
+	ptab_string_t s1, s2;
+	ptab_t *q;
+	int i;
+
+	q = ptab_init(NULL);
+	ptab_column(q, "StringColumn", PTAB_STRING);
+	ptab_column(q, "IntegerColumn", PTAB_INTEGER);
+	ptab_column(q, "FloatColumn", PTAB_FLOAT);
+
+	for (i = 0; i < 3; i++) {
+		set_row(cells + i * 3, names[i], i * 1000, (float)i / 4.0f);
+
+		ptab_begin_row(q);
+		ptab_row_data_s(q, names[i]);
+		ptab_row_data_i(q, "%d", i * 1000);
+		ptab_row_data_f(q, "%.2f", (float)i / 4.0f);
+		ptab_end_row(q);
+	}
+
+	err = ptab_append_rows(p, cells, 3);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* the same table as one built a cell at a time */
+	ptab_dumps(p, &s1, PTAB_ASCII);
+	ptab_dumps(q, &s2, PTAB_ASCII);
+
+	ck_assert_uint_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+
+	ptab_free(q);
+}
+END_TEST
+
+START_TEST (append_rows_many)
+{
+	ptab_value_t *cells;
+	int i;
+
+	/* more than one chunk, after a row added the usual way */
+	ptab_begin_row(p);
+	ptab_row_data_s(p, "first");
+	ptab_row_data_i(p, "%d", 0);
+	ptab_row_data_f(p, "%.2f", 0.0f);
+	ptab_end_row(p);
+
+	cells = malloc(10000 * 3 * sizeof(*cells));
+	ck_assert(cells != NULL);
+
+	for (i = 0; i < 10000; i++)
+		set_row(cells + i * 3, (i == 5000) ? "the longest string" : "s", i, 1.5f);
+
+	err = ptab_append_rows(p, cells, 10000);
+	ck_assert_int_eq(err, PTAB_OK);
+	ck_assert_uint_eq(p->num_rows, 10001);
+
+	/* the widths are fit to the whole batch */
+	ck_assert_uint_eq(p->columns_head->width, strlen("the longest string"));
+	ck_assert_uint_eq(p->columns_head->next->width, strlen("IntegerColumn"));
+
+	free(cells);
+}
+END_TEST
+
+START_TEST (append_rows_null)
+{
+	ptab_value_t cells[2 * 3];
+
+	set_row(cells, "a", 1, 1.0f);
+	set_row(cells + 3, "b", 2, 2.0f);
+
+	err = ptab_append_rows(NULL, cells, 2);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_append_rows(p, NULL, 2);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	/* a bad cell anywhere means none of the batch is added */
+	cells[3].data.s = NULL;
+	err = ptab_append_rows(p, cells, 2);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	cells[3].data.s = "b";
+	cells[5].format = NULL;
+	err = ptab_append_rows(p, cells, 2);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	ck_assert_uint_eq(p->num_rows, 0);
+
+	err = ptab_append_rows(p, NULL, 0);
+	ck_assert_int_eq(err, PTAB_OK);
+}
+END_TEST
+
+START_TEST (append_rows_order)
+{
+	ptab_value_t cells[3];
+	ptab_t *q;
+
+	set_row(cells, "a", 1, 1.0f);
+
+	q = ptab_init(NULL);
+
+	err = ptab_append_rows(q, cells, 1);
+	ck_assert_int_eq(err, PTAB_EORDER);
+
+	ptab_free(q);
+
+	ptab_begin_row(p);
+
+	err = ptab_append_rows(p, cells, 1);
+	ck_assert_int_eq(err, PTAB_EORDER);
+}
+END_TEST
+
+START_TEST (append_rows_nomem)
+{
+	ptab_value_t cells[3];
+
+	set_row(cells, "a", 1, 1.0f);
+
+	ptab__mem_disable(p);
+
+	err = ptab_append_rows(p, cells, 1);
+	ck_assert_int_eq(err, PTAB_EMEM);
+	ck_assert_uint_eq(p->num_rows, 0);
+
+	ptab__mem_enable(p);
+}
+END_TEST
+
 TCase *begin_row_test_case(void)
 {
 	TCase *tc;
@@ -342,6 +835,26 @@ TCase *row_data_s_test_case(void)
 	tcase_add_test(tc, row_data_s_nomem);
 	tcase_add_test(tc, row_data_s_type);
 	tcase_add_test(tc, row_data_s_numcolumns);
+	tcase_add_test(tc, row_data_s_inline);
+	tcase_add_test(tc, row_data_sn_default);
+	tcase_add_test(tc, row_data_sn_null);
+	tcase_add_test(tc, row_data_str_default);
+	tcase_add_test(tc, row_data_str_null);
+
+	return tc;
+}
+
+TCase *row_data_s_ref_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Row Data (Borrowed String)");
+	tcase_add_checked_fixture(tc, fixture_begin_row_s, fixture_free);
+	tcase_add_test(tc, row_data_s_ref_default);
+	tcase_add_test(tc, row_data_s_ref_null);
+	tcase_add_test(tc, row_data_s_ref_range);
+	tcase_add_test(tc, row_data_s_ref_type);
+	tcase_add_test(tc, row_data_s_ref_moved);
 
 	return tc;
 }
@@ -355,6 +868,7 @@ TCase *row_data_i_test_case(void)
 	tcase_add_test(tc, row_data_i_default);
 	tcase_add_test(tc, row_data_i_null);
 	tcase_add_test(tc, row_data_i_nomem);
+	tcase_add_test(tc, row_data_i_heap_full);
 	tcase_add_test(tc, row_data_i_type);
 	tcase_add_test(tc, row_data_i_numcolumns);
 
@@ -376,6 +890,22 @@ TCase *row_data_f_test_case(void)
 	return tc;
 }
 
+TCase *reserve_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Reserve");
+	tcase_add_checked_fixture(tc, fixture_reserve, fixture_free);
+	tcase_add_test(tc, reserve_default);
+	tcase_add_test(tc, reserve_null);
+	tcase_add_test(tc, reserve_nocolumns);
+	tcase_add_test(tc, reserve_nomem);
+	tcase_add_test(tc, reserve_range);
+	tcase_add_test(tc, reserve_reuse);
+
+	return tc;
+}
+
 TCase *end_row_test_case(void)
 {
 	TCase *tc;
@@ -389,3 +919,18 @@ TCase *end_row_test_case(void)
 
 	return tc;
 }
+
+TCase *append_rows_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Append Rows");
+	tcase_add_checked_fixture(tc, fixture_init_columns, fixture_free);
+	tcase_add_test(tc, append_rows_default);
+	tcase_add_test(tc, append_rows_many);
+	tcase_add_test(tc, append_rows_null);
+	tcase_add_test(tc, append_rows_order);
+	tcase_add_test(tc, append_rows_nomem);
+
+	return tc;
+}
@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include <ptab.h>
+
+#include "../src/internal.h"
+
+static ptab_t *p;
+static ptab_t *q;
+
+static void setup_table(ptab_t *t)
+{
+	ptab_column(t, "Host", PTAB_STRING);
+	ptab_column(t, "Requests", PTAB_INTEGER);
+	ptab_column(t, "Load", PTAB_FLOAT);
+	ptab_column_align(t, 1, PTAB_RIGHT);
+}
+
+static void fill_table(ptab_t *t, int first, int rows)
+{
+	int i;
+
+	for (i = first; i < first + rows; i++) {
+		ptab_begin_row(t);
+		ptab_row_data_s(t, (i % 5) ? "web" : "database-replica");
+		ptab_row_data_i(t, "%d", i * 7);
+		ptab_row_data_f(t, "%.2f", (float)i / 3.0f);
+		ptab_end_row(t);
+	}
+}
+
+/* p spills to disk, q is the same table kept in memory */
+static void fixture_init(void)
+{
+	p = ptab_init(NULL);
+	q = ptab_init(NULL);
+
+	setup_table(p);
+	setup_table(q);
+}
+
+static void fixture_free(void)
+{
+	ptab_free(p);
+	ptab_free(q);
+}
+
+static void assert_same_output(enum ptab_format fmt)
+{
+	ptab_string_t s1, s2;
+
+	ck_assert_int_eq(ptab_dumps(p, &s1, fmt), PTAB_OK);
+	ck_assert_int_eq(ptab_dumps(q, &s2, fmt), PTAB_OK);
+
+	ck_assert_int_eq(s1.len, s2.len);
+	ck_assert(memcmp(s1.str, s2.str, s1.len) == 0);
+
+	ptab_free_string(p, &s1);
+	ptab_free_string(q, &s2);
+}
+
+START_TEST (spill_identical)
+{
+	ptab_mem_stats_t stats;
+	int err;
+
+	err = ptab_set_memory_limit(p, 64 * 1024, NULL);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	fill_table(p, 0, 50000);
+	fill_table(q, 0, 50000);
+
+	ck_assert(p->spill.num_rows > 0);
+	ck_assert_int_eq(p->num_rows, 50000);
+
+	/* the rows never took much more than the limit */
+	ptab_mem_stats(p, &stats);
+	ck_assert(stats.peak < 512 * 1024);
+
+	assert_same_output(PTAB_ASCII);
+	assert_same_output(PTAB_UNICODE);
+}
+END_TEST
+
+START_TEST (spill_append_rows)
+{
+	ptab_value_t cells[1000 * 3];
+	ptab_mem_stats_t stats;
+	int err;
+	int i, j;
+
+	err = ptab_set_memory_limit(p, 64 * 1024, NULL);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 0; i < 50000; i += 1000) {
+		for (j = 0; j < 1000; j++) {
+			cells[j * 3].data.s = ((i + j) % 5) ? "web" : "database-replica";
+			cells[j * 3 + 1].format = "%d";
+			cells[j * 3 + 1].data.i = (i + j) * 7;
+			cells[j * 3 + 2].format = "%.2f";
+			cells[j * 3 + 2].data.f = (float)(i + j) / 3.0f;
+		}
+
+		err = ptab_append_rows(p, cells, 1000);
+		ck_assert_int_eq(err, PTAB_OK);
+	}
+
+	fill_table(q, 0, 50000);
+
+	ck_assert(p->spill.num_rows > 0);
+	ck_assert_int_eq(p->num_rows, 50000);
+
+	/* a batch is held to the limit like rows added one at a time */
+	ptab_mem_stats(p, &stats);
+	ck_assert(stats.peak < 512 * 1024);
+
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_column_data)
+{
+	const char *hosts[1000];
+	int requests[1000];
+	float loads[1000];
+	ptab_mem_stats_t stats;
+	int err;
+	int i, j;
+
+	err = ptab_set_memory_limit(p, 64 * 1024, NULL);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	for (i = 0; i < 50000; i += 1000) {
+		for (j = 0; j < 1000; j++) {
+			hosts[j] = ((i + j) % 5) ? "web" : "database-replica";
+			requests[j] = (i + j) * 7;
+			loads[j] = (float)(i + j) / 3.0f;
+		}
+
+		ptab_column_data_s(p, 0, hosts, 1000);
+		ptab_column_data_i(p, 1, "%d", requests, 1000);
+		ptab_column_data_f(p, 2, "%.2f", loads, 1000);
+	}
+
+	fill_table(q, 0, 50000);
+
+	ck_assert(p->spill.num_rows > 0);
+	ck_assert_int_eq(p->num_rows, 50000);
+
+	/* each load is finished, and can spill, once the columns match */
+	ptab_mem_stats(p, &stats);
+	ck_assert(stats.peak < 512 * 1024);
+
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_row_data_s_ref)
+{
+	static const char hosts[] = "webdatabase-replica";
+	int err;
+	int i;
+
+	err = ptab_set_memory_limit(p, 64 * 1024, NULL);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* borrowed text is copied into the spill file */
+	for (i = 0; i < 50000; i++) {
+		ptab_begin_row(p);
+		if (i % 5)
+			ptab_row_data_s_ref(p, hosts, 3);
+		else
+			ptab_row_data_s_ref(p, hosts + 3, 16);
+		ptab_row_data_i(p, "%d", i * 7);
+		ptab_row_data_f(p, "%.2f", (float)i / 3.0f);
+		ptab_end_row(p);
+	}
+
+	fill_table(q, 0, 50000);
+
+	ck_assert(p->spill.num_rows > 0);
+	ck_assert_int_eq(p->num_rows, 50000);
+
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_dict)
+{
+	int err;
+
+	err = ptab_column_dict(p, 0);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	err = ptab_set_memory_limit(p, 64 * 1024, NULL);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* each spill takes the values with it, and starts a new dictionary */
+	fill_table(p, 0, 50000);
+	fill_table(q, 0, 50000);
+
+	ck_assert(p->spill.num_rows > 0);
+	ck_assert_uint_eq(p->columns_head->dict->count, 2);
+
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_lazy)
+{
+	int err;
+	int i;
+
+	ck_assert_int_eq(ptab_column_lazy(p, 1, "%d"), PTAB_OK);
+	ck_assert_int_eq(ptab_column_lazy(p, 2, "%.2f"), PTAB_OK);
+
+	err = ptab_set_memory_limit(p, 64 * 1024, NULL);
+	ck_assert_int_eq(err, PTAB_OK);
+
+	/* lazy cells are formatted on their way to the spill file */
+	for (i = 0; i < 50000; i++) {
+		ptab_begin_row(p);
+		ptab_row_data_s(p, (i % 5) ? "web" : "database-replica");
+		ptab_row_data_i(p, NULL, i * 7);
+		ptab_row_data_f(p, NULL, (float)i / 3.0f);
+		ptab_end_row(p);
+	}
+
+	fill_table(q, 0, 50000);
+
+	ck_assert(p->spill.num_rows > 0);
+
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_dumpf)
+{
+	char *buf1, *buf2;
+	size_t len1, len2;
+	FILE *f1, *f2;
+
+	ck_assert_int_eq(ptab_set_memory_limit(p, 16 * 1024, NULL), PTAB_OK);
+
+	fill_table(p, 0, 20000);
+	fill_table(q, 0, 20000);
+
+	f1 = tmpfile();
+	f2 = tmpfile();
+	ck_assert(f1 != NULL && f2 != NULL);
+
+	ck_assert_int_eq(ptab_dumpf(p, f1, PTAB_UNICODE), PTAB_OK);
+	ck_assert_int_eq(ptab_dumpf(q, f2, PTAB_UNICODE), PTAB_OK);
+
+	len1 = (size_t)ftell(f1);
+	len2 = (size_t)ftell(f2);
+	ck_assert_int_eq(len1, len2);
+
+	buf1 = malloc(len1);
+	buf2 = malloc(len2);
+	rewind(f1);
+	rewind(f2);
+	ck_assert_int_eq(fread(buf1, 1, len1, f1), len1);
+	ck_assert_int_eq(fread(buf2, 1, len2, f2), len2);
+	ck_assert(memcmp(buf1, buf2, len1) == 0);
+
+	free(buf1);
+	free(buf2);
+	fclose(f1);
+	fclose(f2);
+}
+END_TEST
+
+START_TEST (spill_more_rows)
+{
+	ck_assert_int_eq(ptab_set_memory_limit(p, 32 * 1024, NULL), PTAB_OK);
+
+	/* rows keep going to the file after it has been read back */
+	fill_table(p, 0, 10000);
+	fill_table(q, 0, 10000);
+	assert_same_output(PTAB_ASCII);
+
+	fill_table(p, 10000, 10000);
+	fill_table(q, 10000, 10000);
+	assert_same_output(PTAB_ASCII);
+
+	/* with no limit, the new rows stay in memory */
+	ck_assert_int_eq(ptab_set_memory_limit(p, 0, NULL), PTAB_OK);
+	fill_table(p, 20000, 10000);
+	fill_table(q, 20000, 10000);
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_reset)
+{
+	ck_assert_int_eq(ptab_set_memory_limit(p, 16 * 1024, NULL), PTAB_OK);
+
+	fill_table(p, 0, 20000);
+	ck_assert(p->spill.num_rows > 0);
+
+	ptab_reset(p);
+	ck_assert_int_eq(p->spill.num_rows, 0);
+
+	fill_table(p, 100, 5000);
+	fill_table(q, 100, 5000);
+	assert_same_output(PTAB_ASCII);
+}
+END_TEST
+
+START_TEST (spill_errors)
+{
+	int err;
+
+	err = ptab_set_memory_limit(NULL, 1024, NULL);
+	ck_assert_int_eq(err, PTAB_ENULL);
+
+	err = ptab_set_memory_limit(p, 1024, "/nonexistent/ptab/dir");
+	ck_assert_int_eq(err, PTAB_EIO);
+
+	/* turning the limit off doesn't need a directory */
+	err = ptab_set_memory_limit(p, 0, "/nonexistent/ptab/dir");
+	ck_assert_int_eq(err, PTAB_OK);
+}
+END_TEST
+
+TCase *spill_test_case(void)
+{
+	TCase *tc;
+
+	tc = tcase_create("Spill");
+	tcase_add_checked_fixture(tc, fixture_init, fixture_free);
+	tcase_add_test(tc, spill_identical);
+	tcase_add_test(tc, spill_append_rows);
+	tcase_add_test(tc, spill_column_data);
+	tcase_add_test(tc, spill_row_data_s_ref);
+	tcase_add_test(tc, spill_dict);
+	tcase_add_test(tc, spill_lazy);
+	tcase_add_test(tc, spill_dumpf);
+	tcase_add_test(tc, spill_more_rows);
+	tcase_add_test(tc, spill_reset);
+	tcase_add_test(tc, spill_errors);
+
+	return tc;
+}
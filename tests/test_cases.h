@@ -7,12 +7,28 @@ extern TCase *version_test_case(void);
 extern TCase *error_test_case(void);
 extern TCase *init_test_case(void);
 extern TCase *free_test_case(void);
+extern TCase *mem_test_case(void);
+extern TCase *pool_test_case(void);
 extern TCase *column_test_case(void);
 extern TCase *begin_row_test_case(void);
 extern TCase *row_data_s_test_case(void);
+extern TCase *row_data_s_ref_test_case(void);
 extern TCase *row_data_i_test_case(void);
 extern TCase *row_data_f_test_case(void);
 extern TCase *end_row_test_case(void);
+extern TCase *reserve_test_case(void);
+extern TCase *append_rows_test_case(void);
+extern TCase *load_test_case(void);
+extern TCase *dict_test_case(void);
+extern TCase *lazy_test_case(void);
+extern TCase *format_test_case(void);
+extern TCase *number_test_case(void);
+extern TCase *int64_test_case(void);
+extern TCase *decimal_test_case(void);
+extern TCase *timestamp_test_case(void);
 extern TCase *output_test_case(void);
+extern TCase *reset_test_case(void);
+extern TCase *spill_test_case(void);
+extern TCase *concurrent_test_case(void);
 
 #endif